@@ -9,15 +9,72 @@
 #include <Exception.hpp>
 
 ArgParse::ArgParse(int argc, char const *argv[]):
-    parserDebug(false), parseOnly(false), withCSE(true)
+    parserDebug(false), parseOnly(false), withDeadFunction(true), withInline(true), withTailCall(true), withSpecialize(true), withUnroll(true), withCSE(true), withLoadForward(true), withDSE(true), withLICM(true), withSR(true), withRotation(true), withSimplifyCFG(true), withDCE(true), withOutOfSSA(false), runProgram(false), runVM(false), optLevel(2)
 {
     for(int i = 1; i < argc; ++i){
         if(std::string(argv[i]) == "--parser_debug"){
             parserDebug = true;
         }else if(std::string(argv[i]) == "--parse_only"){
             parseOnly = true;
+        }else if(std::string(argv[i]) == "--no_dead_function"){
+            withDeadFunction = false;
+        }else if(std::string(argv[i]) == "--no_inline"){
+            withInline = false;
+        }else if(std::string(argv[i]) == "--no_tail_call"){
+            withTailCall = false;
+        }else if(std::string(argv[i]) == "--no_specialize"){
+            withSpecialize = false;
+        }else if(std::string(argv[i]) == "--no_unroll"){
+            withUnroll = false;
+        }else if(std::string(argv[i]) == "--unroll_factor"){
+            if(++i >= argc){
+                throw Exception("no factor for unroll");
+            }
+            try{
+                unrollFactor = std::stoul(argv[i]);
+            }catch(std::exception&){
+                throw Exception("invalid unroll factor");
+            }
         }else if(std::string(argv[i]) == "--no_cse"){
             withCSE = false;
+        }else if(std::string(argv[i]) == "--no_load_forward"){
+            withLoadForward = false;
+        }else if(std::string(argv[i]) == "--no_dse"){
+            withDSE = false;
+        }else if(std::string(argv[i]) == "--no_licm"){
+            withLICM = false;
+        }else if(std::string(argv[i]) == "--no_sr"){
+            withSR = false;
+        }else if(std::string(argv[i]) == "--no_rotation"){
+            withRotation = false;
+        }else if(std::string(argv[i]) == "--no_simplify_cfg"){
+            withSimplifyCFG = false;
+        }else if(std::string(argv[i]) == "--no_dce"){
+            withDCE = false;
+        }else if(std::string(argv[i]) == "--out_of_ssa"){
+            withOutOfSSA = true;
+        }else if(std::string(argv[i]) == "--run"){
+            runProgram = true;
+        }else if(std::string(argv[i]) == "--run_vm"){
+            runVM = true;
+        }else if(std::string(argv[i]) == "--registers"){
+            if(++i >= argc){
+                throw Exception("no count for registers");
+            }
+            try{
+                registerCount = std::stoul(argv[i]);
+            }catch(std::exception&){
+                throw Exception("invalid register count");
+            }
+            if(*registerCount < 2){
+                throw Exception("at least 2 registers are needed");
+            }
+        }else if(std::string(argv[i]).starts_with("-O")){
+            try{
+                optLevel = std::stoul(std::string(argv[i]).substr(2));
+            }catch(std::exception&){
+                throw Exception("invalid optimization level");
+            }
         }else if(std::string(argv[i]) == "--visualize_ir"){
             if(++i < argc){
                 irVisualizeFile = argv[i];
@@ -28,6 +85,11 @@ ArgParse::ArgParse(int argc, char const *argv[]):
             inputFiles.emplace_back(argv[i]);
         }
     }
+    // No optimization at level 0
+    if(optLevel == 0){
+        withDeadFunction = withInline = withTailCall = withSpecialize = withUnroll = withCSE = withLoadForward = false;
+        withDSE = withLICM = withSR = withRotation = withSimplifyCFG = withDCE = false;
+    }
     // Input files
     if(inputFiles.size() < 1){
         throw Exception("no input file");
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <string>
+#include <optional>
 
 class ArgParse{
 public:
@@ -12,7 +13,25 @@ public:
     std::vector<std::string> inputFiles;
     bool parserDebug;
     bool parseOnly;
+    bool withDeadFunction;
+    bool withInline;
+    bool withTailCall;
+    bool withSpecialize;
+    bool withUnroll;
     bool withCSE;
+    bool withLoadForward;
+    bool withDSE;
+    bool withLICM;
+    bool withSR;
+    bool withRotation;
+    bool withSimplifyCFG;
+    bool withDCE;
+    bool withOutOfSSA;
+    bool runProgram;
+    bool runVM;
+    size_t optLevel;
+    std::optional<size_t> unrollFactor;
+    std::optional<size_t> registerCount;
     std::string irVisualizeFile;
 };
 
@@ -16,8 +16,25 @@
 #include <PrintPass.hpp>
 #include <IRGeneratorPass.hpp>
 #include <IRVisualizerPass.hpp>
-#include <RemapPass.hpp>
+#include <DeadFunctionPass.hpp>
+#include <InlinePass.hpp>
+#include <TailCallPass.hpp>
+#include <SpecializePass.hpp>
+#include <LoopUnrollPass.hpp>
 #include <CSEPass.hpp>
+#include <LoadForwardPass.hpp>
+#include <DSEPass.hpp>
+#include <LICMPass.hpp>
+#include <StrengthReductionPass.hpp>
+#include <LoopRotationPass.hpp>
+#include <SimplifyCFGPass.hpp>
+#include <DCEPass.hpp>
+#include <OutOfSSAPass.hpp>
+#include <LinearScanPass.hpp>
+#include <GraphColoringPass.hpp>
+#include <InterpreterPass.hpp>
+#include <Bytecode.hpp>
+#include <VirtualMachine.hpp>
 
 #include "ColorPrint.hpp"
 #include "ArgParse.hpp"
@@ -60,19 +77,80 @@ int main(int argc, char const *argv[]){
             parserPasses.emplace_back(printPass);
         }
         IRGeneratorPass irGeneratorPass(funcMap);
-        RemapPass remapPass;
         std::optional<IRVisualizerPass> irVisualizerPass;
+        DeadFunctionPass deadFunctionPass;
+        InlinePass inlinePass;
+        TailCallPass tailCallPass;
+        SpecializePass specializePass;
+        LoopUnrollPass loopUnrollPass(arguments.unrollFactor.value_or(LoopUnrollPass::defaultFactor));
         CSEPass csePass;
+        LoadForwardPass loadForwardPass;
+        DSEPass dsePass;
+        LICMPass licmPass;
+        StrengthReductionPass strengthReductionPass;
+        LoopRotationPass loopRotationPass;
+        SimplifyCFGPass simplifyCFGPass;
+        DCEPass dcePass;
+        OutOfSSAPass outOfSSAPass;
+        LinearScanPass linearScanPass(arguments.registerCount.value_or(RegisterAllocPass::defaultRegisters));
+        GraphColoringPass graphColoringPass(arguments.registerCount.value_or(RegisterAllocPass::defaultRegisters));
+        // Linear scan is faster, graph coloring allocates better
+        RegisterAllocPass& registerAllocPass = (arguments.optLevel >= 2) ? static_cast<RegisterAllocPass&>(graphColoringPass) : linearScanPass;
+        InterpreterPass interpreterPass(std::cin, std::cout);
 
         if(!arguments.parseOnly){
             parserPasses.emplace_back(irGeneratorPass);
-            irPasses.emplace_back(remapPass);
+            if(arguments.withDeadFunction){
+                irPasses.emplace_back(deadFunctionPass);
+            }
+            if(arguments.withInline){
+                irPasses.emplace_back(inlinePass);
+            }
+            if(arguments.withTailCall){
+                irPasses.emplace_back(tailCallPass);
+            }
+            if(arguments.withSpecialize){
+                irPasses.emplace_back(specializePass);
+            }
+            if(arguments.withUnroll){
+                irPasses.emplace_back(loopUnrollPass);
+            }
             if(arguments.withCSE){
                 irPasses.emplace_back(csePass);
             }
+            if(arguments.withLoadForward){
+                irPasses.emplace_back(loadForwardPass);
+            }
+            if(arguments.withDSE){
+                irPasses.emplace_back(dsePass);
+            }
+            if(arguments.withLICM){
+                irPasses.emplace_back(licmPass);
+            }
+            if(arguments.withSR){
+                irPasses.emplace_back(strengthReductionPass);
+            }
+            if(arguments.withRotation){
+                irPasses.emplace_back(loopRotationPass);
+            }
+            if(arguments.withSimplifyCFG){
+                irPasses.emplace_back(simplifyCFGPass);
+            }
+            if(arguments.withDCE){
+                irPasses.emplace_back(dcePass);
+            }
+            if(arguments.withOutOfSSA || arguments.registerCount || arguments.runVM){
+                irPasses.emplace_back(outOfSSAPass);
+            }
+            if(arguments.registerCount){
+                irPasses.emplace_back(registerAllocPass);
+            }
             if(!arguments.irVisualizeFile.empty()){
                 irPasses.emplace_back(irVisualizerPass.emplace(arguments.irVisualizeFile));
             }
+            if(arguments.runProgram){
+                irPasses.emplace_back(interpreterPass);
+            }
         }
 
         // Parse
@@ -89,6 +167,29 @@ int main(int argc, char const *argv[]){
                 return -2;
             }
         }
+        for(std::pair<const std::string, size_t>& spillPair : registerAllocPass.spillCounts){
+            ColorPrint::info((spillPair.first + ": " + std::to_string(spillPair.second) + " values spilled, "
+                + std::to_string(registerAllocPass.moveCounts[spillPair.first]) + " moves").c_str());
+        }
+        if(arguments.runProgram){
+            size_t total = 0;
+            for(std::pair<const IR::Operation, size_t>& countPair : interpreterPass.counts){
+                ColorPrint::info((InterpreterPass::operationName(countPair.first) + ": " + std::to_string(countPair.second)).c_str());
+                total += countPair.second;
+            }
+            ColorPrint::info((std::to_string(total) + " instructions executed").c_str());
+        }
+        if(arguments.runVM){
+            VM::Bytecode bytecode(funcMap);
+            VM::VirtualMachine virtualMachine(std::cin, std::cout);
+            virtualMachine.run(bytecode);
+            size_t total = 0;
+            for(std::pair<const VM::Opcode, size_t>& countPair : virtualMachine.counts){
+                ColorPrint::info((VM::opcodeName(countPair.first) + ": " + std::to_string(countPair.second)).c_str());
+                total += countPair.second;
+            }
+            ColorPrint::info((std::to_string(total) + " bytecode instructions executed").c_str());
+        }
         printLogs(arguments.inputFiles[0]);
     }catch(Exception& err){
         ColorPrint::fatal(err.what());
@@ -0,0 +1,36 @@
+#ifndef SMPLC_AliasAnalysis_DEF
+#define SMPLC_AliasAnalysis_DEF
+
+#include <IR.hpp>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+namespace IR{
+
+class AliasAnalysis{
+public:
+    struct Location{
+        enum class Kind{
+            Unknown, Frame, Array,
+        };
+        Kind kind;
+        // Frame: offset from fp if known; Array: offset of the array in frame
+        std::optional<int32_t> offset;
+        // Array: offset of the element in array if known
+        std::optional<int32_t> element;
+        bool operator==(const Location&) const = default;
+    };
+
+    AliasAnalysis(const std::shared_ptr<FuncEntry>& entry);
+    Location locate(index_t address) const;
+    bool mayAlias(index_t address1, index_t address2) const;
+    bool mayAlias(const Location& location1, const Location& location2) const;
+
+private:
+    std::unordered_map<index_t, Location> locations;
+};
+
+};
+
+#endif
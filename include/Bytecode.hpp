@@ -0,0 +1,139 @@
+#ifndef SMPLC_Bytecode_DEF
+#define SMPLC_Bytecode_DEF
+
+#include <IR.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <optional>
+
+namespace VM{
+
+// Instruction is the opcode followed by its operands in words. Operands are registers in the window
+// of running function unless noted, target is the position of instruction in code
+enum class Opcode{
+    Halt,
+    Imm,        // dest, constant
+    Mov,        // dest, src
+    Neg,        // dest, src
+    Add,        // dest, src1, src2
+    Sub,        // dest, src1, src2
+    Mul,        // dest, src1, src2
+    Div,        // dest, src1, src2
+    Cmp,        // dest, src1, src2
+    Load,       // dest, address
+    Store,      // src, address
+    Jmp,        // target
+    Bne,        // src, target
+    Beq,        // src, target
+    Ble,        // src, target
+    Blt,        // src, target
+    Bge,        // src, target
+    Bgt,        // src, target
+    Call,       // target, window size of callee
+    Ret,        // Return to the code address in pc
+    Leave,      // Return by the frame at fp, for function ending without return sequence
+    Read,       // dest
+    Write,      // src
+    WriteNL,
+    // Superinstructions fused from common sequences of IR, imm is a constant operand
+    AddI,       // dest, src, imm
+    SubI,       // dest, src, imm
+    MulI,       // dest, src, imm
+    CmpBne,     // src1, src2, target: Cmp followed by branch on its result
+    CmpBeq,     // src1, src2, target
+    CmpBle,     // src1, src2, target
+    CmpBlt,     // src1, src2, target
+    CmpBge,     // src1, src2, target
+    CmpBgt,     // src1, src2, target
+    CmpBneI,    // src, imm, target
+    CmpBeqI,    // src, imm, target
+    CmpBleI,    // src, imm, target
+    CmpBltI,    // src, imm, target
+    CmpBgeI,    // src, imm, target
+    CmpBgtI,    // src, imm, target
+    LoadOffset, // dest, base, imm: load at base + imm, frame slot if base is fp
+    StoreOffset, // src, base, imm
+    LoadIndexed, // dest, base, index, imm: load at base + index * imm, array element
+    StoreIndexed, // src, base, index, imm
+};
+const size_t opcodeCount = (size_t)Opcode::StoreIndexed + 1;
+
+// Window of each function starts with registers of IR, values follow
+enum Slot{
+    fp,
+    rval,
+    pc,
+    slotCount,
+};
+
+std::string opcodeName(Opcode opcode);
+// Words of instruction, including the opcode
+size_t instrSize(Opcode opcode);
+
+// Register-based bytecode lowered from IR without Phi. Values of each function get registers of its window,
+// the ones given by register allocation if any. Blocks are laid out in reverse post-order with branch targets
+// resolved, pc read by call sequence is the code address INT_SIZE before the instruction following the call.
+// Values defined only by Const are folded into instructions taking an immediate, and a value used once by the
+// instruction right after its definition is fused into it, for Cmp and branch, and address arithmetic and memory access
+class Bytecode{
+public:
+    Bytecode(const std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+    std::vector<int32_t> code;
+    // Position of _main
+    size_t entry;
+    // Registers in window of each function
+    std::unordered_map<std::string, size_t> windowSizes;
+
+private:
+    struct Function{
+        std::unordered_map<IR::index_t, int32_t> registers;
+        size_t windowSize = Slot::slotCount;
+        // Registers given by register allocation are below
+        size_t allocatedSize = Slot::slotCount;
+        // Uses of each value in IR, and the ones reading it from register in bytecode
+        std::unordered_map<IR::index_t, size_t> uses;
+        std::unordered_map<IR::index_t, size_t> reads;
+        // Values defined only by Const
+        std::unordered_map<IR::index_t, int32_t> constants;
+    };
+
+    // Address computed by the instructions before a memory access
+    struct Address{
+        // Positions of instructions fused, empty if not fused
+        std::vector<size_t> fused;
+        IR::index_t base;
+        IR::index_t index;
+        // Offset, or scale of index if isIndexed
+        int32_t immediate;
+        bool isIndexed;
+    };
+
+    std::unordered_map<std::string, size_t> funcStarts;
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, size_t> blockStarts;
+    // Operands of branch targets and calls to resolve
+    std::vector<std::pair<size_t, std::shared_ptr<IR::BasicBlock>>> blockPatches;
+    std::vector<std::pair<size_t, std::string>> callPatches;
+    // Imm of pc waiting for the call following it in block
+    std::vector<size_t> pcPatches;
+
+    void lower(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry);
+    int32_t registerOf(Function& func, IR::index_t value);
+    // Register holding operand, pc is set before the instruction using it
+    int32_t use(Function& func, IR::index_t value);
+    std::optional<int32_t> constantOf(const Function& func, IR::index_t value);
+    // Position of the instruction defining value used only once before pos in instrs, with only Const between
+    // them that can't overwrite the operands
+    std::optional<size_t> fusible(const Function& func, const std::vector<IR::Instrction>& instrs, size_t pos, IR::index_t value);
+    Address matchAddress(const Function& func, const std::vector<IR::Instrction>& instrs, size_t pos, IR::index_t address);
+    // Instructions before pos fused into the one at pos
+    std::vector<size_t> fusedPositions(const Function& func, const std::vector<IR::Instrction>& instrs, size_t pos);
+    void emit(Opcode opcode, std::initializer_list<int32_t> operands);
+    void emitBranch(Opcode opcode, std::initializer_list<int32_t> operands, const std::shared_ptr<IR::BasicBlock>& target);
+};
+
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SMPLC_CFG_DEF
+#define SMPLC_CFG_DEF
+
+#include <IR.hpp>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <string>
+#include <set>
+#include <optional>
+
+namespace IR{
+
+class CFG{
+public:
+    CFG(const std::shared_ptr<FuncEntry>& entry);
+
+    // Reachable blocks in reverse post-order, root is always 0
+    std::vector<std::shared_ptr<BasicBlock>> blocks;
+    std::unordered_map<std::shared_ptr<BasicBlock>, size_t> blockId;
+    // Predecessors are sorted in Phi operand order: forward edges before back edges,
+    // fall-through edges before branch edges
+    std::vector<std::vector<size_t>> preds, succs;
+    std::vector<size_t> idom;
+    std::vector<std::vector<size_t>> domChildren;
+
+    bool dominates(size_t dom, size_t block) const;
+
+private:
+    std::vector<size_t> domEnter, domLeave;
+};
+
+// Call emitted by IRGeneratorPass, with the setup of callee frame before the Bra
+struct CallSite{
+    std::shared_ptr<BasicBlock> block;
+    // Position of Bra in block
+    size_t position;
+    // Frame of callee starts at fp + frameOffset
+    int32_t frameOffset;
+    // Instructions only used for setting up the frame, including the Bra
+    std::set<index_t> setup;
+};
+
+std::optional<CallSite> findCallSite(const CFG& cfg, const FuncCallLink& link);
+// Position of the first instruction of the return sequence ending with Bra pc at braPos
+std::optional<size_t> returnStart(const std::vector<Instrction>& instrs, size_t braPos);
+
+// Copy of function with new instruction indices, call links follow the copied calls
+std::shared_ptr<FuncEntry> cloneFunc(const std::shared_ptr<FuncEntry>& entry);
+
+// Arithmetic on constants becomes a constant with the same index, so that uses need no change
+void foldConstants(const std::shared_ptr<FuncEntry>& entry);
+
+// Point the branch instruction at the end of block to the first instruction of its branch target
+void relinkBranch(const std::shared_ptr<BasicBlock>& block);
+// Point the branch instruction of every call to the first instruction of the callee
+void relinkCalls(std::unordered_map<std::string, std::shared_ptr<FuncEntry>>& funcMap);
+
+};
+
+#endif
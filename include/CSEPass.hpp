@@ -2,32 +2,72 @@
 #define SMPLC_CSEPass_DEF
 
 #include <IR.hpp>
+#include <CFG.hpp>
+#include <ExprTable.hpp>
+#include <AliasAnalysis.hpp>
+#include <SideEffects.hpp>
 #include <string>
-#include <stack>
+#include <vector>
 #include <memory>
 #include <unordered_map>
-#include <map>
 #include <utility>
 #include <variant>
 #include <set>
+#include <optional>
 
 class CSEPass: public IR::Pass{
+public:
+    CSEPass();
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
 private:
-    struct Context{
-        std::unordered_map<IR::index_t, IR::index_t> forward;
-        std::unordered_map<int32_t, IR::index_t> constMap;
-        std::unordered_map<IR::index_t, IR::index_t> negMap, loadMap;
-        std::map<std::pair<IR::index_t, IR::index_t>, IR::index_t> addMap, subMap, mulMap, divMap, cmpMap, addaMap;
-        std::unordered_map<IR::index_t, IR::index_t> addressMap; // Map adda index to address add instruction
+    // Each array is a memory class on its own, numbered from arrayMemory by its offset in frame
+    enum MemoryClass: IR::index_t{
+        unknownMemory = 0,
+        frameMemory = 1,
+        allMemory = 2,
+        arrayMemory = 3,
+    };
+
+    // Call to pure function, later calls with the same arguments reuse its result
+    struct PureCall{
+        const IR::FuncCallLink* link;
+        std::vector<IR::index_t> arguments;
+    };
+    struct ScopeMark{
+        size_t versionLog;
+        size_t exprTable;
+        size_t pureCalls;
     };
 
-    std::stack<Context> contextStack;
+    ExprTable exprTable;
+    std::optional<IR::AliasAnalysis> aliasAnalysis;
+    std::optional<IR::SideEffects> sideEffects;
+    // Call links and sites of current function by index of Bra
+    std::unordered_map<IR::index_t, std::pair<const IR::FuncCallLink*, std::optional<IR::CallSite>>> callMap;
+    std::vector<PureCall> pureCalls;
+    // Frame destinations of removed calls, removed as well if nothing else uses them
+    std::set<IR::index_t> removedDests;
+    // Loads are keyed with the memory version of their base, so a store only renews the versions it may alias
+    std::unordered_map<IR::index_t, IR::index_t> memoryVersion;
+    IR::index_t versionCounter;
+    std::unordered_map<IR::index_t, IR::index_t> forward;
     std::set<IR::index_t> removedSet;
-    
-    void beforeVisit(std::shared_ptr<IR::BasicBlock>&);
-    void afterVisit(std::shared_ptr<IR::BasicBlock>&);
-    void afterVisit(const std::string&, std::shared_ptr<IR::FuncEntry>&);
-    
+    // Scope exit restores the tables by rolling back to the marks of the scope
+    std::vector<std::pair<IR::index_t, IR::index_t>> versionLog;
+    std::vector<ScopeMark> scopeMarks;
+
+    void enterScope();
+    void leaveScope();
+    void visitBlock(const IR::CFG& cfg, size_t blockId);
+    IR::index_t classOf(IR::index_t address);
+    IR::index_t versionOf(IR::index_t memoryClass);
+    void renewVersion(IR::index_t memoryClass);
+    void replace(IR::index_t& operand);
+    bool number(IR::InstrBase& instr, const ExprTable::Key& key);
+
+    using IR::Pass::visit;
+
     void visit(IR::Const&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Neg&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Add&, std::shared_ptr<IR::BasicBlock>&);
@@ -42,6 +82,7 @@ private:
     void visit(IR::Phi&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Write&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::StoreReg&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Bra&, std::shared_ptr<IR::BasicBlock>&);
 
     void visit(IR::Bne&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Beq&, std::shared_ptr<IR::BasicBlock>&);
@@ -51,4 +92,4 @@ private:
     void visit(IR::Bgt&, std::shared_ptr<IR::BasicBlock>&);
 };
 
-#endif
\ No newline at end of file
+#endif
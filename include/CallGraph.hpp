@@ -0,0 +1,35 @@
+#ifndef SMPLC_CallGraph_DEF
+#define SMPLC_CallGraph_DEF
+
+#include <IR.hpp>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <string>
+#include <set>
+
+namespace IR{
+
+// Calls between functions, from call links of each function
+class CallGraph{
+public:
+    CallGraph(const std::unordered_map<std::string, std::shared_ptr<FuncEntry>>& funcMap);
+
+    // Without duplicates, sorted by name
+    std::unordered_map<std::string, std::vector<std::string>> callees;
+    std::unordered_map<std::string, std::vector<std::string>> callers;
+    // Strongly connected components, callees come before callers
+    std::vector<std::vector<std::string>> sccs;
+    std::unordered_map<std::string, size_t> sccOf;
+
+    // Functions with callees before callers, functions in the same component are together
+    std::vector<std::string> bottomUp() const;
+    // Function is in a cycle of calls, including calling itself
+    bool isRecursive(const std::string& funcName) const;
+    // Functions reachable from funcName through calls, including itself
+    std::set<std::string> reachableFrom(const std::string& funcName) const;
+};
+
+};
+
+#endif
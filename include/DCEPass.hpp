@@ -0,0 +1,17 @@
+#ifndef SMPLC_DCEPass_DEF
+#define SMPLC_DCEPass_DEF
+
+#include <IR.hpp>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+// Dead code elimination, instructions without side effect are removed unless their values are used
+class DCEPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+    // Remove dead code in one function, call branches to it should be relinked if its first instruction is removed
+    void eliminate(const std::shared_ptr<IR::FuncEntry>& entry);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SMPLC_DSEPass_DEF
+#define SMPLC_DSEPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <AliasAnalysis.hpp>
+#include <SideEffects.hpp>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <set>
+#include <utility>
+
+// Dead store elimination, removes stores to arrays that are overwritten or
+// the function returns before the stored value can be read
+class DSEPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+private:
+    // Array memory known to be dead, going backward from a program point
+    struct DeadState{
+        // Every array except liveArrays is dead
+        bool allArrays;
+        std::set<int32_t> liveArrays;
+        // Elements of arrays, as offset of array and offset of element
+        std::set<std::pair<int32_t, int32_t>> elements;
+        bool operator==(const DeadState&) const = default;
+    };
+
+    // Calls to functions that may read memory of caller
+    std::set<IR::index_t> readingCalls;
+
+    static DeadState exitState();
+    static bool isDead(const DeadState& state, const IR::AliasAnalysis::Location& location);
+    DeadState meet(const IR::CFG& cfg, size_t blockId, const std::vector<DeadState>& entryStates);
+    void transfer(DeadState& state, IR::Instrction& instr, const IR::AliasAnalysis& aliasAnalysis, std::set<IR::index_t>* removedSet);
+};
+
+#endif
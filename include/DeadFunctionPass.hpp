@@ -0,0 +1,15 @@
+#ifndef SMPLC_DeadFunctionPass_DEF
+#define SMPLC_DeadFunctionPass_DEF
+
+#include <IR.hpp>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+// Remove functions never called from main, directly or through other functions
+class DeadFunctionPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+};
+
+#endif
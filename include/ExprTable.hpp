@@ -0,0 +1,43 @@
+#ifndef SMPLC_ExprTable_DEF
+#define SMPLC_ExprTable_DEF
+
+#include <IR.hpp>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// Open addressing hash table from (operation, operand1, operand2) to the index of the leading instruction,
+// every change is logged so that a scope can be rolled back
+class ExprTable{
+public:
+    struct Key{
+        IR::Operation operation;
+        IR::index_t operand1, operand2;
+        bool operator==(const Key&) const = default;
+    };
+    static const IR::index_t none = 0;
+
+    ExprTable();
+    static Key makeKey(IR::Operation operation, IR::index_t operand1, IR::index_t operand2 = 0);
+    IR::index_t find(const Key& key) const;
+    void insert(const Key& key, IR::index_t value);
+    void erase(const Key& key);
+    size_t mark() const;
+    void rollback(size_t mark);
+    void clear();
+
+private:
+    struct Slot{
+        Key key;
+        IR::index_t value;
+    };
+    std::vector<Slot> slots;
+    size_t count;
+    std::vector<std::pair<Key, IR::index_t>> undoLog;
+
+    size_t locate(const Key& key) const;
+    void set(const Key& key, IR::index_t value);
+    void remove(size_t pos);
+};
+
+#endif
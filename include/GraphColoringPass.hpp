@@ -0,0 +1,58 @@
+#ifndef SMPLC_GraphColoringPass_DEF
+#define SMPLC_GraphColoringPass_DEF
+
+#include <IR.hpp>
+#include <RegisterAllocPass.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <Liveness.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// Chaitin-Briggs register allocation. The interference graph is built from liveness, values of
+// each Move that don't interfere are coalesced aggressively, deeper loops first, then the graph is
+// simplified and colored optimistically. Values left uncolored are spilled everywhere, chosen by
+// uses weighted by loop depth over degree; Const is recomputed before each use instead of spilled.
+// The graph is built again with spill code until all is colored
+class GraphColoringPass: public RegisterAllocPass{
+public:
+    GraphColoringPass(size_t registerCount = defaultRegisters);
+
+private:
+    struct Node{
+        // Values coalesced into this node
+        std::vector<IR::index_t> values;
+        std::unordered_set<size_t> adjacent;
+        // Nodes of values copied from or to, before coalescing
+        std::vector<size_t> moves;
+        double cost;
+        size_t alias;
+        size_t color;
+        bool spillable;
+    };
+
+    // Move from src to dest, in loop of depth
+    struct Copy{
+        size_t depth;
+        size_t dest;
+        size_t src;
+    };
+
+    std::vector<Node> nodes;
+    std::unordered_map<IR::index_t, size_t> nodeOf;
+    std::vector<Copy> copies;
+    // Values defined only by Const, with the constant
+    std::unordered_map<IR::index_t, int32_t> constants;
+
+    void allocate(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry);
+    void build(const IR::CFG& cfg, const IR::Liveness& liveness);
+    size_t find(size_t node);
+    void coalesce();
+    std::vector<size_t> color();
+    void rewrite(const std::shared_ptr<IR::FuncEntry>& entry, const std::vector<size_t>& spilled);
+};
+
+#endif
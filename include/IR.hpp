@@ -8,6 +8,8 @@
 #include <unordered_map>
 #include <string>
 #include <optional>
+#include <functional>
+#include <Symbol.hpp>
 
 namespace IR{
 
@@ -36,6 +38,7 @@ enum class Operation{
     Load,
     Store,
     Phi,
+    Move,
     End,
     Bra,
     Bne,
@@ -102,6 +105,8 @@ using Cmp = Instr<Operation::Cmp, index_t, index_t>;
 using Adda = Instr<Operation::Adda, index_t, index_t>;
 using Store = Instr<Operation::Store, index_t, index_t>;
 using Phi = Instr<Operation::Phi, index_t, index_t>;
+// Copy operand2 to the value operand1, left by translation out of SSA form
+using Move = Instr<Operation::Move, index_t, index_t>;
 using Bne = Instr<Operation::Bne, index_t, index_t>;
 using Beq = Instr<Operation::Beq, index_t, index_t>;
 using Ble = Instr<Operation::Ble, index_t, index_t>;
@@ -123,6 +128,7 @@ using Instrction = std::variant<
     Load,
     Store,
     Phi,
+    Move,
     End,
     Bra,
     Bne,
@@ -137,13 +143,14 @@ using Instrction = std::variant<
 >;
 
 const index_t getInstrIndex(const Instrction&);
+// Apply on every value operand, branch targets and the value written by StoreReg or Move are excluded
+void forEachOperand(Instrction&, const std::function<void(index_t&)>&);
+// Copy of the instruction with a new index
+Instrction cloneInstr(const Instrction&);
 
 struct BasicBlock{
     std::vector<Instrction> instructions;
     std::shared_ptr<BasicBlock> branch, fallThrough, dominator;
-    std::unordered_map<std::string, index_t> variableVal;
-    std::unordered_map<index_t, index_t> arrayVal;
-    std::unordered_map<index_t, index_t> relocateMap;
 };
 
 struct TypeData{
@@ -158,15 +165,21 @@ struct FuncCallLink{
     std::string funcName;
     index_t callIndex;
     std::shared_ptr<BasicBlock> block;
-    std::vector<std::pair<std::string, index_t>> params;
+    std::vector<std::pair<SymbolId, index_t>> params;
+    // Copy of the return value, none for void functions
+    std::optional<index_t> resultIndex;
 };
 struct FuncEntry{
     std::shared_ptr<BasicBlock> root;
-    std::unordered_map<std::string, TypeData> variables;
-    std::unordered_map<std::string, address_t> paramAddrMap;
-    std::vector<std::string> paramNames;
+    std::unordered_map<SymbolId, TypeData> variables;
+    std::unordered_map<SymbolId, address_t> paramAddrMap;
+    std::vector<SymbolId> paramNames;
     std::vector<FuncCallLink> callLinks;
     bool isVoid;
+    // Size of frame in bytes, frames of callees start after it
+    address_t frameSize;
+    // Register of each value, filled by register allocation
+    std::unordered_map<index_t, size_t> registers;
 };
 
 class Pass{
@@ -193,6 +206,7 @@ protected:
     virtual void visit(Load&, std::shared_ptr<BasicBlock>&);
     virtual void visit(Store&, std::shared_ptr<BasicBlock>&);
     virtual void visit(Phi&, std::shared_ptr<BasicBlock>&);
+    virtual void visit(Move&, std::shared_ptr<BasicBlock>&);
     virtual void visit(End&, std::shared_ptr<BasicBlock>&);
     virtual void visit(Bra&, std::shared_ptr<BasicBlock>&);
     virtual void visit(Bne&, std::shared_ptr<BasicBlock>&);
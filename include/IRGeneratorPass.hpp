@@ -9,6 +9,7 @@
 #include <memory>
 #include <functional>
 #include <set>
+#include <unordered_set>
 
 #include <IR.hpp>
 #include <Parser.hpp>
@@ -20,6 +21,7 @@ public:
     /* Before */
     void beforeParse(Parser::StatSequence&);
     void beforeParse(Parser::Computation&);
+    void beforeParse(Parser::IfStatement&);
     void beforeParse(Parser::WhileStatement&);
     void beforeParse(Parser::FuncDecl&);
     void beforeParse(Parser::FuncBody&);
@@ -46,14 +48,47 @@ private:
     std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap;
     std::shared_ptr<IR::FuncEntry> curEntry;
     Parser::FuncDecl* curDecl;
-    std::stack<std::unordered_map<std::string, IR::index_t>> varStack;
     std::stack<std::shared_ptr<IR::BasicBlock>> bbStack;
+    std::stack<std::shared_ptr<IR::BasicBlock>> entryStack;
     std::stack<std::shared_ptr<IR::BasicBlock>> whileStack;
+    // Block with the relation of each if and while statement, which enters its bodies
+    std::stack<std::shared_ptr<IR::BasicBlock>> condStack;
+    // Blocks of current function in order of creation
+    std::vector<std::shared_ptr<IR::BasicBlock>> funcBlocks;
+    // Values of variables at the end of each block, or at the point generated so far. Only kept
+    // while the function is generated, and only for variables assigned in the block or read through it
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::unordered_map<SymbolId, IR::index_t>> blockVals;
+    // Predecessors in order of Phi operands
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::vector<std::shared_ptr<IR::BasicBlock>>> preds;
+    // Phi of loop headers created before the back edge is known, by variable
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::unordered_map<SymbolId, IR::index_t>> incompletePhis;
+    std::unordered_map<IR::index_t, std::shared_ptr<IR::BasicBlock>> phiBlocks;
+    // Phi using each Phi as operand
+    std::unordered_map<IR::index_t, std::vector<IR::index_t>> phiUsers;
+    // Trivial Phi removed, and the value it is replaced with
+    std::unordered_map<IR::index_t, IR::index_t> replacedPhis;
+    // Constants read from uninitialized variables
+    std::set<IR::index_t> undefinedValues;
     std::stack<IR::index_t> exprStack;
-    std::set<std::string> usedVar;
+    std::unordered_set<SymbolId> usedVar;
     IR::address_t stackTop;
+    // Frame size of main, restored after each function
+    IR::address_t mainStackTop;
     template<typename T, typename... O> T& emitInstr(O...);
     std::string getFuncMsg();
+    std::shared_ptr<IR::BasicBlock> createBlock(const std::shared_ptr<IR::BasicBlock>& dominator);
+
+    /* SSA construction */
+    IR::index_t readVariable(SymbolId name, const std::shared_ptr<IR::BasicBlock>& block);
+    IR::index_t addPhi(const std::shared_ptr<IR::BasicBlock>& block);
+    IR::index_t addPhiOperands(SymbolId name, IR::index_t phi);
+    IR::index_t tryRemoveTrivialPhi(IR::index_t phi);
+    IR::Phi& getPhi(IR::index_t phi);
+    bool isIncomplete(IR::index_t phi);
+    IR::index_t resolve(IR::index_t value);
+    void sealBlock(const std::shared_ptr<IR::BasicBlock>& block);
+    IR::index_t undefinedValue();
+    std::optional<IR::index_t> findValue(SymbolId name);
 };
 
 #endif
\ No newline at end of file
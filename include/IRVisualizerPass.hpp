@@ -43,6 +43,7 @@ private:
     void visit(IR::Load&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Store&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Phi&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Move&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::End&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Bra&, std::shared_ptr<IR::BasicBlock>&);
     void visit(IR::Bne&, std::shared_ptr<IR::BasicBlock>&);
@@ -0,0 +1,32 @@
+#ifndef SMPLC_InlinePass_DEF
+#define SMPLC_InlinePass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <optional>
+
+// Inline calls to small functions, blocks of callee are cloned into the caller with
+// parameters replaced by arguments, and frame of callee placed where the call would put it
+class InlinePass: public IR::Pass{
+public:
+    InlinePass(size_t sizeLimit = defaultSizeLimit);
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+    // Maximum number of instructions in callee
+    static const size_t defaultSizeLimit;
+
+private:
+    size_t sizeLimit;
+    std::unordered_map<IR::index_t, IR::index_t> forward;
+
+    static size_t sizeOf(const std::shared_ptr<IR::FuncEntry>& entry);
+    static bool canInline(const std::shared_ptr<IR::FuncEntry>& entry);
+    bool inlineCall(const std::shared_ptr<IR::FuncEntry>& caller, const IR::FuncCallLink& link, const std::shared_ptr<IR::FuncEntry>& callee);
+    void replace(IR::index_t& operand);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SMPLC_InterpreterPass_DEF
+#define SMPLC_InterpreterPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+
+// Reference interpreter of the IR, running _main with the frame protocol of IRGeneratorPass over a flat
+// memory of int32, counting instructions executed. Each instruction is placed at a code address, reading
+// pc gives the address of the Bra it is followed by in its block, so that pc + INT_SIZE returns after the call.
+// Values belong to the activation of the function defining them, a call moving fp pushes a new activation
+// and a tail call reusing the frame replaces it. Function ending without return sequence returns by its frame.
+// Arithmetic wraps around in 32 bits as in constant folding, INT_MIN / -1 gives INT_MIN
+class InterpreterPass: public IR::Pass{
+public:
+    InterpreterPass(std::istream& input, std::ostream& output, size_t memorySize = defaultMemorySize);
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+    // In words of INT_SIZE
+    static const size_t defaultMemorySize;
+    static std::string operationName(IR::Operation operation);
+    // Instructions executed of each operation, Phi counted on each entry of its block
+    std::map<IR::Operation, size_t> counts;
+
+protected:
+    void visit(IR::Nop&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Const&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Neg&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Add&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Sub&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::StoreReg&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Mul&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Div&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Cmp&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Adda&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Load&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Store&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Phi&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Move&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::End&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Bra&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Bne&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Beq&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Ble&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Blt&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Bge&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Bgt&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Read&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::Write&, std::shared_ptr<IR::BasicBlock>&);
+    void visit(IR::WriteNL&, std::shared_ptr<IR::BasicBlock>&);
+
+private:
+    struct Activation{
+        std::unordered_map<IR::index_t, int32_t> values;
+        // Frame the function is called with
+        int32_t fp;
+    };
+
+    std::istream& input;
+    std::ostream& output;
+    std::vector<int32_t> memory;
+    std::unordered_map<std::string, std::shared_ptr<IR::CFG>> cfgs;
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::string> funcOf;
+    // Block and position at each code address over INT_SIZE, the end of each block has an address as well
+    std::vector<std::pair<std::shared_ptr<IR::BasicBlock>, size_t>> code;
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, size_t> codeStart;
+    // Function called by each call branch
+    std::unordered_map<IR::index_t, std::string> callees;
+    std::vector<Activation> activations;
+    int32_t pc, fp, rval;
+    std::shared_ptr<IR::BasicBlock> block;
+    // Position of the next instruction in block
+    size_t position;
+    bool halted;
+    bool lineStart;
+
+    int32_t valueOf(IR::index_t value);
+    void define(IR::index_t value, int32_t result);
+    int32_t& memoryAt(int32_t address);
+    // Evaluate Phi of target with operands of the edge taken from block, call enters without edge
+    void enter(std::shared_ptr<IR::BasicBlock> target, std::shared_ptr<IR::BasicBlock> from, bool isBranch);
+    void jump(int32_t address);
+    void branchIf(bool taken);
+};
+
+#endif
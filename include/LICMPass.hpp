@@ -0,0 +1,27 @@
+#ifndef SMPLC_LICMPass_DEF
+#define SMPLC_LICMPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <AliasAnalysis.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <set>
+
+// Loop invariant code motion, invariant instructions are moved to the preheader of loop
+class LICMPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+private:
+    std::unordered_map<IR::index_t, int32_t> constants;
+    std::set<IR::index_t> callSet;
+
+    bool insertPreheaders(const IR::CFG& cfg, const IR::LoopInfo& loopInfo);
+    void hoist(const IR::CFG& cfg, const IR::Loop& loop, const IR::AliasAnalysis& aliasAnalysis);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SMPLC_LinearScanPass_DEF
+#define SMPLC_LinearScanPass_DEF
+
+#include <IR.hpp>
+#include <RegisterAllocPass.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <Liveness.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// Linear scan register allocation. Live intervals are built from liveness over blocks in
+// reverse post-order; when no register is free, the interval with the farthest next use is split:
+// it keeps its register before the split, and is reloaded from a spill slot after it.
+// Spill code is inserted and allocation is run again until all fits
+class LinearScanPass: public RegisterAllocPass{
+public:
+    LinearScanPass(size_t registerCount = defaultRegisters);
+
+private:
+    // Half-open range of positions, instruction reads operands at even position and writes at the next one
+    struct Range{
+        int from;
+        int to;
+    };
+    struct Interval{
+        IR::index_t value;
+        std::vector<Range> ranges;
+        std::vector<int> uses;
+        // Uses by stores to spill slot, which are never reloaded
+        std::vector<int> storeUses;
+        std::vector<int> defs;
+        size_t reg;
+        bool spillable;
+
+        int start() const;
+        int end() const;
+        bool covers(int pos) const;
+        // First position covered by both, or never
+        int intersection(const Interval& other) const;
+        // First use at or after pos, or never
+        int nextUse(int pos) const;
+        // Splitting at pos frees the register, which is not the case between a definition and its store to slot
+        bool splittable(int pos) const;
+    };
+    // Uses of value at or after position are reloaded from its slot
+    struct Spill{
+        IR::index_t value;
+        int from;
+    };
+
+    // Stores to slots, whose operands are never reloaded
+    std::unordered_set<IR::index_t> spillStores;
+
+    void allocate(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry);
+    std::vector<Interval> buildIntervals(const IR::CFG& cfg, const IR::Liveness& liveness, std::vector<int>& blockFrom);
+    std::vector<Spill> scan(std::vector<Interval>& intervals);
+    bool rewrite(const IR::CFG& cfg, const IR::Liveness& liveness,
+        const std::vector<int>& blockFrom, std::vector<Spill>& spills);
+};
+
+#endif
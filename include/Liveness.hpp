@@ -0,0 +1,50 @@
+#ifndef SMPLC_Liveness_DEF
+#define SMPLC_Liveness_DEF
+
+#include <CFG.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+
+namespace IR{
+
+// Dense set of value numbers, unions and differences run over whole words
+class ValueSet{
+public:
+    ValueSet(size_t size = 0);
+
+    bool contains(size_t id) const;
+    void insert(size_t id);
+    void erase(size_t id);
+    // Add the values of other, returns whether anything was added
+    bool unite(const ValueSet& other);
+    // Set to gen and the values of other not in kill, returns whether anything changed
+    bool assign(const ValueSet& gen, const ValueSet& other, const ValueSet& kill);
+    std::vector<size_t> elements() const;
+
+private:
+    std::vector<uint64_t> words;
+};
+
+// Values live on entry and exit of blocks, solved backward with a worklist.
+// Operands of Phi are live out of the predecessor on the matching edge instead of live in its block,
+// and Phi is defined on entry. Move defines its destination, so that it also works out of SSA form
+class Liveness{
+public:
+    Liveness(const CFG& cfg);
+
+    // Values used in function, numbered densely in order of first appearance
+    std::vector<index_t> values;
+    std::unordered_map<index_t, size_t> valueId;
+    std::vector<ValueSet> liveIn, liveOut;
+
+    std::optional<size_t> idOf(index_t value) const;
+    bool isLiveIn(size_t blockId, index_t value) const;
+    bool isLiveOut(size_t blockId, index_t value) const;
+};
+
+};
+
+#endif
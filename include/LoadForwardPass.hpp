@@ -0,0 +1,43 @@
+#ifndef SMPLC_LoadForwardPass_DEF
+#define SMPLC_LoadForwardPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <AliasAnalysis.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <optional>
+#include <tuple>
+
+// Replace loads with the value last stored to or loaded from the same address,
+// values from different paths are merged with Phi at the join block
+class LoadForwardPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+private:
+    // Known value of memory at a join, turned into Phi only if a load uses it
+    struct MemoryPhi{
+        std::shared_ptr<IR::BasicBlock> block;
+        IR::index_t operand1, operand2;
+        std::optional<IR::Phi> phi;
+    };
+    // Map address to its value, values from pendingPhis start at pendingBase
+    using MemoryState = std::map<IR::index_t, IR::index_t>;
+    static const IR::index_t pendingBase;
+
+    std::vector<MemoryPhi> pendingPhis;
+    std::unordered_map<IR::index_t, IR::index_t> forward;
+    // Addresses at the same known location share the first address seen
+    std::map<std::tuple<IR::AliasAnalysis::Location::Kind, int32_t, int32_t>, IR::index_t> locationMap;
+
+    IR::index_t addressOf(const IR::AliasAnalysis& aliasAnalysis, IR::index_t address);
+    MemoryState joinStates(const std::shared_ptr<IR::BasicBlock>& block, const std::vector<MemoryState*>& states);
+    IR::index_t resolve(IR::index_t value);
+    void replace(IR::index_t& operand);
+};
+
+#endif
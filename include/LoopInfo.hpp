@@ -0,0 +1,36 @@
+#ifndef SMPLC_LoopInfo_DEF
+#define SMPLC_LoopInfo_DEF
+
+#include <CFG.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace IR{
+
+struct Loop{
+    size_t header;
+    std::vector<size_t> latches;
+    std::vector<size_t> blocks; // In reverse post-order, header first
+    std::vector<bool> contains;
+    size_t parent;
+    size_t depth;
+};
+
+// Natural loops of back edges, a back edge goes to a block dominating its source
+class LoopInfo{
+public:
+    static const size_t noLoop;
+
+    LoopInfo(const CFG& cfg);
+
+    // Inner loops come before outer loops
+    std::vector<Loop> loops;
+    // Innermost loop of each block
+    std::vector<size_t> loopOf;
+
+    size_t depthOf(size_t blockId) const;
+};
+
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SMPLC_LoopRotationPass_DEF
+#define SMPLC_LoopRotationPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <set>
+
+// Rotate loops into guarded do-while form: the exit test is copied before the loop as a guard
+// and to the end of latch as a conditional branch back to header, so that each iteration runs
+// a single branch instead of a test in header and a jump back to it
+class LoopRotationPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+private:
+    // Headers of loops already visited
+    std::set<std::shared_ptr<IR::BasicBlock>> visited;
+
+    static bool canRotate(const IR::CFG& cfg, const IR::Loop& loop);
+    static void rotate(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop);
+};
+
+#endif
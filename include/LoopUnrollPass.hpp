@@ -0,0 +1,69 @@
+#ifndef SMPLC_LoopUnrollPass_DEF
+#define SMPLC_LoopUnrollPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <set>
+#include <optional>
+
+// Unroll innermost loops counted by an induction variable. Loops with a small constant trip count
+// are replaced by copies of their body, other loops run several copies of the body for each test
+// of the exit condition, and the iterations left over are finished by the original loop. A bound not
+// constant is guarded, the original loop runs all iterations if the bound moved back would wrap around
+class LoopUnrollPass: public IR::Pass{
+public:
+    LoopUnrollPass(size_t factor = defaultFactor);
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+    // Copies of body in each iteration of partially unrolled loop
+    static const size_t defaultFactor;
+    // Maximum trip count of fully unrolled loop
+    static const size_t maxFullTrips;
+    // Maximum number of instructions of the unrolled copies
+    static const size_t sizeLimit;
+
+private:
+    // Exit test of header: Cmp(phi, bound) or Cmp(bound, phi), phi = Phi(init, phi + step)
+    struct Counter{
+        IR::index_t phi;
+        IR::index_t init;
+        int32_t step;
+        IR::index_t cmp;
+        IR::index_t bound;
+        bool boundFirst;
+        IR::Operation exitOp;
+    };
+    // Copy of loop blocks for one iteration, the header without its Phi and exit test
+    struct Iteration{
+        std::shared_ptr<IR::BasicBlock> entry;
+        std::shared_ptr<IR::BasicBlock> latch;
+        bool latchFallsThrough;
+        std::unordered_map<IR::index_t, IR::index_t> valueMap;
+    };
+
+    size_t factor;
+    bool fullyUnrolled;
+    std::unordered_map<IR::index_t, int32_t> constants;
+    // Headers of loops created or already visited
+    std::set<std::shared_ptr<IR::BasicBlock>> visited;
+
+    bool unroll(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop);
+    std::optional<Counter> findCounter(const IR::CFG& cfg, const IR::Loop& loop);
+    std::optional<size_t> tripCount(const Counter& counter);
+    static bool exits(IR::Operation exitOp, int32_t cmpValue);
+    Iteration cloneIteration(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop,
+        const std::unordered_map<IR::index_t, IR::index_t>& phiValues);
+    static std::unordered_map<IR::index_t, IR::index_t> nextPhiValues(const IR::CFG& cfg, const IR::Loop& loop,
+        const Iteration& iteration, const std::unordered_map<IR::index_t, IR::index_t>& phiValues);
+    void unrollFully(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop,
+        std::shared_ptr<IR::BasicBlock>& preheader, size_t trips);
+    void unrollPartially(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop,
+        std::shared_ptr<IR::BasicBlock>& preheader, const Counter& counter);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SMPLC_OutOfSSAPass_DEF
+#define SMPLC_OutOfSSAPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <Liveness.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// Translate out of SSA form: Phi is replaced by copies (Move) at the end of its predecessors.
+// Critical edges are split for the copies, values of a Phi and its operands are coalesced
+// into one variable when they don't interfere, and the copies left on each edge are
+// sequentialized as a parallel copy (Boissinot et al.)
+class OutOfSSAPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+    void translate(const std::shared_ptr<IR::FuncEntry>& entry);
+
+private:
+    // Copies of one edge, destination to source
+    using ParallelCopy = std::vector<std::pair<IR::index_t, IR::index_t>>;
+
+    // Block and position of definitions, -1 for Phi, with the last uses in blocks
+    struct Interference{
+        Interference(const IR::CFG& cfg);
+        IR::Liveness liveness;
+        std::unordered_map<IR::index_t, size_t> defBlock;
+        std::unordered_map<IR::index_t, int> defPos;
+        // Position of the last use in block other than by Phi, whose operands are live out of predecessors
+        std::vector<std::unordered_map<IR::index_t, int>> lastUse;
+
+        bool liveAt(IR::index_t value, size_t blockId, int pos) const;
+        bool interfere(IR::index_t value1, IR::index_t value2) const;
+    };
+
+    // Union-find of coalesced values
+    std::unordered_map<IR::index_t, IR::index_t> parent;
+    std::unordered_map<IR::index_t, std::vector<IR::index_t>> members;
+    std::unordered_set<IR::index_t> phis;
+
+    IR::index_t find(IR::index_t value);
+    IR::index_t representative(IR::index_t value);
+    void coalesce(const IR::CFG& cfg, const Interference& interference);
+    bool tryMerge(IR::index_t value1, IR::index_t value2, const Interference& interference, const std::unordered_map<IR::index_t, size_t>& phiBlock);
+    static std::shared_ptr<IR::BasicBlock> splitEdge(const std::shared_ptr<IR::BasicBlock>& pred, const std::shared_ptr<IR::BasicBlock>& succ);
+    static std::vector<IR::Instrction> sequentialize(const ParallelCopy& copies);
+};
+
+#endif
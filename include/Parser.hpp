@@ -8,6 +8,7 @@
 #include <variant>
 #include <optional>
 #include <Source.hpp>
+#include <Symbol.hpp>
 
 namespace Parser{
 
@@ -54,7 +55,7 @@ class Ident: public Interface{
 public:
     Ident(Source& source, std::vector<std::reference_wrapper<Pass>>& passes);
     bool parse();
-    std::string value;
+    SymbolId symbol;
 };
 
 class Number: public Interface{
@@ -0,0 +1,53 @@
+#ifndef SMPLC_RegisterAllocPass_DEF
+#define SMPLC_RegisterAllocPass_DEF
+
+#include <IR.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// Base of register allocation on code translated out of SSA form, filling FuncEntry::registers.
+// Spill slots are placed after the frame, and after parameters of functions called in tail position
+// which reuse the frame; frames of other callees are moved above them
+class RegisterAllocPass: public IR::Pass{
+public:
+    RegisterAllocPass(size_t registerCount);
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+    static const size_t defaultRegisters;
+    // Values spilled to slots, and copies between different registers left in each function
+    std::map<std::string, size_t> spillCounts;
+    std::map<std::string, size_t> moveCounts;
+
+protected:
+    size_t registerCount;
+    // Slot of each spilled value, values may share one
+    std::unordered_map<IR::index_t, size_t> slots;
+    size_t slotCount;
+    // Values of spill code, which are never spilled again
+    std::unordered_set<IR::index_t> unspillable;
+
+    virtual void allocate(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry) = 0;
+    // Append the address of slot of value to instrs
+    IR::index_t slotAddress(std::vector<IR::Instrction>& instrs, IR::index_t value);
+    // Called after spill code is inserted, frames of callees are moved once there are slots
+    void moveCalleeFrames(const std::shared_ptr<IR::FuncEntry>& entry);
+    // Value written by instruction, Move writes its first operand
+    static IR::index_t defOf(const IR::Instrction& instr);
+
+private:
+    IR::address_t slotBase;
+    // Add computing the frame of callee of each call, with the offset of frame
+    std::vector<std::pair<IR::index_t, int32_t>> calleeFrames;
+    // Offsets of callee frames moved after spill slots, with the offsets before
+    std::unordered_map<IR::index_t, int32_t> frameConsts;
+
+    void prepare(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry,
+        std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+    void finish(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry);
+};
+
+#endif
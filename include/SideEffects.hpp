@@ -0,0 +1,34 @@
+#ifndef SMPLC_SideEffects_DEF
+#define SMPLC_SideEffects_DEF
+
+#include <IR.hpp>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+namespace IR{
+
+struct FuncSummary{
+    // Memory outside the frame of function and its callees, which may belong to caller
+    bool readsMemory;
+    bool writesMemory;
+    // Read, Write, WriteNL or End
+    bool performsIO;
+
+    // Result only depends on arguments, and nothing is changed for caller
+    bool isPure() const;
+};
+
+// Side effects of each function including those of its callees, functions calling each other share the same summary
+class SideEffects{
+public:
+    SideEffects(const std::unordered_map<std::string, std::shared_ptr<FuncEntry>>& funcMap);
+    const FuncSummary& of(const std::string& funcName) const;
+
+private:
+    std::unordered_map<std::string, FuncSummary> summaries;
+};
+
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SMPLC_SimplifyCFGPass_DEF
+#define SMPLC_SimplifyCFGPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <DCEPass.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+// Simplify control flow: branches with known conditions are folded, jumps through blocks
+// doing nothing but forwarding control are threaded, and straight-line chains of blocks are merged
+class SimplifyCFGPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+    void simplify(const std::shared_ptr<IR::FuncEntry>& entry);
+
+private:
+    // Predecessors of blocks with Phi, in operand order before a change, with blocks replaced by the change
+    using PhiPreds = std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::vector<std::shared_ptr<IR::BasicBlock>>>;
+
+    // Removing dead code first leaves more blocks empty
+    DCEPass dcePass;
+
+    static PhiPreds phiPreds(const IR::CFG& cfg);
+    static bool foldBranches(const IR::CFG& cfg);
+    static bool threadJump(const IR::CFG& cfg, PhiPreds& preds);
+    static bool mergeChain(const std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, PhiPreds& preds);
+    static void fixPhis(const std::shared_ptr<IR::FuncEntry>& entry, const PhiPreds& preds);
+    static void replacePred(PhiPreds& preds, const std::shared_ptr<IR::BasicBlock>& from, const std::shared_ptr<IR::BasicBlock>& to);
+};
+
+#endif
@@ -9,10 +9,13 @@ class Source{
 private:
     std::istream& stream;
     std::stack<int> back;
+    std::string text;
 public:
     Source(std::istream& stream);
     int get();
     void putback(int);
+    // Buffer for the text of a token being read, reused by every token of the source
+    std::string& buffer();
 };
 
 #endif
\ No newline at end of file
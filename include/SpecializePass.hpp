@@ -0,0 +1,31 @@
+#ifndef SMPLC_SpecializePass_DEF
+#define SMPLC_SpecializePass_DEF
+
+#include <IR.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <optional>
+
+// Clone functions for the constant arguments of their calls, parameters of the clone
+// become constants, and calls with the same constant arguments branch to the clone
+class SpecializePass: public IR::Pass{
+public:
+    SpecializePass(size_t budget = defaultBudget);
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+    // Maximum number of instructions in all clones
+    static const size_t defaultBudget;
+
+private:
+    // Constant value of each parameter, in the order of declaration
+    using Arguments = std::vector<std::optional<int32_t>>;
+
+    size_t budget;
+
+    static std::string nameOf(const std::string& funcName, const Arguments& arguments);
+    static void specialize(const std::shared_ptr<IR::FuncEntry>& entry, const Arguments& arguments);
+};
+
+#endif
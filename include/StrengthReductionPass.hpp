@@ -0,0 +1,59 @@
+#ifndef SMPLC_StrengthReductionPass_DEF
+#define SMPLC_StrengthReductionPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <LoopInfo.hpp>
+#include <DCEPass.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <optional>
+
+// Replace values linear in induction variables of loop by new induction variables,
+// so that array addresses in loop become pointers incremented on each iteration
+class StrengthReductionPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+private:
+    // Basic induction variable: phi = Phi(init, update), update = phi + step
+    struct Induction{
+        IR::index_t phi;
+        IR::index_t init;
+        IR::index_t update;
+        IR::index_t step;
+        int32_t stepSign;
+    };
+    // scale * phi + sum of coefficient * term, plus base if it's an address from Adda
+    struct Linear{
+        IR::index_t phi;
+        int32_t scale;
+        std::vector<std::pair<IR::index_t, int32_t>> terms;
+        std::optional<IR::index_t> base;
+    };
+    using LinearKey = std::tuple<IR::index_t, int32_t, std::vector<std::pair<IR::index_t, int32_t>>, std::optional<IR::index_t>>;
+
+    std::unordered_map<IR::index_t, int32_t> constants;
+    std::unordered_map<IR::index_t, IR::index_t> forward;
+    // Induction variables created in current loop, with the linear value they replaced
+    std::vector<std::tuple<Induction, IR::index_t, Linear>> reduced;
+    // Replaced values are removed before checking the uses of basic induction variables
+    DCEPass dcePass;
+
+    void reduce(const IR::CFG& cfg, const IR::Loop& loop);
+    void replaceExitTest(const IR::CFG& cfg, const IR::Loop& loop);
+    // Linear value of every value of induction variable tested against bound fits in int32, so that comparing them keeps the order
+    bool fitsInt32(const Induction& induction, const Linear& linear, IR::index_t bound);
+    IR::index_t materialize(std::vector<IR::Instrction>& code, const Linear& linear, IR::index_t value);
+    IR::index_t emitConst(std::vector<IR::Instrction>& code, int32_t value);
+    IR::index_t emitMul(std::vector<IR::Instrction>& code, IR::index_t operand, int32_t factor);
+    IR::index_t emitAdd(std::vector<IR::Instrction>& code, IR::index_t operand1, IR::index_t operand2);
+    void replaceUses(const IR::CFG& cfg, std::shared_ptr<IR::FuncEntry>& entry);
+};
+
+#endif
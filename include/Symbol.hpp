@@ -0,0 +1,27 @@
+#ifndef SMPLC_Symbol_DEF
+#define SMPLC_Symbol_DEF
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+
+using SymbolId = uint32_t;
+
+// Identifiers interned while parsing: each name is stored once, then compared and hashed by its id.
+// Like Logger the table is static, smplc compiles one source per run and ids stay valid for all passes
+class Symbol{
+private:
+    Symbol();
+    static Symbol symbol;
+    // Deque keeps the strings in place, so that the views used as keys stay valid
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+public:
+    static SymbolId intern(std::string_view name);
+    static const std::string& name(SymbolId id);
+    static size_t count();
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SMPLC_TailCallPass_DEF
+#define SMPLC_TailCallPass_DEF
+
+#include <IR.hpp>
+#include <CFG.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+// Calls in tail position reuse the frame of caller instead of returning through it,
+// and calls of function to itself in tail position become a loop back to its root
+class TailCallPass: public IR::Pass{
+public:
+    void traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap);
+
+private:
+    struct TailCall{
+        IR::FuncCallLink link;
+        IR::CallSite site;
+        // No return sequence, the block falls through to the end of function
+        bool fallsToEnd;
+    };
+
+    std::unordered_map<IR::index_t, IR::index_t> forward;
+
+    static bool isTail(const IR::CFG& cfg, const IR::FuncCallLink& link, const IR::CallSite& site, bool& fallsToEnd);
+    static void cutAfterCall(TailCall& tailCall);
+    void reuseFrame(TailCall& tailCall, const std::shared_ptr<IR::FuncEntry>& callee);
+    void loopToRoot(const std::shared_ptr<IR::FuncEntry>& entry, std::vector<TailCall>& tailCalls);
+    void replace(IR::index_t& operand);
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SMPLC_VirtualMachine_DEF
+#define SMPLC_VirtualMachine_DEF
+
+#include <Bytecode.hpp>
+#include <map>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+namespace VM{
+
+// Runs Bytecode with threaded code, each instruction jumps to the handler of the next one by computed goto
+// where supported. Memory is a flat array of int32 as in IR. Windows of registers are stacked, a call moving
+// fp pushes the window of callee, and a tail call reusing the frame reuses the window
+class VirtualMachine{
+public:
+    VirtualMachine(std::istream& input, std::ostream& output, size_t memorySize = defaultMemorySize, size_t stackSize = defaultStackSize);
+    void run(const Bytecode& bytecode);
+
+    // In words of INT_SIZE
+    static const size_t defaultMemorySize;
+    // Limit of registers in all windows
+    static const size_t defaultStackSize;
+    // Instructions executed of each opcode
+    std::map<Opcode, size_t> counts;
+
+private:
+    struct Frame{
+        // Frame the function is called with
+        int32_t fp;
+        size_t base;
+        size_t windowSize;
+    };
+
+    std::istream& input;
+    std::ostream& output;
+    size_t memorySize;
+    size_t stackSize;
+    std::vector<int32_t> memory;
+    std::vector<int32_t> stack;
+    std::vector<Frame> frames;
+};
+
+};
+
+#endif
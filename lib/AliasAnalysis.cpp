@@ -0,0 +1,140 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <AliasAnalysis.hpp>
+#include <CFG.hpp>
+
+#include <set>
+#include <vector>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+IR::AliasAnalysis::AliasAnalysis(const std::shared_ptr<IR::FuncEntry>& entry){
+    IR::CFG cfg(entry);
+    // Phi is assumed to locate where its first operand does, until its second operand disagrees
+    std::set<IR::index_t> unknownPhis;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        locations.clear();
+        locations[IR::Register::fp] = Location {Location::Kind::Frame, 0, std::nullopt};
+        std::unordered_map<IR::index_t, int32_t> constants;
+        std::vector<IR::Phi*> phis;
+        // Blocks in reverse post-order, so that addresses are located before their uses
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            for(IR::Instrction& instrRef : block->instructions){
+                std::visit(overloaded {
+                    [](auto&){},
+                    [&](IR::Const& instr){
+                        constants[instr.index] = instr.value;
+                    },
+                    [&](IR::Neg& instr){
+                        if(constants.contains(instr.operand)){
+                            constants[instr.index] = -constants[instr.operand];
+                        }
+                    },
+                    [&](IR::Sub& instr){
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            constants[instr.index] = constants[instr.operand1] - constants[instr.operand2];
+                        }
+                    },
+                    [&](IR::Mul& instr){
+                        // Offsets of constant indices are computed by multiplication
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            constants[instr.index] = constants[instr.operand1] * constants[instr.operand2];
+                        }
+                    },
+                    [&](IR::Add& instr){
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            constants[instr.index] = constants[instr.operand1] + constants[instr.operand2];
+                            return;
+                        }
+                        // Frame offset is kept only when the other operand is constant
+                        IR::index_t base = instr.operand1;
+                        IR::index_t offset = instr.operand2;
+                        if(locate(base).kind != Location::Kind::Frame){
+                            std::swap(base, offset);
+                        }
+                        Location location = locate(base);
+                        if(location.kind != Location::Kind::Frame){
+                            return;
+                        }
+                        if(location.offset && constants.contains(offset)){
+                            location.offset = *location.offset + constants[offset];
+                        }else{
+                            location.offset.reset();
+                        }
+                        locations[instr.index] = location;
+                    },
+                    [&](IR::Adda& instr){
+                        // Address in array stays in the same array
+                        Location location = locate(instr.operand1);
+                        std::optional<int32_t> offset;
+                        if(constants.contains(instr.operand2)){
+                            offset = constants[instr.operand2];
+                        }
+                        if(location.kind == Location::Kind::Frame && location.offset){
+                            locations[instr.index] = Location {Location::Kind::Array, location.offset, offset};
+                        }else if(location.kind == Location::Kind::Array){
+                            if(location.element && offset){
+                                location.element = *location.element + *offset;
+                            }else{
+                                location.element.reset();
+                            }
+                            locations[instr.index] = location;
+                        }
+                    },
+                    [&](IR::Phi& instr){
+                        phis.push_back(&instr);
+                        Location location = locate(instr.operand1);
+                        if(!unknownPhis.contains(instr.index) && location.kind != Location::Kind::Unknown){
+                            location.element.reset();
+                            locations[instr.index] = location;
+                        }
+                    },
+                }, instrRef);
+            }
+        }
+        for(IR::Phi* phi : phis){
+            Location location1 = locate(phi->operand1);
+            Location location2 = locate(phi->operand2);
+            if(locations.contains(phi->index)
+                && (location1.kind != location2.kind || location1.offset != location2.offset)
+            ){
+                unknownPhis.insert(phi->index);
+                changed = true;
+            }
+        }
+    }
+}
+
+IR::AliasAnalysis::Location IR::AliasAnalysis::locate(IR::index_t address) const{
+    std::unordered_map<IR::index_t, Location>::const_iterator it = locations.find(address);
+    if(it != locations.end()){
+        return it->second;
+    }
+    return Location {Location::Kind::Unknown, std::nullopt, std::nullopt};
+}
+
+bool IR::AliasAnalysis::mayAlias(IR::index_t address1, IR::index_t address2) const{
+    return mayAlias(locate(address1), locate(address2));
+}
+
+bool IR::AliasAnalysis::mayAlias(const Location& location1, const Location& location2) const{
+    if(location1.kind == Location::Kind::Unknown || location2.kind == Location::Kind::Unknown){
+        return true;
+    }
+    // Array elements stay inside their array, and never overlap frame slots
+    if(location1.kind != location2.kind){
+        return !location1.offset || !location2.offset;
+    }
+    if(location1.offset && location2.offset && *location1.offset != *location2.offset){
+        return false;
+    }
+    // Different elements of the same array
+    return !location1.element || !location2.element || *location1.element == *location2.element;
+}
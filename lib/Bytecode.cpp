@@ -0,0 +1,457 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <Bytecode.hpp>
+#include <CFG.hpp>
+#include <Exception.hpp>
+
+#include <algorithm>
+#include <unordered_set>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+static const std::pair<const char*, size_t> opcodeInfos[] = {
+    {"halt", 1},
+    {"imm", 3},
+    {"mov", 3},
+    {"neg", 3},
+    {"add", 4},
+    {"sub", 4},
+    {"mul", 4},
+    {"div", 4},
+    {"cmp", 4},
+    {"load", 3},
+    {"store", 3},
+    {"jmp", 2},
+    {"bne", 3},
+    {"beq", 3},
+    {"ble", 3},
+    {"blt", 3},
+    {"bge", 3},
+    {"bgt", 3},
+    {"call", 3},
+    {"ret", 1},
+    {"leave", 1},
+    {"read", 2},
+    {"write", 2},
+    {"writeNL", 1},
+    {"addi", 4},
+    {"subi", 4},
+    {"muli", 4},
+    {"cmpbne", 4},
+    {"cmpbeq", 4},
+    {"cmpble", 4},
+    {"cmpblt", 4},
+    {"cmpbge", 4},
+    {"cmpbgt", 4},
+    {"cmpbnei", 4},
+    {"cmpbeqi", 4},
+    {"cmpblei", 4},
+    {"cmpblti", 4},
+    {"cmpbgei", 4},
+    {"cmpbgti", 4},
+    {"loadoffset", 4},
+    {"storeoffset", 4},
+    {"loadindexed", 5},
+    {"storeindexed", 5},
+};
+static_assert(sizeof(opcodeInfos) / sizeof(opcodeInfos[0]) == VM::opcodeCount);
+
+std::string VM::opcodeName(VM::Opcode opcode){
+    return opcodeInfos[(size_t)opcode].first;
+}
+
+size_t VM::instrSize(VM::Opcode opcode){
+    return opcodeInfos[(size_t)opcode].second;
+}
+
+// Value tested by conditional branch
+static std::optional<IR::index_t> conditionOf(const IR::Instrction& instr){
+    return std::visit(overloaded {
+        [](const auto&) -> std::optional<IR::index_t> { return std::nullopt; },
+        [](const IR::Bne& target) -> std::optional<IR::index_t> { return target.operand1; },
+        [](const IR::Beq& target) -> std::optional<IR::index_t> { return target.operand1; },
+        [](const IR::Ble& target) -> std::optional<IR::index_t> { return target.operand1; },
+        [](const IR::Blt& target) -> std::optional<IR::index_t> { return target.operand1; },
+        [](const IR::Bge& target) -> std::optional<IR::index_t> { return target.operand1; },
+        [](const IR::Bgt& target) -> std::optional<IR::index_t> { return target.operand1; },
+    }, instr);
+}
+
+VM::Bytecode::Bytecode(const std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair : funcMap){
+        if(funcPair.second->root){
+            lower(funcPair.first, funcPair.second);
+        }
+    }
+    for(std::pair<size_t, std::shared_ptr<IR::BasicBlock>>& patch : blockPatches){
+        code[patch.first] = blockStarts.at(patch.second);
+    }
+    for(std::pair<size_t, std::string>& patch : callPatches){
+        code[patch.first] = funcStarts.at(patch.second);
+        code[patch.first + 1] = windowSizes.at(patch.second);
+    }
+    entry = funcStarts.at("_main");
+    blockStarts.clear();
+    blockPatches.clear();
+    callPatches.clear();
+}
+
+void VM::Bytecode::emit(VM::Opcode opcode, std::initializer_list<int32_t> operands){
+    code.push_back((int32_t)opcode);
+    code.insert(code.end(), operands.begin(), operands.end());
+}
+
+void VM::Bytecode::emitBranch(VM::Opcode opcode, std::initializer_list<int32_t> operands, const std::shared_ptr<IR::BasicBlock>& target){
+    emit(opcode, operands);
+    blockPatches.emplace_back(code.size(), target);
+    code.push_back(0);
+}
+
+int32_t VM::Bytecode::registerOf(Function& func, IR::index_t value){
+    switch(value){
+        case IR::Register::pc:
+            return VM::Slot::pc;
+        case IR::Register::fp:
+            return VM::Slot::fp;
+        case IR::Register::rval:
+            return VM::Slot::rval;
+        default:
+            break;
+    }
+    std::unordered_map<IR::index_t, int32_t>::iterator it = func.registers.find(value);
+    if(it == func.registers.end()){
+        it = func.registers.emplace(value, func.windowSize++).first;
+    }
+    return it->second;
+}
+
+int32_t VM::Bytecode::use(Function& func, IR::index_t value){
+    if(value == IR::Register::pc){
+        emit(VM::Opcode::Imm, {VM::Slot::pc, 0});
+        pcPatches.push_back(code.size() - 1);
+    }
+    ++func.reads[value];
+    return registerOf(func, value);
+}
+
+std::optional<int32_t> VM::Bytecode::constantOf(const Function& func, IR::index_t value){
+    std::unordered_map<IR::index_t, int32_t>::const_iterator it = func.constants.find(value);
+    if(it == func.constants.end()){
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::optional<size_t> VM::Bytecode::fusible(const Function& func, const std::vector<IR::Instrction>& instrs, size_t pos, IR::index_t value){
+    std::unordered_map<IR::index_t, size_t>::const_iterator uses = func.uses.find(value);
+    if(uses == func.uses.end() || uses->second != 1){
+        return std::nullopt;
+    }
+    while(pos > 0){
+        --pos;
+        if(IR::getInstrIndex(instrs[pos]) == value){
+            if(std::holds_alternative<IR::Move>(instrs[pos])){
+                return std::nullopt;
+            }
+            return pos;
+        }
+        // Const skipped can't overwrite the operands read later, unless it has an allocated register
+        std::unordered_map<IR::index_t, int32_t>::const_iterator reg = func.registers.find(IR::getInstrIndex(instrs[pos]));
+        if(!std::holds_alternative<IR::Const>(instrs[pos]) || (reg != func.registers.end() && (size_t)reg->second < func.allocatedSize)){
+            return std::nullopt;
+        }
+    }
+    return std::nullopt;
+}
+
+VM::Bytecode::Address VM::Bytecode::matchAddress(const Function& func, const std::vector<IR::Instrction>& instrs, size_t pos, IR::index_t address){
+    std::optional<size_t> defPos = fusible(func, instrs, pos, address);
+    IR::index_t operand1, operand2;
+    if(const IR::Add* add = defPos ? std::get_if<IR::Add>(&instrs[*defPos]) : nullptr){
+        operand1 = add->operand1;
+        operand2 = add->operand2;
+    }else if(const IR::Adda* adda = defPos ? std::get_if<IR::Adda>(&instrs[*defPos]) : nullptr){
+        operand1 = adda->operand1;
+        operand2 = adda->operand2;
+    }else{
+        return {{}, 0, 0, 0, false};
+    }
+    // base + offset
+    if(std::optional<int32_t> offset = constantOf(func, operand2)){
+        return {{*defPos}, operand1, 0, *offset, false};
+    }
+    if(std::optional<int32_t> offset = constantOf(func, operand1)){
+        return {{*defPos}, operand2, 0, *offset, false};
+    }
+    // base + index * scale
+    for(std::pair<IR::index_t, IR::index_t> operands : {std::make_pair(operand1, operand2), std::make_pair(operand2, operand1)}){
+        std::optional<size_t> mulPos = fusible(func, instrs, *defPos, operands.second);
+        if(const IR::Mul* mul = mulPos ? std::get_if<IR::Mul>(&instrs[*mulPos]) : nullptr){
+            if(std::optional<int32_t> scale = constantOf(func, mul->operand2)){
+                return {{*mulPos, *defPos}, operands.first, mul->operand1, *scale, true};
+            }
+            if(std::optional<int32_t> scale = constantOf(func, mul->operand1)){
+                return {{*mulPos, *defPos}, operands.first, mul->operand2, *scale, true};
+            }
+        }
+    }
+    return {{*defPos}, operand1, operand2, 1, true};
+}
+
+std::vector<size_t> VM::Bytecode::fusedPositions(const Function& func, const std::vector<IR::Instrction>& instrs, size_t pos){
+    if(const IR::Load* load = std::get_if<IR::Load>(&instrs[pos])){
+        return matchAddress(func, instrs, pos, load->operand).fused;
+    }
+    if(const IR::Store* store = std::get_if<IR::Store>(&instrs[pos])){
+        return matchAddress(func, instrs, pos, store->operand2).fused;
+    }
+    std::optional<IR::index_t> condition = conditionOf(instrs[pos]);
+    std::optional<size_t> cmpPos = condition ? fusible(func, instrs, pos, *condition) : std::nullopt;
+    if(cmpPos && std::holds_alternative<IR::Cmp>(instrs[*cmpPos])){
+        return {*cmpPos};
+    }
+    return {};
+}
+
+void VM::Bytecode::lower(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry){
+    // Allocated registers come first in window, values without register follow
+    Function func;
+    for(const std::pair<const IR::index_t, size_t>& regPair : entry->registers){
+        func.registers[regPair.first] = VM::Slot::slotCount + regPair.second;
+        func.windowSize = std::max(func.windowSize, VM::Slot::slotCount + regPair.second + 1);
+    }
+    func.allocatedSize = func.windowSize;
+    std::unordered_map<IR::index_t, std::string> callees;
+    for(const IR::FuncCallLink& link : entry->callLinks){
+        callees[link.callIndex] = link.funcName;
+    }
+
+    IR::CFG cfg(entry);
+    std::unordered_set<IR::index_t> moved;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                ++func.uses[operand];
+            });
+            if(const IR::Const* constant = std::get_if<IR::Const>(&instr)){
+                func.constants[constant->index] = constant->value;
+            }else if(const IR::Move* move = std::get_if<IR::Move>(&instr)){
+                moved.insert(move->operand1);
+            }
+        }
+    }
+    for(IR::index_t value : moved){
+        func.constants.erase(value);
+    }
+
+    // Arithmetic with immediate if an operand is constant
+    auto emitArith = [&](VM::Opcode opcode, std::optional<VM::Opcode> immOpcode, bool isCommutative, IR::index_t index, IR::index_t operand1, IR::index_t operand2){
+        std::optional<int32_t> immediate;
+        if(immOpcode){
+            immediate = constantOf(func, operand2);
+            if(!immediate && isCommutative && (immediate = constantOf(func, operand1))){
+                std::swap(operand1, operand2);
+            }
+        }
+        if(!immediate){
+            int32_t src1 = use(func, operand1);
+            int32_t src2 = use(func, operand2);
+            emit(opcode, {registerOf(func, index), src1, src2});
+        }else if(*immediate == 0 && *immOpcode != VM::Opcode::MulI){
+            int32_t src = use(func, operand1);
+            int32_t dest = registerOf(func, index);
+            if(dest != src){
+                emit(VM::Opcode::Mov, {dest, src});
+            }
+        }else{
+            int32_t src = use(func, operand1);
+            emit(*immOpcode, {registerOf(func, index), src, *immediate});
+        }
+    };
+    // Branch on the result of Cmp right before, or on value
+    auto emitCondBranch = [&](VM::Opcode opcode, VM::Opcode cmpOpcode, VM::Opcode cmpImmOpcode, const std::vector<IR::Instrction>& instrs, size_t pos, IR::index_t condition, const std::shared_ptr<IR::BasicBlock>& target){
+        std::vector<size_t> fused = fusedPositions(func, instrs, pos);
+        if(fused.empty()){
+            emitBranch(opcode, {use(func, condition)}, target);
+            return;
+        }
+        const IR::Cmp& cmp = std::get<IR::Cmp>(instrs[fused.front()]);
+        if(std::optional<int32_t> immediate = constantOf(func, cmp.operand2)){
+            emitBranch(cmpImmOpcode, {use(func, cmp.operand1), *immediate}, target);
+        }else{
+            int32_t src1 = use(func, cmp.operand1);
+            int32_t src2 = use(func, cmp.operand2);
+            emitBranch(cmpOpcode, {src1, src2}, target);
+        }
+    };
+    // Memory access with address computed by the instructions right before, returns false if not fused
+    auto emitAccess = [&](VM::Opcode offsetOpcode, VM::Opcode indexedOpcode, int32_t reg, const std::vector<IR::Instrction>& instrs, size_t pos, IR::index_t address){
+        VM::Bytecode::Address match = matchAddress(func, instrs, pos, address);
+        if(match.fused.empty()){
+            return false;
+        }
+        int32_t base = use(func, match.base);
+        if(match.isIndexed){
+            int32_t index = use(func, match.index);
+            emit(indexedOpcode, {reg, base, index, match.immediate});
+        }else{
+            emit(offsetOpcode, {reg, base, match.immediate});
+        }
+        return true;
+    };
+
+    // Lowered twice, the first time only counts reads of constants from register, so that Const folded
+    // into all its uses is dropped
+    size_t codeStart = code.size();
+    size_t blockPatchStart = blockPatches.size();
+    size_t callPatchStart = callPatches.size();
+    for(bool isCounting : {true, false}){
+        if(!isCounting){
+            code.resize(codeStart);
+            blockPatches.resize(blockPatchStart);
+            callPatches.resize(callPatchStart);
+        }
+        funcStarts[funcName] = code.size();
+        for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+            const std::shared_ptr<IR::BasicBlock>& block = cfg.blocks[blockId];
+            const std::vector<IR::Instrction>& instrs = block->instructions;
+            blockStarts[block] = code.size();
+            pcPatches.clear();
+            std::vector<bool> isFused(instrs.size(), false);
+            for(size_t pos = 0; pos < instrs.size(); ++pos){
+                for(size_t fused : fusedPositions(func, instrs, pos)){
+                    isFused[fused] = true;
+                }
+            }
+            // Block without successor ends the function, unless it jumps, returns or ends the program
+            bool isEnd = true;
+            for(size_t pos = 0; pos < instrs.size(); ++pos){
+                isEnd = true;
+                if(isFused[pos]){
+                    continue;
+                }
+                std::visit(overloaded {
+                    [&](const IR::Nop&){},
+                    [&](const IR::Phi&){
+                        throw Exception(std::string("Phi left in '") + funcName + "', translate out of SSA form before lowering");
+                    },
+                    [&](const IR::Const& target){
+                        if(isCounting || func.reads[target.index] > 0){
+                            emit(VM::Opcode::Imm, {registerOf(func, target.index), target.value});
+                        }
+                    },
+                    [&](const IR::Neg& target){
+                        int32_t src = use(func, target.operand);
+                        emit(VM::Opcode::Neg, {registerOf(func, target.index), src});
+                    },
+                    [&](const IR::Add& target){
+                        emitArith(VM::Opcode::Add, VM::Opcode::AddI, true, target.index, target.operand1, target.operand2);
+                    },
+                    [&](const IR::Adda& target){
+                        emitArith(VM::Opcode::Add, VM::Opcode::AddI, true, target.index, target.operand1, target.operand2);
+                    },
+                    [&](const IR::Sub& target){
+                        emitArith(VM::Opcode::Sub, VM::Opcode::SubI, false, target.index, target.operand1, target.operand2);
+                    },
+                    [&](const IR::Mul& target){
+                        emitArith(VM::Opcode::Mul, VM::Opcode::MulI, true, target.index, target.operand1, target.operand2);
+                    },
+                    [&](const IR::Div& target){
+                        emitArith(VM::Opcode::Div, std::nullopt, false, target.index, target.operand1, target.operand2);
+                    },
+                    [&](const IR::Cmp& target){
+                        emitArith(VM::Opcode::Cmp, std::nullopt, false, target.index, target.operand1, target.operand2);
+                    },
+                    [&](const IR::Load& target){
+                        int32_t dest = registerOf(func, target.index);
+                        if(!emitAccess(VM::Opcode::LoadOffset, VM::Opcode::LoadIndexed, dest, instrs, pos, target.operand)){
+                            emit(VM::Opcode::Load, {dest, use(func, target.operand)});
+                        }
+                    },
+                    [&](const IR::Store& target){
+                        int32_t src = use(func, target.operand1);
+                        if(!emitAccess(VM::Opcode::StoreOffset, VM::Opcode::StoreIndexed, src, instrs, pos, target.operand2)){
+                            emit(VM::Opcode::Store, {src, use(func, target.operand2)});
+                        }
+                    },
+                    [&](const IR::StoreReg& target){
+                        int32_t src = use(func, target.operand2);
+                        emit(VM::Opcode::Mov, {registerOf(func, target.operand1), src});
+                    },
+                    [&](const IR::Move& target){
+                        int32_t src = use(func, target.operand2);
+                        int32_t dest = registerOf(func, target.operand1);
+                        if(dest != src){
+                            emit(VM::Opcode::Mov, {dest, src});
+                        }
+                    },
+                    [&](const IR::End&){
+                        emit(VM::Opcode::Halt, {});
+                        isEnd = false;
+                    },
+                    [&](const IR::Bra& target){
+                        std::unordered_map<IR::index_t, std::string>::iterator callee = callees.find(target.index);
+                        if(callee != callees.end()){
+                            emit(VM::Opcode::Call, {0, 0});
+                            callPatches.emplace_back(code.size() - 2, callee->second);
+                            // Return address is pc + INT_SIZE
+                            for(size_t patch : pcPatches){
+                                code[patch] = (code.size() - 1) * INT_SIZE;
+                            }
+                            pcPatches.clear();
+                        }else if(target.operand == IR::Register::pc){
+                            emit(VM::Opcode::Ret, {});
+                            isEnd = false;
+                        }else{
+                            emitBranch(VM::Opcode::Jmp, {}, block->branch);
+                            isEnd = false;
+                        }
+                    },
+                    [&](const IR::Bne& target){
+                        emitCondBranch(VM::Opcode::Bne, VM::Opcode::CmpBne, VM::Opcode::CmpBneI, instrs, pos, target.operand1, block->branch);
+                    },
+                    [&](const IR::Beq& target){
+                        emitCondBranch(VM::Opcode::Beq, VM::Opcode::CmpBeq, VM::Opcode::CmpBeqI, instrs, pos, target.operand1, block->branch);
+                    },
+                    [&](const IR::Ble& target){
+                        emitCondBranch(VM::Opcode::Ble, VM::Opcode::CmpBle, VM::Opcode::CmpBleI, instrs, pos, target.operand1, block->branch);
+                    },
+                    [&](const IR::Blt& target){
+                        emitCondBranch(VM::Opcode::Blt, VM::Opcode::CmpBlt, VM::Opcode::CmpBltI, instrs, pos, target.operand1, block->branch);
+                    },
+                    [&](const IR::Bge& target){
+                        emitCondBranch(VM::Opcode::Bge, VM::Opcode::CmpBge, VM::Opcode::CmpBgeI, instrs, pos, target.operand1, block->branch);
+                    },
+                    [&](const IR::Bgt& target){
+                        emitCondBranch(VM::Opcode::Bgt, VM::Opcode::CmpBgt, VM::Opcode::CmpBgtI, instrs, pos, target.operand1, block->branch);
+                    },
+                    [&](const IR::Read& target){
+                        emit(VM::Opcode::Read, {registerOf(func, target.index)});
+                    },
+                    [&](const IR::Write& target){
+                        emit(VM::Opcode::Write, {use(func, target.operand)});
+                    },
+                    [&](const IR::WriteNL&){
+                        emit(VM::Opcode::WriteNL, {});
+                    },
+                }, instrs[pos]);
+            }
+            if(!pcPatches.empty()){
+                throw Exception(std::string("pc read without call in '") + funcName + "'");
+            }
+            if(block->fallThrough){
+                if(blockId + 1 >= cfg.blocks.size() || cfg.blocks[blockId + 1] != block->fallThrough){
+                    emitBranch(VM::Opcode::Jmp, {}, block->fallThrough);
+                }
+            }else if(isEnd){
+                emit((funcName == "_main") ? VM::Opcode::Halt : VM::Opcode::Leave, {});
+            }
+        }
+    }
+    windowSizes[funcName] = func.windowSize;
+}
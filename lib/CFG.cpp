@@ -0,0 +1,384 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <CFG.hpp>
+
+#include <stack>
+#include <utility>
+#include <algorithm>
+#include <limits>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+static const size_t noBlock = std::numeric_limits<size_t>::max();
+
+IR::CFG::CFG(const std::shared_ptr<IR::FuncEntry>& entry){
+    if(!entry->root){
+        return;
+    }
+    // Post-order
+    std::vector<std::shared_ptr<IR::BasicBlock>> postOrder;
+    std::stack<std::pair<std::shared_ptr<IR::BasicBlock>, int>> dfsStack;
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, bool> visited;
+    dfsStack.emplace(entry->root, 0);
+    visited[entry->root] = true;
+    while(!dfsStack.empty()){
+        std::pair<std::shared_ptr<IR::BasicBlock>, int>& top = dfsStack.top();
+        std::shared_ptr<IR::BasicBlock> next;
+        if(top.second == 0){
+            next = top.first->fallThrough;
+        }else if(top.second == 1){
+            next = top.first->branch;
+        }else{
+            postOrder.push_back(top.first);
+            dfsStack.pop();
+            continue;
+        }
+        top.second += 1;
+        if(next && !visited[next]){
+            visited[next] = true;
+            dfsStack.emplace(next, 0);
+        }
+    }
+    blocks.assign(postOrder.rbegin(), postOrder.rend());
+    for(size_t id = 0; id < blocks.size(); ++id){
+        blockId[blocks[id]] = id;
+    }
+
+    // Edges
+    preds.resize(blocks.size());
+    succs.resize(blocks.size());
+    for(size_t id = 0; id < blocks.size(); ++id){
+        if(blocks[id]->fallThrough){
+            succs[id].push_back(blockId.at(blocks[id]->fallThrough));
+        }
+        if(blocks[id]->branch && blocks[id]->branch != blocks[id]->fallThrough){
+            succs[id].push_back(blockId.at(blocks[id]->branch));
+        }
+        for(size_t succ : succs[id]){
+            preds[succ].push_back(id);
+        }
+    }
+
+    // Dominators (Cooper, Harvey & Kennedy)
+    idom.assign(blocks.size(), noBlock);
+    idom[0] = 0;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(size_t id = 1; id < blocks.size(); ++id){
+            size_t newIdom = noBlock;
+            for(size_t pred : preds[id]){
+                if(idom[pred] == noBlock){
+                    continue;
+                }
+                if(newIdom == noBlock){
+                    newIdom = pred;
+                    continue;
+                }
+                size_t finger = pred;
+                while(finger != newIdom){
+                    while(finger > newIdom){
+                        finger = idom[finger];
+                    }
+                    while(newIdom > finger){
+                        newIdom = idom[newIdom];
+                    }
+                }
+            }
+            if(idom[id] != newIdom){
+                idom[id] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    domChildren.resize(blocks.size());
+    for(size_t id = 1; id < blocks.size(); ++id){
+        domChildren[idom[id]].push_back(id);
+    }
+
+    // Numbering on dominator tree for constant time dominance query
+    domEnter.resize(blocks.size());
+    domLeave.resize(blocks.size());
+    size_t counter = 0;
+    std::stack<std::pair<size_t, size_t>> domStack;
+    domStack.emplace(0, 0);
+    domEnter[0] = counter++;
+    while(!domStack.empty()){
+        std::pair<size_t, size_t>& top = domStack.top();
+        if(top.second < domChildren[top.first].size()){
+            size_t child = domChildren[top.first][top.second++];
+            domEnter[child] = counter++;
+            domStack.emplace(child, 0);
+        }else{
+            domLeave[top.first] = counter++;
+            domStack.pop();
+        }
+    }
+
+    // Sort predecessors in Phi operand order
+    for(size_t id = 0; id < blocks.size(); ++id){
+        std::stable_sort(preds[id].begin(), preds[id].end(), [this, id](size_t a, size_t b){
+            bool aBack = dominates(id, a);
+            bool bBack = dominates(id, b);
+            if(aBack != bBack){
+                return bBack;
+            }
+            bool aBranch = blocks[a]->fallThrough != blocks[id];
+            bool bBranch = blocks[b]->fallThrough != blocks[id];
+            if(aBranch != bBranch){
+                return bBranch;
+            }
+            return a < b;
+        });
+    }
+}
+
+bool IR::CFG::dominates(size_t dom, size_t block) const{
+    return domEnter[dom] <= domEnter[block] && domLeave[block] <= domLeave[dom];
+}
+
+void IR::relinkBranch(const std::shared_ptr<IR::BasicBlock>& block){
+    if(!block->branch || block->instructions.empty()){
+        return;
+    }
+    if(block->branch->instructions.empty()){
+        block->branch->instructions.emplace_back(IR::Nop());
+    }
+    IR::index_t target = IR::getInstrIndex(block->branch->instructions.front());
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Bra& instr){
+            if(instr.operand != IR::Register::pc){
+                instr.operand = target;
+            }
+        },
+        [&](IR::Bne& instr){ instr.operand2 = target; },
+        [&](IR::Beq& instr){ instr.operand2 = target; },
+        [&](IR::Ble& instr){ instr.operand2 = target; },
+        [&](IR::Blt& instr){ instr.operand2 = target; },
+        [&](IR::Bge& instr){ instr.operand2 = target; },
+        [&](IR::Bgt& instr){ instr.operand2 = target; },
+    }, block->instructions.back());
+}
+
+void IR::relinkCalls(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair : funcMap){
+        if(!funcPair.second->root || funcPair.second->callLinks.empty()){
+            continue;
+        }
+        std::unordered_map<IR::index_t, IR::Bra*> callMap;
+        for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(funcPair.second).blocks){
+            for(IR::Instrction& instr : block->instructions){
+                if(std::holds_alternative<IR::Bra>(instr)){
+                    callMap[std::get<IR::Bra>(instr).index] = &std::get<IR::Bra>(instr);
+                }
+            }
+        }
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            std::shared_ptr<IR::BasicBlock>& calleeRoot = funcMap.at(link.funcName)->root;
+            if(!callMap.contains(link.callIndex) || !calleeRoot){
+                continue;
+            }
+            if(calleeRoot->instructions.empty()){
+                calleeRoot->instructions.emplace_back(IR::Nop());
+            }
+            callMap[link.callIndex]->operand = IR::getInstrIndex(calleeRoot->instructions.front());
+        }
+    }
+}
+
+std::optional<IR::CallSite> IR::findCallSite(const IR::CFG& cfg, const IR::FuncCallLink& link){
+    std::unordered_map<IR::index_t, IR::Instrction*> instrMap;
+    std::optional<IR::CallSite> site;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(size_t pos = 0; pos < block->instructions.size(); ++pos){
+            IR::index_t index = IR::getInstrIndex(block->instructions[pos]);
+            instrMap[index] = &block->instructions[pos];
+            if(index == link.callIndex){
+                site.emplace(IR::CallSite {block, pos, 0, {}});
+            }
+        }
+    }
+    if(!site || site->position == 0 || !std::holds_alternative<IR::StoreReg>(site->block->instructions[site->position - 1])){
+        return std::nullopt;
+    }
+    std::vector<IR::Instrction>& instrs = site->block->instructions;
+
+    // Destination: fp + Const
+    IR::index_t dest = std::get<IR::StoreReg>(instrs[site->position - 1]).operand2;
+    if(!instrMap.contains(dest) || !std::holds_alternative<IR::Add>(*instrMap[dest])){
+        return std::nullopt;
+    }
+    IR::Add& destInstr = std::get<IR::Add>(*instrMap[dest]);
+    if(destInstr.operand1 != IR::Register::fp || !instrMap.contains(destInstr.operand2) || !std::holds_alternative<IR::Const>(*instrMap[destInstr.operand2])){
+        return std::nullopt;
+    }
+    site->frameOffset = std::get<IR::Const>(*instrMap[destInstr.operand2]).value;
+
+    // Addresses in the frame of callee, and stores to them
+    site->setup = {dest, IR::getInstrIndex(instrs[site->position - 1]), link.callIndex};
+    for(size_t pos = 0; pos < site->position; ++pos){
+        if(std::holds_alternative<IR::Add>(instrs[pos]) && std::get<IR::Add>(instrs[pos]).operand1 == dest){
+            site->setup.insert(std::get<IR::Add>(instrs[pos]).index);
+        }
+    }
+    for(size_t pos = 0; pos < site->position; ++pos){
+        if(std::holds_alternative<IR::Store>(instrs[pos]) && site->setup.contains(std::get<IR::Store>(instrs[pos]).operand2)){
+            IR::Store& store = std::get<IR::Store>(instrs[pos]);
+            site->setup.insert(store.index);
+            // Return address
+            if(instrMap.contains(store.operand1) && std::holds_alternative<IR::Add>(*instrMap[store.operand1])
+                && std::get<IR::Add>(*instrMap[store.operand1]).operand1 == IR::Register::pc
+            ){
+                site->setup.insert(store.operand1);
+            }
+        }
+    }
+    return site;
+}
+
+std::optional<size_t> IR::returnStart(const std::vector<IR::Instrction>& instrs, size_t braPos){
+    // StoreReg rval, Load fp, Const, Add, Load, StoreReg fp, StoreReg pc, Bra pc
+    if(braPos < 6
+        || !std::holds_alternative<IR::StoreReg>(instrs[braPos - 1]) || std::get<IR::StoreReg>(instrs[braPos - 1]).operand1 != IR::Register::pc
+        || !std::holds_alternative<IR::StoreReg>(instrs[braPos - 2]) || std::get<IR::StoreReg>(instrs[braPos - 2]).operand1 != IR::Register::fp
+        || !std::holds_alternative<IR::Load>(instrs[braPos - 3])
+        || !std::holds_alternative<IR::Add>(instrs[braPos - 4])
+        || !std::holds_alternative<IR::Const>(instrs[braPos - 5])
+        || !std::holds_alternative<IR::Load>(instrs[braPos - 6]) || std::get<IR::Load>(instrs[braPos - 6]).operand != IR::Register::fp
+    ){
+        return std::nullopt;
+    }
+    if(braPos >= 7 && std::holds_alternative<IR::StoreReg>(instrs[braPos - 7]) && std::get<IR::StoreReg>(instrs[braPos - 7]).operand1 == IR::Register::rval){
+        return braPos - 7;
+    }
+    return braPos - 6;
+}
+
+std::shared_ptr<IR::FuncEntry> IR::cloneFunc(const std::shared_ptr<IR::FuncEntry>& entry){
+    std::shared_ptr<IR::FuncEntry> clone = std::make_shared<IR::FuncEntry>();
+    clone->variables = entry->variables;
+    clone->paramAddrMap = entry->paramAddrMap;
+    clone->paramNames = entry->paramNames;
+    clone->isVoid = entry->isVoid;
+    clone->frameSize = entry->frameSize;
+    if(!entry->root){
+        return clone;
+    }
+    IR::CFG cfg(entry);
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::shared_ptr<IR::BasicBlock>> blockMap;
+    std::unordered_map<IR::index_t, IR::index_t> valueMap;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        std::shared_ptr<IR::BasicBlock> newBlock = std::make_shared<IR::BasicBlock>();
+        for(IR::Instrction& instr : block->instructions){
+            valueMap[IR::getInstrIndex(instr)] = IR::getInstrIndex(newBlock->instructions.emplace_back(IR::cloneInstr(instr)));
+        }
+        blockMap[block] = newBlock;
+    }
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        std::shared_ptr<IR::BasicBlock>& newBlock = blockMap[block];
+        newBlock->branch = blockMap.contains(block->branch) ? blockMap[block->branch] : nullptr;
+        newBlock->fallThrough = blockMap.contains(block->fallThrough) ? blockMap[block->fallThrough] : nullptr;
+        newBlock->dominator = blockMap.contains(block->dominator) ? blockMap[block->dominator] : nullptr;
+        for(IR::Instrction& instr : newBlock->instructions){
+            IR::forEachOperand(instr, [&valueMap](IR::index_t& operand){
+                if(valueMap.contains(operand)){
+                    operand = valueMap[operand];
+                }
+            });
+        }
+    }
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        IR::relinkBranch(blockMap[block]);
+    }
+    clone->root = blockMap[entry->root];
+    for(const IR::FuncCallLink& link : entry->callLinks){
+        if(!valueMap.contains(link.callIndex)){
+            continue;
+        }
+        IR::FuncCallLink& newLink = clone->callLinks.emplace_back(link);
+        newLink.callIndex = valueMap[link.callIndex];
+        newLink.block = blockMap.contains(link.block) ? blockMap[link.block] : nullptr;
+        for(std::pair<SymbolId, IR::index_t>& param : newLink.params){
+            if(valueMap.contains(param.second)){
+                param.second = valueMap[param.second];
+            }
+        }
+        if(newLink.resultIndex && valueMap.contains(*newLink.resultIndex)){
+            newLink.resultIndex = valueMap[*newLink.resultIndex];
+        }
+    }
+    return clone;
+}
+
+void IR::foldConstants(const std::shared_ptr<IR::FuncEntry>& entry){
+    // Arithmetic on constants becomes a constant with the same index, so that uses need no change
+    std::unordered_map<IR::index_t, int32_t> constants;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+            for(IR::Instrction& instrRef : block->instructions){
+                std::optional<int32_t> value = std::visit(overloaded {
+                    [](auto&) -> std::optional<int32_t> { return std::nullopt; },
+                    [&](IR::Const& instr) -> std::optional<int32_t> {
+                        constants[instr.index] = instr.value;
+                        return std::nullopt;
+                    },
+                    [&](IR::Neg& instr) -> std::optional<int32_t> {
+                        if(constants.contains(instr.operand)){
+                            return (int32_t)(0u - (uint32_t)constants[instr.operand]);
+                        }
+                        return std::nullopt;
+                    },
+                    [&](IR::Add& instr) -> std::optional<int32_t> {
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            return (int32_t)((uint32_t)constants[instr.operand1] + (uint32_t)constants[instr.operand2]);
+                        }
+                        return std::nullopt;
+                    },
+                    [&](IR::Sub& instr) -> std::optional<int32_t> {
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            return (int32_t)((uint32_t)constants[instr.operand1] - (uint32_t)constants[instr.operand2]);
+                        }
+                        return std::nullopt;
+                    },
+                    [&](IR::Mul& instr) -> std::optional<int32_t> {
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            return (int32_t)((uint32_t)constants[instr.operand1] * (uint32_t)constants[instr.operand2]);
+                        }
+                        return std::nullopt;
+                    },
+                    [&](IR::Div& instr) -> std::optional<int32_t> {
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2) && constants[instr.operand2] != 0
+                            && !(constants[instr.operand1] == std::numeric_limits<int32_t>::min() && constants[instr.operand2] == -1)
+                        ){
+                            return constants[instr.operand1] / constants[instr.operand2];
+                        }
+                        return std::nullopt;
+                    },
+                    [&](IR::Cmp& instr) -> std::optional<int32_t> {
+                        if(constants.contains(instr.operand1) && constants.contains(instr.operand2)){
+                            int32_t value1 = constants[instr.operand1];
+                            int32_t value2 = constants[instr.operand2];
+                            return (value1 > value2) - (value1 < value2);
+                        }
+                        return std::nullopt;
+                    },
+                }, instrRef);
+                if(value && !std::visit([](auto& instr){ return instr.isImportant; }, instrRef)){
+                    IR::Const folded(*value);
+                    folded.index = IR::getInstrIndex(instrRef);
+                    instrRef = folded;
+                    constants[folded.index] = *value;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
@@ -5,251 +5,280 @@
  */
 
 #include <CSEPass.hpp>
+#include <CallGraph.hpp>
 
-#include <sstream>
+#include <stack>
 #include <algorithm>
 
-void CSEPass::beforeVisit(std::shared_ptr<IR::BasicBlock>& target){
-    if(contextStack.empty()){
-        contextStack.emplace();
+CSEPass::CSEPass(): versionCounter(0){}
+
+void CSEPass::enterScope(){
+    scopeMarks.emplace_back(ScopeMark {versionLog.size(), exprTable.mark(), pureCalls.size()});
+}
+
+void CSEPass::leaveScope(){
+    ScopeMark mark = scopeMarks.back();
+    scopeMarks.pop_back();
+    while(versionLog.size() > mark.versionLog){
+        std::pair<IR::index_t, IR::index_t>& entry = versionLog.back();
+        memoryVersion[entry.first] = entry.second;
+        versionLog.pop_back();
+    }
+    exprTable.rollback(mark.exprTable);
+    pureCalls.resize(mark.pureCalls);
+}
+
+IR::index_t CSEPass::classOf(IR::index_t address){
+    IR::AliasAnalysis::Location location = aliasAnalysis->locate(address);
+    switch(location.kind){
+        case IR::AliasAnalysis::Location::Kind::Array :
+            return arrayMemory + (IR::index_t)*location.offset;
+        case IR::AliasAnalysis::Location::Kind::Frame :
+            return frameMemory;
+        default:
+            return unknownMemory;
     }
-    if(target->dominator && target->dominator->branch == target){
-        contextStack.pop();
+}
+
+IR::index_t CSEPass::versionOf(IR::index_t memoryClass){
+    // Versions are drawn from one counter, so the newer of the two identifies the memory state
+    return std::max(memoryVersion[memoryClass], memoryVersion[allMemory]);
+}
+
+void CSEPass::renewVersion(IR::index_t memoryClass){
+    versionLog.emplace_back(memoryClass, memoryVersion[memoryClass]);
+    memoryVersion[memoryClass] = ++versionCounter;
+}
+
+void CSEPass::replace(IR::index_t& operand){
+    std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(operand);
+    if(it != forward.end()){
+        operand = it->second;
     }
 }
-void CSEPass::afterVisit(std::shared_ptr<IR::BasicBlock>& target){
-    std::erase_if(target->instructions, [this](IR::Instrction& instr) -> bool {
-        return removedSet.contains(IR::getInstrIndex(instr));
-    });
-    if(target->fallThrough && target->fallThrough == target->dominator){
-        Context& context = contextStack.top();
-        for(IR::Instrction& instrRef : target->dominator->instructions){
-            if(std::holds_alternative<IR::Phi>(instrRef)){
-                IR::Phi& instr = std::get<IR::Phi>(instrRef);
-                if(context.forward.contains(instr.operand1)){
-                    instr.operand1 = context.forward[instr.operand1];
-                }
-                if(context.forward.contains(instr.operand2)){
-                    instr.operand2 = context.forward[instr.operand2];
+
+void CSEPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    sideEffects.emplace(funcMap);
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        IR::CFG cfg(funcPair.second);
+        aliasAnalysis.emplace(funcPair.second);
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            callMap[link.callIndex] = {&link, IR::findCallSite(cfg, link)};
+        }
+        // Walk dominator tree, tables in scope are exactly those of dominating blocks
+        std::stack<std::pair<size_t, size_t>> domStack;
+        enterScope();
+        visitBlock(cfg, 0);
+        domStack.emplace(0, 0);
+        while(!domStack.empty()){
+            std::pair<size_t, size_t>& top = domStack.top();
+            if(top.second < cfg.domChildren[top.first].size()){
+                size_t child = cfg.domChildren[top.first][top.second++];
+                enterScope();
+                visitBlock(cfg, child);
+                domStack.emplace(child, 0);
+            }else{
+                leaveScope();
+                domStack.pop();
+            }
+        }
+        // Phi operands from back edges and call parameters are updated after all blocks are visited
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            for(IR::Instrction& instrRef : block->instructions){
+                if(std::holds_alternative<IR::Phi>(instrRef)){
+                    IR::Phi& instr = std::get<IR::Phi>(instrRef);
+                    replace(instr.operand1);
+                    replace(instr.operand2);
                 }
             }
+            std::erase_if(block->instructions, [this](IR::Instrction& instr) -> bool {
+                return removedSet.contains(IR::getInstrIndex(instr));
+            });
         }
-    }
-    if(target->branch){
-        if(target->fallThrough){
-            contextStack.emplace(contextStack.top());
-        }else{
-            contextStack.top().loadMap.clear();
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            for(IR::Instrction instr : block->instructions){
+                IR::forEachOperand(instr, [this](IR::index_t& operand){
+                    removedDests.erase(operand);
+                });
+            }
         }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            std::erase_if(block->instructions, [this](IR::Instrction& instr) -> bool {
+                return removedDests.contains(IR::getInstrIndex(instr));
+            });
+        }
+        std::erase_if(funcPair.second->callLinks, [this](IR::FuncCallLink& link){
+            return removedSet.contains(link.callIndex);
+        });
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            for(std::pair<SymbolId, IR::index_t>& param : link.params){
+                replace(param.second);
+            }
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            IR::relinkBranch(block);
+        }
+        forward.clear();
+        removedSet.clear();
+        removedDests.clear();
+        memoryVersion.clear();
+        exprTable.clear();
+        aliasAnalysis.reset();
+        callMap.clear();
+    }
+    sideEffects.reset();
+}
+
+void CSEPass::visitBlock(const IR::CFG& cfg, size_t blockId){
+    std::shared_ptr<IR::BasicBlock> block = cfg.blocks[blockId];
+    // Memory may be modified on other incoming paths
+    if(cfg.preds[blockId].size() != 1){
+        renewVersion(allMemory);
+    }
+    for(IR::Instrction& instr : block->instructions){
+        std::visit([this, &block](auto& arg){
+            visit(arg, block);
+        }, instr);
     }
 }
 
-void CSEPass::visit(IR::Const& instr, std::shared_ptr<IR::BasicBlock>& block){
-    Context& context = contextStack.top();
-    if(!instr.isImportant && context.constMap.contains(instr.value)){
-        context.forward[instr.index] = context.constMap.at(instr.value);
+bool CSEPass::number(IR::InstrBase& instr, const ExprTable::Key& key){
+    IR::index_t leader = exprTable.find(key);
+    if(!instr.isImportant && leader != ExprTable::none){
+        forward[instr.index] = leader;
         removedSet.insert(instr.index);
-    }else{
-        context.constMap[instr.value] = instr.index;
+        return true;
     }
+    exprTable.insert(key, instr.index);
+    return false;
+}
+
+void CSEPass::visit(IR::Const& instr, std::shared_ptr<IR::BasicBlock>&){
+    number(instr, ExprTable::makeKey(IR::Operation::Const, (uint32_t)instr.value));
 }
 
 void CSEPass::visit(IR::Neg& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand)){
-        instr.operand = context.forward[instr.operand];
-    }
-    if(!instr.isImportant && context.negMap.contains(instr.operand)){
-        context.forward[instr.index] = context.negMap.at(instr.operand);
-        removedSet.insert(instr.index);
-    }else{
-        context.negMap[instr.operand] = instr.index;
-    }
+    replace(instr.operand);
+    number(instr, ExprTable::makeKey(IR::Operation::Neg, instr.operand));
 }
 void CSEPass::visit(IR::Add& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::pair<IR::index_t, IR::index_t> operandPair = std::make_pair(instr.operand1, instr.operand2);
-    if(!instr.isImportant && context.addMap.contains(operandPair)){
-        context.forward[instr.index] = context.addMap.at(operandPair);
-        removedSet.insert(instr.index);
-    }else{
-        context.addMap[operandPair] = instr.index;
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    // Return addresses depend on where pc is read, return values on the latest call
+    if(instr.operand1 == IR::Register::pc || instr.operand2 == IR::Register::pc
+        || instr.operand1 == IR::Register::rval || instr.operand2 == IR::Register::rval
+    ){
+        return;
+    }
+    number(instr, ExprTable::makeKey(IR::Operation::Add, instr.operand1, instr.operand2));
 }
 void CSEPass::visit(IR::Sub& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::pair<IR::index_t, IR::index_t> operandPair = std::make_pair(instr.operand1, instr.operand2);
-    if(!instr.isImportant && context.subMap.contains(operandPair)){
-        context.forward[instr.index] = context.subMap.at(operandPair);
-        removedSet.insert(instr.index);
-    }else{
-        context.subMap[operandPair] = instr.index;
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    number(instr, ExprTable::makeKey(IR::Operation::Sub, instr.operand1, instr.operand2));
 }
 void CSEPass::visit(IR::Mul& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::pair<IR::index_t, IR::index_t> operandPair = std::make_pair(instr.operand1, instr.operand2);
-    if(!instr.isImportant && context.mulMap.contains(operandPair)){
-        context.forward[instr.index] = context.mulMap.at(operandPair);
-        removedSet.insert(instr.index);
-    }else{
-        context.mulMap[operandPair] = instr.index;
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    number(instr, ExprTable::makeKey(IR::Operation::Mul, instr.operand1, instr.operand2));
 }
 void CSEPass::visit(IR::Div& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::pair<IR::index_t, IR::index_t> operandPair = std::make_pair(instr.operand1, instr.operand2);
-    if(!instr.isImportant && context.divMap.contains(operandPair)){
-        context.forward[instr.index] = context.divMap.at(operandPair);
-        removedSet.insert(instr.index);
-    }else{
-        context.divMap[operandPair] = instr.index;
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    number(instr, ExprTable::makeKey(IR::Operation::Div, instr.operand1, instr.operand2));
 }
 void CSEPass::visit(IR::Cmp& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::pair<IR::index_t, IR::index_t> operandPair = std::make_pair(instr.operand1, instr.operand2);
-    if(!instr.isImportant && context.cmpMap.contains(operandPair)){
-        context.forward[instr.index] = context.cmpMap.at(operandPair);
-        removedSet.insert(instr.index);
-    }else{
-        context.cmpMap[operandPair] = instr.index;
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    number(instr, ExprTable::makeKey(IR::Operation::Cmp, instr.operand1, instr.operand2));
 }
 void CSEPass::visit(IR::Adda& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::pair<IR::index_t, IR::index_t> operandPair = std::make_pair(instr.operand1, instr.operand2);
-    if(!instr.isImportant && context.addaMap.contains(operandPair)){
-        context.forward[instr.index] = context.addaMap.at(operandPair);
-        removedSet.insert(instr.index);
-    }else{
-        context.addaMap[operandPair] = instr.index;
-        context.addressMap[instr.index] = instr.operand1;
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    number(instr, ExprTable::makeKey(IR::Operation::Adda, instr.operand1, instr.operand2));
 }
 void CSEPass::visit(IR::Load& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand)){
-        instr.operand = context.forward[instr.operand];
-    }
-    if(!instr.isImportant && context.loadMap.contains(instr.operand)){
-        context.forward[instr.index] = context.loadMap.at(instr.operand);
-        removedSet.insert(instr.index);
-    }else{
-        context.loadMap[instr.operand] = instr.index;
-    }
+    replace(instr.operand);
+    number(instr, ExprTable::makeKey(IR::Operation::Load, instr.operand, versionOf(classOf(instr.operand))));
 }
 void CSEPass::visit(IR::Store& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-    std::unordered_map<IR::index_t, IR::index_t> newLoadMap;
-    for(std::pair<IR::index_t, IR::index_t>&& entry : contextStack.top().loadMap){
-        std::unordered_map<IR::index_t, IR::index_t>& addressMap = contextStack.top().addressMap;
-        if(!addressMap.contains(entry.first) || (addressMap.at(entry.first) != contextStack.top().addressMap.at(instr.operand2))){
-            newLoadMap.emplace(entry);
-        }
+    replace(instr.operand1);
+    replace(instr.operand2);
+    // Stores to array only affect loads from the same array, other stores affect the rest
+    IR::index_t memoryClass = classOf(instr.operand2);
+    if(memoryClass == unknownMemory){
+        renewVersion(allMemory);
+    }else{
+        renewVersion(memoryClass);
+        renewVersion(unknownMemory);
     }
-    contextStack.top().loadMap.swap(newLoadMap);
 }
 void CSEPass::visit(IR::Phi& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
+    replace(instr.operand1);
+    replace(instr.operand2);
 }
 void CSEPass::visit(IR::Bne& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
+    replace(instr.operand1);
 }
 void CSEPass::visit(IR::Beq& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
+    replace(instr.operand1);
 }
 void CSEPass::visit(IR::Ble& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
+    replace(instr.operand1);
 }
 void CSEPass::visit(IR::Blt& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
+    replace(instr.operand1);
 }
 void CSEPass::visit(IR::Bge& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
+    replace(instr.operand1);
 }
 void CSEPass::visit(IR::Bgt& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand1)){
-        instr.operand1 = context.forward[instr.operand1];
-    }
+    replace(instr.operand1);
 }
 void CSEPass::visit(IR::Write& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand)){
-        instr.operand = context.forward[instr.operand];
-    }
-}
-void CSEPass::afterVisit(const std::string&, std::shared_ptr<IR::FuncEntry>&){
-    contextStack = std::stack<CSEPass::Context>();
-    removedSet.clear();
+    replace(instr.operand);
 }
 void CSEPass::visit(IR::StoreReg& instr, std::shared_ptr<IR::BasicBlock>&){
-    Context& context = contextStack.top();
-    if(context.forward.contains(instr.operand2)){
-        instr.operand2 = context.forward[instr.operand2];
-    }
-}
\ No newline at end of file
+    replace(instr.operand2);
+}
+void CSEPass::visit(IR::Bra& instr, std::shared_ptr<IR::BasicBlock>&){
+    if(!callMap.contains(instr.index)){
+        return;
+    }
+    const IR::FuncCallLink& link = *callMap[instr.index].first;
+    std::optional<IR::CallSite>& site = callMap[instr.index].second;
+    const IR::FuncSummary& summary = sideEffects->of(link.funcName);
+    if(summary.writesMemory){
+        renewVersion(allMemory);
+    }
+    if(!summary.isPure() || !link.resultIndex){
+        return;
+    }
+    PureCall call {&link, {}};
+    for(const std::pair<SymbolId, IR::index_t>& param : link.params){
+        IR::index_t argument = param.second;
+        replace(argument);
+        call.arguments.push_back(argument);
+    }
+    std::vector<PureCall>::iterator leader = std::find_if(pureCalls.begin(), pureCalls.end(), [&call](PureCall& other){
+        return other.link->funcName == call.link->funcName && other.arguments == call.arguments;
+    });
+    if(leader == pureCalls.end()){
+        pureCalls.emplace_back(call);
+        return;
+    }
+    // Reuse the result of the dominating call, setup of the frame is not needed
+    if(!site){
+        return;
+    }
+    IR::index_t dest = std::get<IR::StoreReg>(site->block->instructions[site->position - 1]).operand2;
+    site->setup.erase(dest);
+    removedDests.insert(dest);
+    removedSet.insert(site->setup.begin(), site->setup.end());
+    removedSet.insert(*link.resultIndex);
+    forward[*link.resultIndex] = *leader->link->resultIndex;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <CallGraph.hpp>
+
+#include <stack>
+#include <algorithm>
+#include <functional>
+
+IR::CallGraph::CallGraph(const std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    // Sorted names, so that the order doesn't depend on hashing
+    std::set<std::string> names;
+    for(const std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair : funcMap){
+        names.insert(funcPair.first);
+        callees[funcPair.first];
+        callers[funcPair.first];
+    }
+    for(const std::string& name : names){
+        std::set<std::string> calleeSet;
+        for(const IR::FuncCallLink& link : funcMap.at(name)->callLinks){
+            if(funcMap.contains(link.funcName)){
+                calleeSet.insert(link.funcName);
+            }
+        }
+        callees[name].assign(calleeSet.begin(), calleeSet.end());
+        for(const std::string& callee : calleeSet){
+            callers[callee].push_back(name);
+        }
+    }
+
+    // Tarjan's algorithm, components are completed in reverse topological order
+    std::unordered_map<std::string, size_t> number, lowLink;
+    std::stack<std::string> sccStack;
+    std::set<std::string> onStack;
+    size_t counter = 0;
+    std::function<void(const std::string&)> connect = [&](const std::string& name){
+        number[name] = counter;
+        lowLink[name] = counter;
+        counter += 1;
+        sccStack.push(name);
+        onStack.insert(name);
+        for(const std::string& callee : callees[name]){
+            if(!number.contains(callee)){
+                connect(callee);
+                lowLink[name] = std::min(lowLink[name], lowLink[callee]);
+            }else if(onStack.contains(callee)){
+                lowLink[name] = std::min(lowLink[name], number[callee]);
+            }
+        }
+        if(lowLink[name] == number[name]){
+            std::vector<std::string>& scc = sccs.emplace_back();
+            std::string member;
+            do{
+                member = sccStack.top();
+                sccStack.pop();
+                onStack.erase(member);
+                scc.push_back(member);
+                sccOf[member] = sccs.size() - 1;
+            }while(member != name);
+            std::sort(scc.begin(), scc.end());
+        }
+    };
+    for(const std::string& name : names){
+        if(!number.contains(name)){
+            connect(name);
+        }
+    }
+}
+
+std::vector<std::string> IR::CallGraph::bottomUp() const{
+    std::vector<std::string> order;
+    for(const std::vector<std::string>& scc : sccs){
+        order.insert(order.end(), scc.begin(), scc.end());
+    }
+    return order;
+}
+
+bool IR::CallGraph::isRecursive(const std::string& funcName) const{
+    if(sccs[sccOf.at(funcName)].size() > 1){
+        return true;
+    }
+    const std::vector<std::string>& calleeList = callees.at(funcName);
+    return std::binary_search(calleeList.begin(), calleeList.end(), funcName);
+}
+
+std::set<std::string> IR::CallGraph::reachableFrom(const std::string& funcName) const{
+    std::set<std::string> reached {funcName};
+    std::stack<std::string> workStack;
+    workStack.push(funcName);
+    while(!workStack.empty()){
+        std::string name = workStack.top();
+        workStack.pop();
+        for(const std::string& callee : callees.at(name)){
+            if(reached.insert(callee).second){
+                workStack.push(callee);
+            }
+        }
+    }
+    return reached;
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <DCEPass.hpp>
+#include <CallGraph.hpp>
+#include <CFG.hpp>
+
+#include <set>
+#include <stack>
+#include <algorithm>
+
+static bool hasSideEffect(IR::Instrction& instrRef){
+    return std::visit([](auto& instr){
+        switch(instr.operation){
+            case IR::Operation::Const :
+            case IR::Operation::Neg :
+            case IR::Operation::Add :
+            case IR::Operation::Sub :
+            case IR::Operation::Mul :
+            case IR::Operation::Div :
+            case IR::Operation::Cmp :
+            case IR::Operation::Adda :
+            case IR::Operation::Load :
+            case IR::Operation::Phi :
+                return instr.isImportant;
+            default:
+                return true;
+        }
+    }, instrRef);
+}
+
+void DCEPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(funcPair.second->root){
+            eliminate(funcPair.second);
+        }
+    }
+    IR::relinkCalls(funcMap);
+}
+
+void DCEPass::eliminate(const std::shared_ptr<IR::FuncEntry>& entry){
+    IR::CFG cfg(entry);
+    // Mark from instructions with side effect, so that dead cycles through Phi are removed as well
+    std::unordered_map<IR::index_t, IR::Instrction*> instrMap;
+    std::stack<IR::Instrction*> markStack;
+    std::set<IR::index_t> liveSet;
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            instrMap[IR::getInstrIndex(instr)] = &instr;
+            if(hasSideEffect(instr)){
+                liveSet.insert(IR::getInstrIndex(instr));
+                markStack.push(&instr);
+            }
+        }
+    }
+    while(!markStack.empty()){
+        IR::Instrction* instr = markStack.top();
+        markStack.pop();
+        IR::forEachOperand(*instr, [&](IR::index_t& operand){
+            if(instrMap.contains(operand) && !liveSet.contains(operand)){
+                liveSet.insert(operand);
+                markStack.push(instrMap[operand]);
+            }
+        });
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        std::erase_if(block->instructions, [&liveSet](IR::Instrction& instr){
+            return !liveSet.contains(IR::getInstrIndex(instr));
+        });
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        IR::relinkBranch(block);
+    }
+}
@@ -0,0 +1,143 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <DSEPass.hpp>
+#include <CallGraph.hpp>
+
+#include <vector>
+#include <algorithm>
+
+using Location = IR::AliasAnalysis::Location;
+
+void DSEPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    IR::SideEffects sideEffects(funcMap);
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        IR::CFG cfg(funcPair.second);
+        IR::AliasAnalysis aliasAnalysis(funcPair.second);
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            if(sideEffects.of(link.funcName).readsMemory){
+                readingCalls.insert(link.callIndex);
+            }
+        }
+
+        // Backward dataflow from all-dead states, in post-order until nothing changes
+        std::vector<DeadState> entryStates(cfg.blocks.size(), exitState());
+        bool changed = true;
+        while(changed){
+            changed = false;
+            for(size_t blockId = cfg.blocks.size(); blockId-- > 0;){
+                DeadState state = meet(cfg, blockId, entryStates);
+                std::vector<IR::Instrction>& instrs = cfg.blocks[blockId]->instructions;
+                for(std::vector<IR::Instrction>::reverse_iterator it = instrs.rbegin(); it != instrs.rend(); ++it){
+                    transfer(state, *it, aliasAnalysis, nullptr);
+                }
+                if(!(state == entryStates[blockId])){
+                    entryStates[blockId] = std::move(state);
+                    changed = true;
+                }
+            }
+        }
+
+        // Remove dead stores
+        std::set<IR::index_t> removedSet;
+        for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+            DeadState state = meet(cfg, blockId, entryStates);
+            std::vector<IR::Instrction>& instrs = cfg.blocks[blockId]->instructions;
+            for(std::vector<IR::Instrction>::reverse_iterator it = instrs.rbegin(); it != instrs.rend(); ++it){
+                transfer(state, *it, aliasAnalysis, &removedSet);
+            }
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            std::erase_if(block->instructions, [&removedSet](IR::Instrction& instr){
+                return removedSet.contains(IR::getInstrIndex(instr));
+            });
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            IR::relinkBranch(block);
+        }
+        readingCalls.clear();
+    }
+    IR::relinkCalls(funcMap);
+}
+
+DSEPass::DeadState DSEPass::exitState(){
+    // Arrays are local to the frame, nothing reads them after return
+    return DeadState {true, {}, {}};
+}
+
+bool DSEPass::isDead(const DeadState& state, const Location& location){
+    if(location.kind != Location::Kind::Array){
+        return false;
+    }
+    if(state.allArrays && !state.liveArrays.contains(*location.offset)){
+        return true;
+    }
+    return location.element && state.elements.contains({*location.offset, *location.element});
+}
+
+DSEPass::DeadState DSEPass::meet(const IR::CFG& cfg, size_t blockId, const std::vector<DeadState>& entryStates){
+    const std::vector<size_t>& succs = cfg.succs[blockId];
+    if(succs.empty()){
+        return exitState();
+    }
+    DeadState result {true, {}, {}};
+    for(size_t succ : succs){
+        const DeadState& state = entryStates[succ];
+        result.allArrays = result.allArrays && state.allArrays;
+        result.liveArrays.insert(state.liveArrays.begin(), state.liveArrays.end());
+    }
+    if(!result.allArrays){
+        result.liveArrays.clear();
+    }
+    // An element is dead if it's dead in all successors
+    for(size_t succ : succs){
+        for(const std::pair<int32_t, int32_t>& element : entryStates[succ].elements){
+            Location location {Location::Kind::Array, element.first, element.second};
+            if(!isDead(result, location) && std::all_of(succs.begin(), succs.end(), [&](size_t other){
+                return isDead(entryStates[other], location);
+            })){
+                result.elements.insert(element);
+            }
+        }
+    }
+    return result;
+}
+
+void DSEPass::transfer(DeadState& state, IR::Instrction& instrRef, const IR::AliasAnalysis& aliasAnalysis, std::set<IR::index_t>* removedSet){
+    if(std::holds_alternative<IR::Store>(instrRef)){
+        IR::Store& instr = std::get<IR::Store>(instrRef);
+        Location location = aliasAnalysis.locate(instr.operand2);
+        if(isDead(state, location)){
+            if(removedSet){
+                removedSet->insert(instr.index);
+            }
+        }else if(location.kind == Location::Kind::Array && location.element){
+            state.elements.emplace(*location.offset, *location.element);
+        }
+    }else if(std::holds_alternative<IR::Load>(instrRef)){
+        IR::Load& instr = std::get<IR::Load>(instrRef);
+        Location location = aliasAnalysis.locate(instr.operand);
+        if(location.kind == Location::Kind::Unknown){
+            state = DeadState {false, {}, {}};
+        }else if(location.kind == Location::Kind::Array){
+            if(state.allArrays){
+                state.liveArrays.insert(*location.offset);
+            }
+            std::erase_if(state.elements, [&](const std::pair<int32_t, int32_t>& element){
+                return aliasAnalysis.mayAlias(Location {Location::Kind::Array, element.first, element.second}, location);
+            });
+        }
+    }else if(std::holds_alternative<IR::Bra>(instrRef) && std::get<IR::Bra>(instrRef).operand == IR::Register::pc){
+        // Return
+        state = exitState();
+    }else if(readingCalls.contains(IR::getInstrIndex(instrRef))){
+        state = DeadState {false, {}, {}};
+    }
+}
@@ -0,0 +1,20 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <DeadFunctionPass.hpp>
+#include <CallGraph.hpp>
+
+#include <set>
+
+void DeadFunctionPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    if(!funcMap.contains("_main")){
+        return;
+    }
+    std::set<std::string> reachable = IR::CallGraph(funcMap).reachableFrom("_main");
+    std::erase_if(funcMap, [&reachable](const std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair){
+        return !reachable.contains(funcPair.first);
+    });
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <ExprTable.hpp>
+
+#include <cstdint>
+
+static const size_t initialSize = 64;
+
+static size_t hashKey(const ExprTable::Key& key){
+    uint64_t hash = (uint64_t)key.operation;
+    hash = (hash ^ key.operand1) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (hash >> 29) ^ key.operand2) * 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 32);
+}
+
+ExprTable::ExprTable():
+    slots(initialSize), count(0)
+{}
+
+ExprTable::Key ExprTable::makeKey(IR::Operation operation, IR::index_t operand1, IR::index_t operand2){
+    if((operation == IR::Operation::Add || operation == IR::Operation::Mul) && operand1 > operand2){
+        return Key {operation, operand2, operand1};
+    }
+    return Key {operation, operand1, operand2};
+}
+
+size_t ExprTable::locate(const Key& key) const{
+    size_t mask = slots.size() - 1;
+    size_t pos = hashKey(key) & mask;
+    while(slots[pos].value != none && !(slots[pos].key == key)){
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+IR::index_t ExprTable::find(const Key& key) const{
+    return slots[locate(key)].value;
+}
+
+void ExprTable::set(const Key& key, IR::index_t value){
+    size_t pos = locate(key);
+    if(value == none){
+        if(slots[pos].value != none){
+            remove(pos);
+        }
+        return;
+    }
+    if(slots[pos].value == none){
+        // Keep load factor under 1/2
+        if((count + 1) * 2 > slots.size()){
+            std::vector<Slot> oldSlots(slots.size() * 2);
+            oldSlots.swap(slots);
+            for(Slot& slot : oldSlots){
+                if(slot.value != none){
+                    slots[locate(slot.key)] = slot;
+                }
+            }
+            pos = locate(key);
+        }
+        slots[pos].key = key;
+        count += 1;
+    }
+    slots[pos].value = value;
+}
+
+void ExprTable::remove(size_t pos){
+    // Backward shift deletion, so that no tombstone is needed
+    size_t mask = slots.size() - 1;
+    slots[pos].value = none;
+    count -= 1;
+    for(size_t next = (pos + 1) & mask; slots[next].value != none; next = (next + 1) & mask){
+        size_t home = hashKey(slots[next].key) & mask;
+        if(((next - home) & mask) >= ((next - pos) & mask)){
+            slots[pos] = slots[next];
+            slots[next].value = none;
+            pos = next;
+        }
+    }
+}
+
+void ExprTable::insert(const Key& key, IR::index_t value){
+    undoLog.emplace_back(key, find(key));
+    set(key, value);
+}
+
+void ExprTable::erase(const Key& key){
+    IR::index_t old = find(key);
+    if(old != none){
+        undoLog.emplace_back(key, old);
+        set(key, none);
+    }
+}
+
+size_t ExprTable::mark() const{
+    return undoLog.size();
+}
+
+void ExprTable::rollback(size_t mark){
+    while(undoLog.size() > mark){
+        set(undoLog.back().first, undoLog.back().second);
+        undoLog.pop_back();
+    }
+}
+
+void ExprTable::clear(){
+    slots.assign(initialSize, Slot());
+    count = 0;
+    undoLog.clear();
+}
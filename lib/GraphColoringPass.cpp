@@ -0,0 +1,315 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <GraphColoringPass.hpp>
+#include <Exception.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <cmath>
+
+// Also marks values not in the live set
+static const size_t noColor = std::numeric_limits<size_t>::max();
+
+GraphColoringPass::GraphColoringPass(size_t registerCount): RegisterAllocPass(registerCount){}
+
+void GraphColoringPass::allocate(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry){
+    while(true){
+        IR::CFG cfg(entry);
+        IR::Liveness liveness(cfg);
+        build(cfg, liveness);
+        coalesce();
+        std::vector<size_t> spilled = color();
+        if(spilled.empty()){
+            entry->registers.clear();
+            for(std::pair<const IR::index_t, size_t>& nodePair : nodeOf){
+                entry->registers[nodePair.first] = nodes[find(nodePair.second)].color;
+            }
+            break;
+        }
+        for(size_t node : spilled){
+            if(!nodes[node].spillable){
+                throw Exception(std::string("not enough registers for spill code in '") + funcName + "'");
+            }
+        }
+        rewrite(entry, spilled);
+        moveCalleeFrames(entry);
+    }
+}
+
+void GraphColoringPass::build(const IR::CFG& cfg, const IR::Liveness& liveness){
+    nodes.clear();
+    nodeOf.clear();
+    copies.clear();
+    constants.clear();
+    for(size_t id = 0; id < liveness.values.size(); ++id){
+        IR::index_t value = liveness.values[id];
+        nodes.emplace_back(Node {{value}, {}, {}, 0, id, noColor, !unspillable.contains(value)});
+        nodeOf[value] = id;
+    }
+
+    // Const defining its value alone can be computed again
+    std::unordered_map<IR::index_t, size_t> defCount;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            defCount[defOf(instr)] += 1;
+            if(std::holds_alternative<IR::Const>(instr)){
+                constants[std::get<IR::Const>(instr).index] = std::get<IR::Const>(instr).value;
+            }
+        }
+    }
+    std::erase_if(constants, [&defCount](const std::pair<const IR::index_t, int32_t>& constPair){
+        return defCount[constPair.first] > 1;
+    });
+
+    // Value defined interferes with values live after it, except the source of Move
+    IR::LoopInfo loopInfo(cfg);
+    auto addEdge = [this](size_t node1, size_t node2){
+        if(node1 != node2){
+            nodes[node1].adjacent.insert(node2);
+            nodes[node2].adjacent.insert(node1);
+        }
+    };
+    // Live values are kept in a sparse set, so that they are iterated without scanning all values
+    std::vector<size_t> live;
+    std::vector<size_t> livePos(nodes.size(), noColor);
+    auto insert = [&](size_t id){
+        if(livePos[id] == noColor){
+            livePos[id] = live.size();
+            live.push_back(id);
+        }
+    };
+    auto erase = [&](size_t id){
+        if(livePos[id] != noColor){
+            livePos[live.back()] = livePos[id];
+            live[livePos[id]] = live.back();
+            live.pop_back();
+            livePos[id] = noColor;
+        }
+    };
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        size_t depth = loopInfo.depthOf(blockId);
+        double weight = std::pow(10.0, std::min<size_t>(depth, 8));
+        while(!live.empty()){
+            erase(live.back());
+        }
+        for(size_t id : liveness.liveOut[blockId].elements()){
+            insert(id);
+        }
+        std::vector<IR::Instrction>& instrs = cfg.blocks[blockId]->instructions;
+        for(size_t instrId = instrs.size(); instrId-- > 0;){
+            IR::Instrction& instr = instrs[instrId];
+            std::optional<size_t> def = liveness.idOf(defOf(instr));
+            std::optional<size_t> src;
+            if(std::holds_alternative<IR::Move>(instr)){
+                src = liveness.idOf(std::get<IR::Move>(instr).operand2);
+            }
+            if(def){
+                if(src && *src != *def){
+                    copies.emplace_back(Copy {depth, *def, *src});
+                    nodes[*def].moves.push_back(*src);
+                    nodes[*src].moves.push_back(*def);
+                }
+                for(size_t other : live){
+                    if(other != src){
+                        addEdge(*def, other);
+                    }
+                }
+                erase(*def);
+                if(!constants.contains(defOf(instr))){
+                    nodes[*def].cost += weight;
+                }
+            }
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                std::optional<size_t> use = liveness.idOf(operand);
+                if(use){
+                    insert(*use);
+                    nodes[*use].cost += weight;
+                }
+            });
+        }
+    }
+}
+
+size_t GraphColoringPass::find(size_t node){
+    while(nodes[node].alias != node){
+        nodes[node].alias = nodes[nodes[node].alias].alias;
+        node = nodes[node].alias;
+    }
+    return node;
+}
+
+void GraphColoringPass::coalesce(){
+    // Copies in deeper loops are removed first, values of spill code are kept apart
+    std::stable_sort(copies.begin(), copies.end(), [](const Copy& copy1, const Copy& copy2){
+        return copy1.depth > copy2.depth;
+    });
+    for(Copy& copy : copies){
+        size_t node1 = find(copy.dest);
+        size_t node2 = find(copy.src);
+        if(node1 == node2 || nodes[node1].adjacent.contains(node2) || !nodes[node1].spillable || !nodes[node2].spillable){
+            continue;
+        }
+        // Smaller node is merged into the larger one
+        if(nodes[node1].adjacent.size() + nodes[node1].values.size() < nodes[node2].adjacent.size() + nodes[node2].values.size()){
+            std::swap(node1, node2);
+        }
+        Node& merged = nodes[node2];
+        merged.alias = node1;
+        nodes[node1].values.insert(nodes[node1].values.end(), merged.values.begin(), merged.values.end());
+        nodes[node1].cost += merged.cost;
+        for(size_t other : merged.adjacent){
+            nodes[other].adjacent.erase(node2);
+            nodes[other].adjacent.insert(node1);
+            nodes[node1].adjacent.insert(other);
+        }
+        merged.adjacent.clear();
+    }
+}
+
+std::vector<size_t> GraphColoringPass::color(){
+    // Nodes with less neighbors than registers are removed first, otherwise the one of lowest
+    // cost over degree is removed optimistically
+    size_t nodeCount = 0;
+    std::vector<size_t> degree(nodes.size(), 0);
+    std::vector<bool> removed(nodes.size(), false);
+    std::vector<size_t> lowDegree;
+    std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, std::greater<std::pair<double, size_t>>> highDegree;
+    auto spillCost = [this, &degree](size_t node){
+        return nodes[node].spillable ? nodes[node].cost / degree[node] : std::numeric_limits<double>::infinity();
+    };
+    for(size_t node = 0; node < nodes.size(); ++node){
+        if(nodes[node].alias != node){
+            continue;
+        }
+        nodeCount += 1;
+        degree[node] = nodes[node].adjacent.size();
+        if(degree[node] < registerCount){
+            lowDegree.push_back(node);
+        }else{
+            highDegree.emplace(spillCost(node), node);
+        }
+    }
+    std::vector<size_t> stack;
+    while(stack.size() < nodeCount){
+        size_t node;
+        if(!lowDegree.empty()){
+            node = lowDegree.back();
+            lowDegree.pop_back();
+        }else{
+            std::pair<double, size_t> top = highDegree.top();
+            highDegree.pop();
+            node = top.second;
+            if(!removed[node] && degree[node] >= registerCount && top.first != spillCost(node)){
+                // Degree decreased since queued
+                highDegree.emplace(spillCost(node), node);
+                continue;
+            }
+        }
+        if(removed[node]){
+            continue;
+        }
+        removed[node] = true;
+        stack.push_back(node);
+        for(size_t other : nodes[node].adjacent){
+            if(!removed[other] && degree[other]-- == registerCount){
+                lowDegree.push_back(other);
+            }
+        }
+    }
+
+    // Colors are given in reverse order, preferring the color of nodes copied from or to
+    std::vector<size_t> spilled;
+    while(!stack.empty()){
+        size_t nodeId = stack.back();
+        Node& node = nodes[nodeId];
+        stack.pop_back();
+        std::vector<bool> used(registerCount, false);
+        for(size_t other : node.adjacent){
+            if(nodes[other].color != noColor){
+                used[nodes[other].color] = true;
+            }
+        }
+        for(IR::index_t value : node.values){
+            for(size_t other : nodes[nodeOf[value]].moves){
+                size_t partner = nodes[find(other)].color;
+                if(node.color == noColor && partner != noColor && !used[partner]){
+                    node.color = partner;
+                }
+            }
+        }
+        if(node.color == noColor){
+            std::vector<bool>::iterator free = std::find(used.begin(), used.end(), false);
+            if(free == used.end()){
+                spilled.push_back(nodeId);
+                continue;
+            }
+            node.color = free - used.begin();
+        }
+    }
+    return spilled;
+}
+
+void GraphColoringPass::rewrite(const std::shared_ptr<IR::FuncEntry>& entry, const std::vector<size_t>& spilled){
+    // Each spilled node gets a slot, shared by its values
+    std::unordered_map<IR::index_t, int32_t> remats;
+    std::unordered_set<IR::index_t> spilledValues;
+    for(size_t node : spilled){
+        std::vector<IR::index_t>& values = nodes[node].values;
+        if(values.size() == 1 && constants.contains(values[0])){
+            remats[values[0]] = constants[values[0]];
+            continue;
+        }
+        for(IR::index_t value : values){
+            slots[value] = slotCount;
+            spilledValues.insert(value);
+            unspillable.insert(value);
+        }
+        slotCount += 1;
+    }
+
+    // Value is stored after each definition and loaded before each use, Const is computed again instead
+    for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+        std::vector<IR::Instrction> instrs;
+        for(IR::Instrction& instr : block->instructions){
+            if(remats.contains(IR::getInstrIndex(instr))){
+                continue;
+            }
+            // Copy between values of the same slot is done already
+            if(std::holds_alternative<IR::Move>(instr)){
+                IR::Move& move = std::get<IR::Move>(instr);
+                if(spilledValues.contains(move.operand1) && spilledValues.contains(move.operand2) && slots[move.operand1] == slots[move.operand2]){
+                    continue;
+                }
+            }
+            std::unordered_map<IR::index_t, IR::index_t> reloads;
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                if(!reloads.contains(operand)){
+                    if(remats.contains(operand)){
+                        reloads[operand] = IR::getInstrIndex(instrs.emplace_back(IR::Const(remats[operand])));
+                    }else if(spilledValues.contains(operand)){
+                        reloads[operand] = IR::getInstrIndex(instrs.emplace_back(IR::Load(slotAddress(instrs, operand))));
+                    }else{
+                        return;
+                    }
+                    unspillable.insert(reloads[operand]);
+                }
+                operand = reloads[operand];
+            });
+            instrs.emplace_back(instr);
+            IR::index_t def = defOf(instr);
+            if(spilledValues.contains(def)){
+                IR::index_t address = slotAddress(instrs, def);
+                instrs.emplace_back(IR::Store(def, address));
+            }
+        }
+        if(instrs.empty()){
+            instrs.emplace_back(IR::Nop());
+        }
+        block->instructions = instrs;
+    }
+}
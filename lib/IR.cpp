@@ -5,10 +5,14 @@
  */
 
 #include <IR.hpp>
+#include <CallGraph.hpp>
 #include <stack>
 #include <set>
 #include <memory>
 
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
 IR::InstrBase::InstrBase(): isImportant(false){
     static IR::index_t newId = 3;
     index = newId++;
@@ -20,6 +24,39 @@ const IR::index_t IR::getInstrIndex(const IR::Instrction& instr){
     }, instr);
 }
 
+void IR::forEachOperand(IR::Instrction& instrRef, const std::function<void(IR::index_t&)>& func){
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Neg& instr){ func(instr.operand); },
+        [&](IR::Load& instr){ func(instr.operand); },
+        [&](IR::Write& instr){ func(instr.operand); },
+        [&](IR::Add& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Sub& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Mul& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Div& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Cmp& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Adda& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Store& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::Phi& instr){ func(instr.operand1); func(instr.operand2); },
+        [&](IR::StoreReg& instr){ func(instr.operand2); },
+        [&](IR::Move& instr){ func(instr.operand2); },
+        [&](IR::Bne& instr){ func(instr.operand1); },
+        [&](IR::Beq& instr){ func(instr.operand1); },
+        [&](IR::Ble& instr){ func(instr.operand1); },
+        [&](IR::Blt& instr){ func(instr.operand1); },
+        [&](IR::Bge& instr){ func(instr.operand1); },
+        [&](IR::Bgt& instr){ func(instr.operand1); },
+    }, instrRef);
+}
+
+IR::Instrction IR::cloneInstr(const IR::Instrction& instr){
+    IR::Instrction result = instr;
+    std::visit([](auto& real){
+        real.index = IR::InstrBase().index;
+    }, result);
+    return result;
+}
+
 void IR::Pass::beforeAll(){}
 void IR::Pass::afterAll(){}
 void IR::Pass::beforeVisit(const std::string&, std::shared_ptr<IR::FuncEntry>&){}
@@ -39,6 +76,7 @@ void IR::Pass::visit(IR::Adda&, std::shared_ptr<IR::BasicBlock>&){}
 void IR::Pass::visit(IR::Load&, std::shared_ptr<IR::BasicBlock>&){}
 void IR::Pass::visit(IR::Store&, std::shared_ptr<IR::BasicBlock>&){}
 void IR::Pass::visit(IR::Phi&, std::shared_ptr<IR::BasicBlock>&){}
+void IR::Pass::visit(IR::Move&, std::shared_ptr<IR::BasicBlock>&){}
 void IR::Pass::visit(IR::End&, std::shared_ptr<IR::BasicBlock>&){}
 void IR::Pass::visit(IR::Bra&, std::shared_ptr<IR::BasicBlock>&){}
 void IR::Pass::visit(IR::Bne&, std::shared_ptr<IR::BasicBlock>&){}
@@ -53,7 +91,9 @@ void IR::Pass::visit(IR::WriteNL&, std::shared_ptr<IR::BasicBlock>&){}
 
 void IR::Pass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
     beforeAll();
-    for(std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& blockPair : funcMap){
+    // Functions bottom-up, so callees are visited before their callers
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& blockPair = *funcMap.find(funcName);
         beforeVisit(blockPair.first, blockPair.second);
         if(blockPair.second->root){
             std::stack<std::shared_ptr<IR::BasicBlock>> blockStack;
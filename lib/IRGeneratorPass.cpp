@@ -23,12 +23,186 @@ template<typename T, typename... O> T& IRGeneratorPass::emitInstr(O... op){
     return std::get<T>(bbStack.top()->instructions.emplace_back(T(op...)));
 }
 
+std::shared_ptr<IR::BasicBlock> IRGeneratorPass::createBlock(const std::shared_ptr<IR::BasicBlock>& dominator){
+    std::shared_ptr<IR::BasicBlock>& block = funcBlocks.emplace_back(std::make_shared<IR::BasicBlock>());
+    block->dominator = dominator;
+    return block;
+}
+
+IR::index_t IRGeneratorPass::readVariable(SymbolId name, const std::shared_ptr<IR::BasicBlock>& block){
+    std::unordered_map<SymbolId, IR::index_t>& vals = blockVals[block];
+    std::unordered_map<SymbolId, IR::index_t>::iterator valIt = vals.find(name);
+    if(valIt != vals.end()){
+        return resolve(valIt->second);
+    }
+    IR::index_t value;
+    std::vector<std::shared_ptr<IR::BasicBlock>>& blockPreds = preds[block];
+    if(incompletePhis.contains(block)){
+        // Loop header, operands are added when the loop body is done
+        value = addPhi(block);
+        incompletePhis[block][name] = value;
+    }else if(blockPreds.empty()){
+        value = undefinedValue();
+    }else if(blockPreds.size() == 1){
+        value = readVariable(name, blockPreds[0]);
+    }else{
+        // Phi is recorded before its operands are read, so that reading through a loop ends at it
+        value = addPhi(block);
+        vals[name] = value;
+        value = addPhiOperands(name, value);
+    }
+    vals[name] = value;
+    return value;
+}
+
+IR::index_t IRGeneratorPass::addPhi(const std::shared_ptr<IR::BasicBlock>& block){
+    // After Nop as branch target, and the Phi already there
+    std::vector<IR::Instrction>::iterator pos = std::find_if(block->instructions.begin(), block->instructions.end(), [](IR::Instrction& instr){
+        return !std::holds_alternative<IR::Nop>(instr) && !std::holds_alternative<IR::Phi>(instr);
+    });
+    IR::index_t phi = IR::getInstrIndex(*block->instructions.insert(pos, IR::Phi(0, 0)));
+    phiBlocks[phi] = block;
+    return phi;
+}
+
+IR::index_t IRGeneratorPass::addPhiOperands(SymbolId name, IR::index_t phi){
+    std::vector<IR::index_t> operands;
+    for(std::shared_ptr<IR::BasicBlock>& pred : preds[phiBlocks[phi]]){
+        operands.emplace_back(readVariable(name, pred));
+    }
+    IR::Phi& instr = getPhi(phi);
+    instr.operand1 = operands[0];
+    instr.operand2 = operands[1];
+    for(IR::index_t operand : operands){
+        if(phiBlocks.contains(operand)){
+            phiUsers[operand].emplace_back(phi);
+        }
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+IR::index_t IRGeneratorPass::tryRemoveTrivialPhi(IR::index_t phi){
+    // Phi merging a single value other than itself is that value
+    IR::Phi& instr = getPhi(phi);
+    IR::index_t same = phi;
+    for(IR::index_t operand : {resolve(instr.operand1), resolve(instr.operand2)}){
+        if(operand == same || operand == phi){
+            continue;
+        }
+        if(same != phi){
+            return phi;
+        }
+        same = operand;
+    }
+    if(same == phi){
+        return phi;
+    }
+    std::shared_ptr<IR::BasicBlock> block = phiBlocks[phi];
+    std::erase_if(block->instructions, [phi](IR::Instrction& instr){
+        return IR::getInstrIndex(instr) == phi;
+    });
+    phiBlocks.erase(phi);
+    replacedPhis[phi] = same;
+
+    // Phi using it may become trivial as well
+    std::vector<IR::index_t> users;
+    users.swap(phiUsers[phi]);
+    phiUsers.erase(phi);
+    for(IR::index_t user : users){
+        if(!phiBlocks.contains(user)){
+            continue;
+        }
+        IR::Phi& userInstr = getPhi(user);
+        userInstr.operand1 = resolve(userInstr.operand1);
+        userInstr.operand2 = resolve(userInstr.operand2);
+        if(phiBlocks.contains(same)){
+            phiUsers[same].emplace_back(user);
+        }
+        if(!isIncomplete(user)){
+            tryRemoveTrivialPhi(user);
+        }
+    }
+    return same;
+}
+
+IR::Phi& IRGeneratorPass::getPhi(IR::index_t phi){
+    return std::get<IR::Phi>(*std::find_if(phiBlocks[phi]->instructions.begin(), phiBlocks[phi]->instructions.end(), [phi](IR::Instrction& instr){
+        return IR::getInstrIndex(instr) == phi;
+    }));
+}
+
+bool IRGeneratorPass::isIncomplete(IR::index_t phi){
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::unordered_map<SymbolId, IR::index_t>>::iterator phiIt = incompletePhis.find(phiBlocks[phi]);
+    return phiIt != incompletePhis.end() && std::any_of(phiIt->second.begin(), phiIt->second.end(), [phi](std::pair<const SymbolId, IR::index_t>& incomplete){
+        return incomplete.second == phi;
+    });
+}
+
+IR::index_t IRGeneratorPass::resolve(IR::index_t value){
+    std::unordered_map<IR::index_t, IR::index_t>::iterator replaceIt = replacedPhis.find(value);
+    while(replaceIt != replacedPhis.end()){
+        value = replaceIt->second;
+        replaceIt = replacedPhis.find(value);
+    }
+    return value;
+}
+
+void IRGeneratorPass::sealBlock(const std::shared_ptr<IR::BasicBlock>& block){
+    size_t replaced = replacedPhis.size();
+    std::unordered_map<SymbolId, IR::index_t>& phis = incompletePhis[block];
+    while(!phis.empty()){
+        std::pair<SymbolId, IR::index_t> incomplete = *phis.begin();
+        phis.erase(phis.begin());
+        addPhiOperands(incomplete.first, incomplete.second);
+    }
+    incompletePhis.erase(block);
+    // Phi read in the loop and then found trivial are replaced in blocks of the loop, which are created after its header
+    if(replacedPhis.size() != replaced){
+        for(std::vector<std::shared_ptr<IR::BasicBlock>>::iterator blockIt = std::find(funcBlocks.begin(), funcBlocks.end(), block); blockIt != funcBlocks.end(); ++blockIt){
+            for(IR::Instrction& instr : (*blockIt)->instructions){
+                IR::forEachOperand(instr, [this](IR::index_t& operand){
+                    operand = resolve(operand);
+                });
+            }
+        }
+        for(IR::FuncCallLink& link : curEntry->callLinks){
+            for(std::pair<SymbolId, IR::index_t>& param : link.params){
+                param.second = resolve(param.second);
+            }
+        }
+    }
+}
+
+IR::index_t IRGeneratorPass::undefinedValue(){
+    // Zero computed in root, before its branch if it is already done
+    std::shared_ptr<IR::BasicBlock>& root = curEntry->root;
+    std::vector<IR::Instrction>::iterator pos = root->instructions.end();
+    if(root->branch){
+        pos = std::prev(pos);
+    }
+    IR::index_t value = IR::getInstrIndex(*root->instructions.insert(pos, IR::Const((int32_t) 0)));
+    undefinedValues.insert(value);
+    return value;
+}
+
+std::optional<IR::index_t> IRGeneratorPass::findValue(SymbolId name){
+    // Parameters and array addresses never change, so the value is shared by blocks it dominates
+    for(std::shared_ptr<IR::BasicBlock> block = bbStack.top(); block; block = block->dominator){
+        std::unordered_map<SymbolId, IR::index_t>& vals = blockVals[block];
+        std::unordered_map<SymbolId, IR::index_t>::iterator valIt = vals.find(name);
+        if(valIt != vals.end()){
+            return valIt->second;
+        }
+    }
+    return std::nullopt;
+}
+
 void IRGeneratorPass::afterParse(Parser::VarDecl& target){
     if(target.isSuccess){
         for(Parser::Ident& ident : target.identifiers){
-            std::unordered_map<std::string, IR::TypeData>& varMap = curEntry->variables;
-            if(varMap.contains(ident.value) || curEntry->paramAddrMap.contains(ident.value)){
-                Logger::put(LogLevel::Error, std::string("redifinition of '") + ident.value + "'");
+            std::unordered_map<SymbolId, IR::TypeData>& varMap = curEntry->variables;
+            if(varMap.contains(ident.symbol) || curEntry->paramAddrMap.contains(ident.symbol)){
+                Logger::put(LogLevel::Error, std::string("redifinition of '") + Symbol::name(ident.symbol) + "'");
             }else{
                 IR::TypeData newVar;
                 if(target.typeDecl.declType == Parser::TypeDecl::Type::Variable){
@@ -39,7 +213,7 @@ void IRGeneratorPass::afterParse(Parser::VarDecl& target){
                     IR::address_t arrSize = INT_SIZE;
                     for(Parser::Number& size: target.typeDecl.arraySizes){
                         if(size.value <= 0){
-                            Logger::put(LogLevel::Error, std::string("invalid array size of '") + ident.value + "'");
+                            Logger::put(LogLevel::Error, std::string("invalid array size of '") + Symbol::name(ident.symbol) + "'");
                         }else{
                             newVar.shape.push_back(size.value);
                             arrSize *= size.value;
@@ -47,8 +221,9 @@ void IRGeneratorPass::afterParse(Parser::VarDecl& target){
                     }
                     newVar.address = stackTop;
                     stackTop += arrSize;
+                    curEntry->frameSize = stackTop;
                 }
-                varMap.insert({ident.value, newVar});
+                varMap.insert({ident.symbol, newVar});
             }
         }
     }
@@ -56,24 +231,20 @@ void IRGeneratorPass::afterParse(Parser::VarDecl& target){
 
 void IRGeneratorPass::beforeParse(Parser::StatSequence&){
     if(bbStack.empty()){
-        curEntry->root = bbStack.emplace(std::make_shared<IR::BasicBlock>());
+        curEntry->root = bbStack.emplace(createBlock(nullptr));
     }else{
-        bbStack.emplace(std::make_shared<IR::BasicBlock>());
-    }
-    if(varStack.empty()){
-        varStack.emplace();
-    }else{
-        varStack.emplace(varStack.top());
+        // Body of if or while statement, entered from the block of its relation
+        std::shared_ptr<IR::BasicBlock>& block = bbStack.emplace(createBlock(condStack.top()));
+        preds[block].emplace_back(condStack.top());
     }
+    entryStack.push(bbStack.top());
 }
 
 void IRGeneratorPass::afterParse(Parser::StatSequence& target){
-    if(target.isSuccess){
-        bbStack.top()->variableVal.swap(varStack.top());
-    }else{
+    if(!target.isSuccess){
         bbStack.pop();
+        entryStack.pop();
     }
-    varStack.pop();
 }
 
 void IRGeneratorPass::afterParse(Parser::Factor& target){
@@ -84,23 +255,19 @@ void IRGeneratorPass::afterParse(Parser::Factor& target){
                 exprStack.push(emitInstr<IR::Const>((int32_t) num.value).index);
             },
             [&](Parser::Designator& des){
-                std::string& identName = des.identifier.value;
+                SymbolId identName = des.identifier.symbol;
                 usedVar.insert(identName);
-                std::unordered_map<std::string, IR::TypeData>& varMap = curEntry->variables;
+                std::unordered_map<SymbolId, IR::TypeData>& varMap = curEntry->variables;
                 if(varMap.contains(identName)){
                     IR::TypeData varType = varMap[identName];
                     if(varType.type == IR::TypeData::Type::Var){
                         // Variable
-                        std::unordered_map<std::string, IR::index_t>::iterator valIt = varStack.top().find(identName);
-                        if(valIt == varStack.top().end()){
+                        IR::index_t value = readVariable(identName, bbStack.top());
+                        if(undefinedValues.contains(value)){
                             // Uninitialized
-                            Logger::put(LogLevel::Warning, std::string("uninitialized variable '") + identName + "'");
-                            IR::Const& instr = emitInstr<IR::Const>((int32_t) 0);
-                            exprStack.push(instr.index);
-                            varStack.top().emplace(identName, instr.index);
-                        }else{
-                            exprStack.push(valIt->second);
+                            Logger::put(LogLevel::Warning, std::string("uninitialized variable '") + Symbol::name(identName) + "'");
                         }
+                        exprStack.push(value);
                     }else{
                         // Array
                         IR::index_t address = exprStack.top();
@@ -109,15 +276,13 @@ void IRGeneratorPass::afterParse(Parser::Factor& target){
                         exprStack.push(loadIdx);
                     }
                 }else if(curEntry->paramAddrMap.contains(identName)){
-                    std::unordered_map<std::string, IR::index_t>::iterator valIt = varStack.top().find(identName);
-                    if(valIt == varStack.top().end()){
+                    std::optional<IR::index_t> value = findValue(identName);
+                    if(!value){
                         IR::Add& address = emitInstr<IR::Add>(IR::Register::fp, emitInstr<IR::Const>((int32_t) curEntry->paramAddrMap[identName]).index);
-                        IR::index_t loadIdx = emitInstr<IR::Load>(address.index).index;
-                        exprStack.push(loadIdx);
-                        varStack.top().emplace(identName, loadIdx);
-                    }else{
-                        exprStack.push(valIt->second);
+                        value = emitInstr<IR::Load>(address.index).index;
+                        blockVals[bbStack.top()][identName] = *value;
                     }
+                    exprStack.push(*value);
                 }
             },
         }, target.value);
@@ -128,14 +293,14 @@ void IRGeneratorPass::afterParse(Parser::Assignment& target){
     if(target.isSuccess){
         IR::index_t result = exprStack.top();
         exprStack.pop();
-        std::string& identName = target.designator.identifier.value;
-        std::unordered_map<std::string, IR::TypeData>& varMap = curEntry->variables;
+        SymbolId identName = target.designator.identifier.symbol;
+        std::unordered_map<SymbolId, IR::TypeData>& varMap = curEntry->variables;
         if(varMap.find(identName) == varMap.end()){
-            Logger::put(LogLevel::Error, std::string("undeclared identifier '") + identName + "'");
+            Logger::put(LogLevel::Error, std::string("undeclared identifier '") + Symbol::name(identName) + "'");
         }else{
             if(varMap.at(identName).type == IR::TypeData::Type::Var){
                 // Variable
-                varStack.top()[identName] = result;
+                blockVals[bbStack.top()][identName] = result;
             }else{
                 // Array
                 IR::index_t address = exprStack.top();
@@ -200,34 +365,43 @@ void IRGeneratorPass::beforeParse(Parser::Computation&){
     stackTop = INT_SIZE * 2;
     funcMap.emplace("_main", std::make_shared<IR::FuncEntry>());
     curEntry = funcMap["_main"];
+    curEntry->frameSize = stackTop;
+}
+
+void IRGeneratorPass::beforeParse(Parser::IfStatement&){
+    condStack.push(bbStack.top());
 }
 
 void IRGeneratorPass::afterParse(Parser::IfStatement& target){
     if(target.isSuccess){
         // Blocks
         if(!target.elseStat.has_value()){
-            bbStack.emplace(std::make_shared<IR::BasicBlock>());
-            bbStack.top()->variableVal = varStack.top();
+            std::shared_ptr<IR::BasicBlock>& elseBlock = bbStack.emplace(createBlock(condStack.top()));
+            preds[elseBlock].emplace_back(condStack.top());
         }
         
         std::shared_ptr<IR::BasicBlock> elseBlock = bbStack.top();
+        std::shared_ptr<IR::BasicBlock> elseEntry = elseBlock;
+        if(target.elseStat.has_value()){
+            elseEntry = entryStack.top();
+            entryStack.pop();
+        }
         bbStack.pop();
         
         std::shared_ptr<IR::BasicBlock> thenBlock = bbStack.top();
-        if(thenBlock->instructions.empty()){
-            emitInstr<IR::Nop>();
+        std::shared_ptr<IR::BasicBlock> thenEntry = entryStack.top();
+        entryStack.pop();
+        if(thenEntry->instructions.empty()){
+            thenEntry->instructions.emplace_back(IR::Nop());
         }
         bbStack.pop();
         
         std::shared_ptr<IR::BasicBlock> previous = bbStack.top();
-        previous->variableVal.swap(varStack.top());
-        previous->fallThrough = elseBlock;
-        previous->branch = thenBlock;
-        thenBlock->dominator = previous;
-        elseBlock->dominator = previous;
+        previous->fallThrough = elseEntry;
+        previous->branch = thenEntry;
 
         // Branch instruction
-        IR::index_t brachTo = IR::getInstrIndex(thenBlock->instructions.front());
+        IR::index_t brachTo = IR::getInstrIndex(thenEntry->instructions.front());
         IR::index_t cmpOperand = exprStack.top();
         exprStack.pop();
         switch (target.relation.opType){
@@ -252,35 +426,15 @@ void IRGeneratorPass::afterParse(Parser::IfStatement& target){
         }
         bbStack.pop();
         
-        // Next block
-        std::shared_ptr<IR::BasicBlock>& nextBlock = bbStack.emplace(std::make_shared<IR::BasicBlock>());
-        
+        // Next block, Phi are added when variables are read from it
+        std::shared_ptr<IR::BasicBlock>& nextBlock = bbStack.emplace(createBlock(previous));
+        preds[nextBlock] = {thenBlock, elseBlock};
+
         elseBlock->instructions.emplace_back(IR::Bra(emitInstr<IR::Nop>().index));
         elseBlock->branch = nextBlock;
         thenBlock->fallThrough = nextBlock;
-        nextBlock->dominator = previous;
-        
-        // Phi functions
-        for(std::pair<std::string, IR::TypeData>&& variable: curEntry->variables){
-            if(variable.second.type == IR::TypeData::Type::Var){
-                if(thenBlock->variableVal.contains(variable.first)){
-                    if(elseBlock->variableVal.contains(variable.first)){
-                        if(thenBlock->variableVal[variable.first] != elseBlock->variableVal[variable.first]){
-                            varStack.top()[variable.first] = emitInstr<IR::Phi>(thenBlock->variableVal[variable.first], elseBlock->variableVal[variable.first]).index;
-                        }else{
-                            varStack.top()[variable.first] = thenBlock->variableVal[variable.first];
-                        }
-                    }else{
-                        varStack.top()[variable.first] = emitInstr<IR::Phi>(thenBlock->variableVal[variable.first], emitInstr<IR::Nop>().index).index;
-                    }
-                }else{
-                    if(elseBlock->variableVal.contains(variable.first)){
-                        varStack.top()[variable.first] = emitInstr<IR::Phi>(emitInstr<IR::Nop>().index, elseBlock->variableVal[variable.first]).index;
-                    }
-                }
-            }
-        }
     }
+    condStack.pop();
 }
 
 void IRGeneratorPass::afterParse(Parser::Relation& target){
@@ -295,11 +449,12 @@ void IRGeneratorPass::afterParse(Parser::Relation& target){
 }
 
 void IRGeneratorPass::beforeParse(Parser::WhileStatement&){
-    if(!varStack.empty()){
-        bbStack.top()->variableVal = varStack.top();
-    }
-    // Block for compare
-    whileStack.emplace(bbStack.emplace(std::make_shared<IR::BasicBlock>()));
+    // Block for compare, not sealed until the back edge from loop body is known
+    std::shared_ptr<IR::BasicBlock> cmpBlock = createBlock(bbStack.top());
+    preds[cmpBlock].emplace_back(bbStack.top());
+    incompletePhis[cmpBlock];
+    whileStack.emplace(bbStack.emplace(cmpBlock));
+    condStack.push(cmpBlock);
 }
 
 void IRGeneratorPass::afterParse(Parser::WhileStatement& target){
@@ -309,71 +464,53 @@ void IRGeneratorPass::afterParse(Parser::WhileStatement& target){
         std::shared_ptr<IR::BasicBlock> cmpBlock = whileStack.top();
         whileStack.pop();
         while(bbStack.top() != cmpBlock){
-            cmpBlock->fallThrough = bbStack.top();
             bbStack.pop();
         }
+        cmpBlock->fallThrough = entryStack.top();
+        entryStack.pop();
         odBlock->fallThrough = cmpBlock;
-        cmpBlock->fallThrough->dominator = cmpBlock;
+        preds[cmpBlock].emplace_back(odBlock);
+        sealBlock(cmpBlock);
 
-        std::shared_ptr<IR::BasicBlock> nextBlock = std::make_shared<IR::BasicBlock>();
+        std::shared_ptr<IR::BasicBlock> nextBlock = createBlock(cmpBlock);
+        preds[nextBlock].emplace_back(cmpBlock);
         IR::index_t nextInstr = IR::getInstrIndex(nextBlock->instructions.emplace_back(IR::Nop()));
         cmpBlock->branch = nextBlock;
-        nextBlock->dominator = cmpBlock;
 
-        // Branch instruction
+        // Branch instruction, leave the loop when relation fails
         IR::index_t cmpOperand = exprStack.top();
         exprStack.pop();
         switch (target.relation.opType){
             case Parser::RelOp::Type::Equal :
-                emitInstr<IR::Beq>(cmpOperand, nextInstr);
+                emitInstr<IR::Bne>(cmpOperand, nextInstr);
                 break;
             case Parser::RelOp::Type::NonEqual :
-                emitInstr<IR::Bne>(cmpOperand, nextInstr);
+                emitInstr<IR::Beq>(cmpOperand, nextInstr);
                 break;
             case Parser::RelOp::Type::GreaterEqual :
-                emitInstr<IR::Bge>(cmpOperand, nextInstr);
+                emitInstr<IR::Blt>(cmpOperand, nextInstr);
                 break;
             case Parser::RelOp::Type::GreaterThan :
-                emitInstr<IR::Bgt>(cmpOperand, nextInstr);
+                emitInstr<IR::Ble>(cmpOperand, nextInstr);
                 break;
             case Parser::RelOp::Type::LessEqual :
-                emitInstr<IR::Ble>(cmpOperand, nextInstr);
+                emitInstr<IR::Bgt>(cmpOperand, nextInstr);
                 break;
             case Parser::RelOp::Type::LessThan :
-                emitInstr<IR::Blt>(cmpOperand, nextInstr);
+                emitInstr<IR::Bge>(cmpOperand, nextInstr);
                 break;
         }
         bbStack.pop();
 
-        std::shared_ptr<IR::BasicBlock> previous = bbStack.top();
-        previous->fallThrough = cmpBlock;
-        cmpBlock->dominator = previous;
-
-        // Phi functions
-        std::vector<IR::Instrction> phis;
-        for(std::pair<std::string, IR::index_t>&& variable: odBlock->variableVal){
-            if(curEntry->variables[variable.first].type == IR::TypeData::Type::Var){
-                if(previous->variableVal.contains(variable.first)){
-                    if(previous->variableVal.at(variable.first) != variable.second){
-                        IR::index_t origin = previous->variableVal.at(variable.first);
-                        IR::index_t phiIndex = IR::getInstrIndex(phis.emplace_back(IR::Phi(origin, variable.second)));
-                        cmpBlock->relocateMap[origin] = phiIndex;
-                        varStack.top()[variable.first] = phiIndex;
-                    }else{
-                        varStack.top()[variable.first] = variable.second;
-                    }
-                }else{
-                    varStack.top()[variable.first] = variable.second;
-                }
-            }
-        }
-        cmpBlock->instructions.insert(cmpBlock->instructions.begin(), phis.begin(), phis.end());
-        cmpBlock->variableVal = varStack.top();
+        // Block before loop is done, the enclosing statement continues from the next block
+        bbStack.top()->fallThrough = cmpBlock;
+        bbStack.pop();
         bbStack.push(nextBlock);
     }else{
         bbStack.pop();
         whileStack.pop();
     }
+    condStack.pop();
 }
 
 void IRGeneratorPass::afterParse(Parser::Computation& target){
@@ -381,7 +518,7 @@ void IRGeneratorPass::afterParse(Parser::Computation& target){
         emitInstr<IR::End>();
         for(auto&& varPair : curEntry->variables){
             if(!usedVar.contains(varPair.first)){
-                Logger::put(LogLevel::Warning, std::string("unused variable '") + varPair.first + "'");
+                Logger::put(LogLevel::Warning, std::string("unused variable '") + Symbol::name(varPair.first) + "'");
             }
         }
     }else{
@@ -393,18 +530,18 @@ void IRGeneratorPass::afterParse(Parser::Computation& target){
 
 void IRGeneratorPass::afterParse(Parser::Designator& target){
     if(target.isSuccess){
-        std::string& identName = target.identifier.value;
-        std::unordered_map<std::string, IR::TypeData>& varMap = curEntry->variables;
+        SymbolId identName = target.identifier.symbol;
+        std::unordered_map<SymbolId, IR::TypeData>& varMap = curEntry->variables;
         if(varMap.contains(identName)){
             IR::TypeData& varType = varMap.at(identName);         
             if(varType.type == IR::TypeData::Type::Array){
-                std::unordered_map<std::string, IR::index_t>::iterator valIt = varStack.top().find(identName);
+                std::optional<IR::index_t> value = findValue(identName);
                 IR::index_t address;
-                if(valIt == varStack.top().end()){
+                if(!value){
                     address = emitInstr<IR::Add>(IR::Register::fp, emitInstr<IR::Const>(*(varType.address)).index).index;
-                    varStack.top()[identName] = address;
+                    blockVals[bbStack.top()][identName] = address;
                 }else{
-                    address = varStack.top().at(identName);
+                    address = *value;
                 }
                 IR::index_t offset;
                 int32_t accSize = INT_SIZE;
@@ -423,14 +560,16 @@ void IRGeneratorPass::afterParse(Parser::Designator& target){
                 exprStack.push(emitInstr<IR::Adda>(address, offset).index);
             }
         }else if(!curEntry->paramAddrMap.contains(identName)){
-            Logger::put(LogLevel::Error, std::string("undeclared identifier '") + identName + "'");
+            Logger::put(LogLevel::Error, std::string("undeclared identifier '") + Symbol::name(identName) + "'");
         }
     }
 }
 
 void IRGeneratorPass::beforeParse(Parser::FuncDecl& target){
+    mainStackTop = stackTop;
     stackTop = INT_SIZE * 2;
     curEntry = std::make_shared<IR::FuncEntry>();
+    curEntry->frameSize = stackTop;
     curDecl = &target;
 }
 
@@ -438,52 +577,63 @@ void IRGeneratorPass::afterParse(Parser::FuncDecl& target){
     if(target.isSuccess){
         for(auto&& varPair : curEntry->variables){
             if(!usedVar.contains(varPair.first)){
-                Logger::put(LogLevel::Warning, std::string("unused variable '") + varPair.first + "'");
+                Logger::put(LogLevel::Warning, std::string("unused variable '") + Symbol::name(varPair.first) + "'");
             }
         }
         for(auto&& varPair : curEntry->paramAddrMap){
             if(!usedVar.contains(varPair.first)){
-                Logger::put(LogLevel::Warning, std::string("unused parameter '") + varPair.first + "'");
+                Logger::put(LogLevel::Warning, std::string("unused parameter '") + Symbol::name(varPair.first) + "'");
             }
         }
-        if(!bbStack.empty()){
-            bbStack.pop();
-        }
     }
     curEntry = funcMap["_main"];
     curDecl = nullptr;
+    stackTop = mainStackTop;
     usedVar.clear();
+    bbStack = std::stack<std::shared_ptr<IR::BasicBlock>>();
+    entryStack = std::stack<std::shared_ptr<IR::BasicBlock>>();
+    funcBlocks.clear();
+    blockVals.clear();
+    preds.clear();
+    incompletePhis.clear();
+    phiBlocks.clear();
+    phiUsers.clear();
+    replacedPhis.clear();
+    undefinedValues.clear();
 }
 
 void IRGeneratorPass::beforeParse(Parser::FuncBody&){
     if(curDecl != nullptr){
-        if(curDecl->identifier.value == "InputNum" || curDecl->identifier.value == "OutputNum" || curDecl->identifier.value == "OutputNewLine"){
-            Logger::put(LogLevel::Error, curDecl->identifier.value + " is reserved function");
+        const std::string& funcName = Symbol::name(curDecl->identifier.symbol);
+        if(funcName == "InputNum" || funcName == "OutputNum" || funcName == "OutputNewLine"){
+            Logger::put(LogLevel::Error, funcName + " is reserved function");
             return;
         }
-        funcMap.emplace(curDecl->identifier.value, curEntry);
+        curEntry->isVoid = curDecl->isVoid;
+        funcMap.emplace(funcName, curEntry);
     }
 }
 
 void IRGeneratorPass::afterParse(Parser::FuncBody& target){
     if(!target.isSuccess){
-        funcMap.erase(curDecl->identifier.value);
+        funcMap.erase(Symbol::name(curDecl->identifier.symbol));
     }
 }
 
 void IRGeneratorPass::afterParse(Parser::FormalParam& target){
     if(target.isSuccess){
-        for(Parser::Ident identifier : target.identifiers){
-            curEntry->paramAddrMap.emplace(identifier.value, stackTop);
-            curEntry->paramNames.push_back(identifier.value);
+        for(Parser::Ident& identifier : target.identifiers){
+            curEntry->paramAddrMap.emplace(identifier.symbol, stackTop);
+            curEntry->paramNames.push_back(identifier.symbol);
             stackTop += INT_SIZE;
+            curEntry->frameSize = stackTop;
         }
     }
 }
 
 void IRGeneratorPass::afterParse(Parser::FuncCall& target){
     if(target.isSuccess){
-        std::string& funcName = target.identifier.value;
+        const std::string& funcName = Symbol::name(target.identifier.symbol);
         if(funcName == "InputNum"){
             exprStack.push(emitInstr<IR::Read>().index);
         }else if(funcName == "OutputNum"){
@@ -501,36 +651,41 @@ void IRGeneratorPass::afterParse(Parser::FuncCall& target){
             }
             // Create call link
             IR::FuncCallLink& link = curEntry->callLinks.emplace_back();
-            link.funcName = target.identifier.value;
+            link.funcName = funcName;
             link.block = bbStack.top();
             // Get destination
-            IR::Add& dest = emitInstr<IR::Add>(IR::Register::fp, emitInstr<IR::Const>((int32_t)stackTop).index);
-            dest.isImportant = true;
+            IR::Add& destInstr = emitInstr<IR::Add>(IR::Register::fp, emitInstr<IR::Const>((int32_t)stackTop).index);
+            destInstr.isImportant = true;
+            IR::index_t dest = destInstr.index;
             // Store fp & return address
-            emitInstr<IR::Store>(emitInstr<IR::Add>(IR::Register::pc, emitInstr<IR::Const>((int32_t)INT_SIZE).index).index, dest.index);
+            emitInstr<IR::Store>(emitInstr<IR::Add>(IR::Register::pc, emitInstr<IR::Const>((int32_t)INT_SIZE).index).index, dest);
             emitInstr<IR::Store>(IR::Register::fp,
-                emitInstr<IR::Add>(dest.index, emitInstr<IR::Const>((int32_t)INT_SIZE).index).index
+                emitInstr<IR::Add>(dest, emitInstr<IR::Const>((int32_t)INT_SIZE).index).index
             );
-            // Store parameters
-            for(size_t i = 0; i < entry->paramAddrMap.size(); ++i){
+            // Store parameters, the last argument is on the top of exprStack
+            link.params.resize(entry->paramNames.size());
+            for(size_t i = entry->paramNames.size(); i-- > 0;){
                 if(exprStack.empty()){
                     Logger::put(LogLevel::Error, std::string("missing expression of parameters for calling function '") + funcName + "'");
                     return;
                 }
-                IR::Add& address = emitInstr<IR::Add>(dest.index,
+                IR::Add& address = emitInstr<IR::Add>(dest,
                     emitInstr<IR::Const>(entry->paramAddrMap.at(entry->paramNames[i])).index
                 );
                 emitInstr<IR::Store>(exprStack.top(), address.index);
-                link.params.emplace_back(entry->paramNames[i], exprStack.top());
+                link.params[i] = {entry->paramNames[i], exprStack.top()};
                 exprStack.pop();
             }
             // Move frame pointer
-            emitInstr<IR::StoreReg>(IR::Register::fp, dest.index);
+            emitInstr<IR::StoreReg>(IR::Register::fp, dest);
             // Branch to function
             link.callIndex = emitInstr<IR::Bra>(IR::getInstrIndex(entry->root->instructions.front())).index;
-            // Get return value after calling function
+            // Get return value after calling function, copied out of rval before the next call overwrites it
             if(!entry->isVoid){
-                exprStack.push(IR::Register::rval);
+                IR::Add& result = emitInstr<IR::Add>(IR::Register::rval, emitInstr<IR::Const>((int32_t)0).index);
+                result.isImportant = true;
+                link.resultIndex = result.index;
+                exprStack.push(result.index);
             }
         }
     }
@@ -60,8 +60,8 @@ void IRVisualizerPass::afterVisit(const std::string& funcName, std::shared_ptr<I
     for(IR::FuncCallLink& link : entry->callLinks){
         fileOut << "__link" << linkSerial
             << "[shape=note,label=< call " << link.funcName;
-        for(std::pair<std::string, IR::index_t>& param : link.params){
-            fileOut << "<br/>" << param.first << ": " << formatOperand(param.second);
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            fileOut << "<br/>" << Symbol::name(param.first) << ": " << formatOperand(param.second);
         }
         fileOut << " >];" << std::endl;
         fileOut << bbNames[link.block] << ":i" << link.callIndex
@@ -196,6 +196,12 @@ void IRVisualizerPass::visit(IR::Phi& target, std::shared_ptr<IR::BasicBlock>& b
         fileOut, target.index, block
     );
 }
+void IRVisualizerPass::visit(IR::Move& target, std::shared_ptr<IR::BasicBlock>& block){
+    outputInstr(
+        std::string("move ") + formatOperand(target.operand1) + " " + formatOperand(target.operand2),
+        fileOut, target.index, block
+    );
+}
 void IRVisualizerPass::visit(IR::End& target, std::shared_ptr<IR::BasicBlock>& block){
     outputInstr("end", fileOut, target.index, block);
 }
@@ -0,0 +1,307 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <InlinePass.hpp>
+#include <CallGraph.hpp>
+
+#include <set>
+#include <functional>
+#include <algorithm>
+
+const size_t InlinePass::defaultSizeLimit = 40;
+
+InlinePass::InlinePass(size_t sizeLimit): sizeLimit(sizeLimit){}
+
+void InlinePass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    // Callees before callers, so that calls in callee are inlined before it's copied.
+    // Recursive functions are never inlined
+    IR::CallGraph callGraph(funcMap);
+    for(const std::string& funcName : callGraph.bottomUp()){
+        std::shared_ptr<IR::FuncEntry>& caller = funcMap.at(funcName);
+        if(!caller->root){
+            continue;
+        }
+        // Calls copied from callees were not inlined there, so they are not tried again
+        std::vector<IR::FuncCallLink> links = caller->callLinks;
+        bool changed = false;
+        for(IR::FuncCallLink& link : links){
+            std::shared_ptr<IR::FuncEntry>& callee = funcMap.at(link.funcName);
+            if(!callee->root || callGraph.isRecursive(link.funcName) || sizeOf(callee) > sizeLimit || !canInline(callee)){
+                continue;
+            }
+            changed = inlineCall(caller, link, callee) || changed;
+        }
+        if(!changed){
+            continue;
+        }
+        // Uses of return values
+        IR::CFG cfg(caller);
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            for(IR::Instrction& instr : block->instructions){
+                IR::forEachOperand(instr, [this](IR::index_t& operand){
+                    replace(operand);
+                });
+            }
+        }
+        for(IR::FuncCallLink& link : caller->callLinks){
+            for(std::pair<SymbolId, IR::index_t>& param : link.params){
+                replace(param.second);
+            }
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            IR::relinkBranch(block);
+        }
+        forward.clear();
+    }
+    IR::relinkCalls(funcMap);
+}
+
+size_t InlinePass::sizeOf(const std::shared_ptr<IR::FuncEntry>& entry){
+    size_t size = 0;
+    for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+        size += block->instructions.size();
+    }
+    return size;
+}
+
+bool InlinePass::canInline(const std::shared_ptr<IR::FuncEntry>& entry){
+    IR::CFG cfg(entry);
+    // Tail calls reusing the frame would run in the frame of caller
+    for(IR::FuncCallLink& link : entry->callLinks){
+        if(!IR::findCallSite(cfg, link)){
+            return false;
+        }
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(size_t pos = 0; pos < block->instructions.size(); ++pos){
+            IR::Instrction& instr = block->instructions[pos];
+            if(std::holds_alternative<IR::End>(instr)){
+                return false;
+            }
+            if(std::holds_alternative<IR::Bra>(instr) && std::get<IR::Bra>(instr).operand == IR::Register::pc && !IR::returnStart(block->instructions, pos)){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool InlinePass::inlineCall(const std::shared_ptr<IR::FuncEntry>& caller, const IR::FuncCallLink& link, const std::shared_ptr<IR::FuncEntry>& callee){
+    IR::CFG callerCFG(caller);
+    std::optional<IR::CallSite> site = IR::findCallSite(callerCFG, link);
+    if(!site){
+        return false;
+    }
+    std::shared_ptr<IR::BasicBlock> callBlock = site->block;
+    size_t callPos = site->position;
+    int32_t base = site->frameOffset;
+
+    // Parameters are loaded from their offsets in frame
+    std::unordered_map<int32_t, IR::index_t> paramArgs;
+    for(const std::pair<SymbolId, IR::index_t>& param : link.params){
+        IR::index_t arg = param.second;
+        replace(arg);
+        paramArgs[callee->paramAddrMap.at(param.first)] = arg;
+    }
+    IR::CFG calleeCFG(callee);
+    std::unordered_map<IR::index_t, int32_t> constants;
+    std::unordered_map<IR::index_t, int32_t> frameOffsets;
+    for(std::shared_ptr<IR::BasicBlock>& block : calleeCFG.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            if(std::holds_alternative<IR::Const>(instr)){
+                constants[std::get<IR::Const>(instr).index] = std::get<IR::Const>(instr).value;
+            }else if(std::holds_alternative<IR::Add>(instr)){
+                IR::Add& add = std::get<IR::Add>(instr);
+                if(add.operand1 == IR::Register::fp && constants.contains(add.operand2)){
+                    frameOffsets[add.index] = constants[add.operand2];
+                }
+            }
+        }
+    }
+
+    // Clone blocks of callee, return sequences are replaced by branches to the continuation of call
+    std::shared_ptr<IR::BasicBlock> next = std::make_shared<IR::BasicBlock>();
+    std::unordered_map<IR::index_t, IR::index_t> valueMap;
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::shared_ptr<IR::BasicBlock>> blockMap;
+    std::vector<std::shared_ptr<IR::BasicBlock>> clones;
+    // Blocks branch to continuation, with the returned value
+    std::vector<std::pair<std::shared_ptr<IR::BasicBlock>, std::optional<IR::index_t>>> returns;
+    std::function<void(const std::shared_ptr<IR::BasicBlock>&, const IR::Instrction&)> cloneInto = [&](const std::shared_ptr<IR::BasicBlock>& clone, const IR::Instrction& instr){
+        if(std::holds_alternative<IR::Load>(instr)){
+            const IR::Load& load = std::get<IR::Load>(instr);
+            if(frameOffsets.contains(load.operand) && paramArgs.contains(frameOffsets[load.operand])){
+                valueMap[load.index] = paramArgs[frameOffsets[load.operand]];
+                return;
+            }
+        }
+        if(frameOffsets.contains(IR::getInstrIndex(instr))){
+            // Move frame of callee above the caller
+            const IR::Add& add = std::get<IR::Add>(instr);
+            IR::index_t offset = IR::getInstrIndex(clone->instructions.emplace_back(IR::Const(frameOffsets[add.index] + base)));
+            IR::Add& newAdd = std::get<IR::Add>(clone->instructions.emplace_back(IR::Add(IR::Register::fp, offset)));
+            newAdd.isImportant = add.isImportant;
+            valueMap[add.index] = newAdd.index;
+            return;
+        }
+        valueMap[IR::getInstrIndex(instr)] = IR::getInstrIndex(clone->instructions.emplace_back(IR::cloneInstr(instr)));
+    };
+    for(std::shared_ptr<IR::BasicBlock>& block : calleeCFG.blocks){
+        blockMap[block] = clones.emplace_back(std::make_shared<IR::BasicBlock>());
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : calleeCFG.blocks){
+        std::vector<IR::Instrction>& instrs = block->instructions;
+        std::shared_ptr<IR::BasicBlock> clone = blockMap[block];
+        clone->dominator = blockMap.contains(block->dominator) ? blockMap[block->dominator] : callBlock;
+        size_t pos = 0;
+        for(size_t braPos = 0; braPos < instrs.size(); ++braPos){
+            if(!std::holds_alternative<IR::Bra>(instrs[braPos]) || std::get<IR::Bra>(instrs[braPos]).operand != IR::Register::pc){
+                continue;
+            }
+            size_t start = *IR::returnStart(instrs, braPos);
+            for(; pos < start; ++pos){
+                cloneInto(clone, instrs[pos]);
+            }
+            std::optional<IR::index_t> value;
+            if(std::holds_alternative<IR::StoreReg>(instrs[start])){
+                value = std::get<IR::StoreReg>(instrs[start]).operand2;
+            }
+            returns.emplace_back(clone, value);
+            clone->branch = next;
+            pos = braPos + 1;
+            if(pos < instrs.size()){
+                // Statements after return are kept in a block that is never executed
+                std::shared_ptr<IR::BasicBlock> rest = clones.emplace_back(std::make_shared<IR::BasicBlock>());
+                rest->dominator = clone;
+                clone->fallThrough = rest;
+                clone = rest;
+            }
+        }
+        for(; pos < instrs.size(); ++pos){
+            cloneInto(clone, instrs[pos]);
+        }
+        if(block->fallThrough){
+            clone->fallThrough = blockMap[block->fallThrough];
+        }
+        if(clone->branch == next){
+            continue;
+        }
+        if(block->branch){
+            clone->branch = blockMap[block->branch];
+        }else if(!block->fallThrough){
+            // End of function
+            returns.emplace_back(clone, std::nullopt);
+            clone->branch = next;
+        }
+    }
+    for(std::shared_ptr<IR::BasicBlock>& clone : clones){
+        for(IR::Instrction& instr : clone->instructions){
+            IR::forEachOperand(instr, [&valueMap](IR::index_t& operand){
+                if(valueMap.contains(operand)){
+                    operand = valueMap[operand];
+                }
+            });
+        }
+    }
+    for(std::pair<std::shared_ptr<IR::BasicBlock>, std::optional<IR::index_t>>& ret : returns){
+        if(ret.second && valueMap.contains(*ret.second)){
+            ret.second = valueMap[*ret.second];
+        }
+    }
+    for(IR::FuncCallLink& calleeLink : callee->callLinks){
+        if(!valueMap.contains(calleeLink.callIndex)){
+            continue;
+        }
+        IR::FuncCallLink& newLink = caller->callLinks.emplace_back(calleeLink);
+        newLink.callIndex = valueMap[calleeLink.callIndex];
+        for(std::pair<SymbolId, IR::index_t>& param : newLink.params){
+            if(valueMap.contains(param.second)){
+                param.second = valueMap[param.second];
+            }
+        }
+        if(newLink.resultIndex){
+            newLink.resultIndex = valueMap[*newLink.resultIndex];
+        }
+    }
+    if(link.resultIndex){
+        if(returns.size() == 1 && returns[0].second){
+            forward[*link.resultIndex] = *returns[0].second;
+        }else{
+            // Return values are passed through the slot of return address
+            for(std::pair<std::shared_ptr<IR::BasicBlock>, std::optional<IR::index_t>>& ret : returns){
+                if(ret.second){
+                    std::vector<IR::Instrction>& instrs = ret.first->instructions;
+                    IR::index_t offset = IR::getInstrIndex(instrs.emplace_back(IR::Const(base)));
+                    IR::index_t address = IR::getInstrIndex(instrs.emplace_back(IR::Add(IR::Register::fp, offset)));
+                    instrs.emplace_back(IR::Store(*ret.second, address));
+                }
+            }
+            IR::index_t offset = IR::getInstrIndex(next->instructions.emplace_back(IR::Const(base)));
+            IR::index_t address = IR::getInstrIndex(next->instructions.emplace_back(IR::Add(IR::Register::fp, offset)));
+            forward[*link.resultIndex] = IR::getInstrIndex(next->instructions.emplace_back(IR::Load(address)));
+        }
+    }
+    // Split the block of call
+    std::vector<IR::Instrction>& callInstrs = callBlock->instructions;
+    for(std::vector<IR::Instrction>::iterator it = callInstrs.begin() + callPos + 1; it != callInstrs.end(); ++it){
+        if(!link.resultIndex || IR::getInstrIndex(*it) != *link.resultIndex){
+            next->instructions.emplace_back(*it);
+        }
+    }
+    if(next->instructions.empty()){
+        next->instructions.emplace_back(IR::Nop());
+    }
+    for(std::pair<std::shared_ptr<IR::BasicBlock>, std::optional<IR::index_t>>& ret : returns){
+        ret.first->instructions.emplace_back(IR::Bra(IR::getInstrIndex(next->instructions.front())));
+    }
+    callInstrs.resize(callPos);
+    // Setup of frame is no longer needed
+    std::erase_if(callInstrs, [&site](IR::Instrction& instr){
+        return site->setup.contains(IR::getInstrIndex(instr));
+    });
+    next->branch = callBlock->branch;
+    next->fallThrough = callBlock->fallThrough;
+    next->dominator = callBlock;
+    for(std::shared_ptr<IR::BasicBlock>& block : callerCFG.blocks){
+        if(block->dominator == callBlock){
+            block->dominator = next;
+        }
+    }
+    callBlock->branch = nullptr;
+    callBlock->fallThrough = clones[0];
+    // Frame of callee is placed in the frame of caller
+    caller->frameSize = std::max(caller->frameSize, base + callee->frameSize);
+
+    // Call links
+    std::erase_if(caller->callLinks, [&link](IR::FuncCallLink& callLink){
+        return callLink.callIndex == link.callIndex;
+    });
+    std::set<IR::index_t> nextInstrs;
+    for(IR::Instrction& instr : next->instructions){
+        nextInstrs.insert(IR::getInstrIndex(instr));
+    }
+    std::unordered_map<IR::index_t, std::shared_ptr<IR::BasicBlock>> cloneOf;
+    for(std::shared_ptr<IR::BasicBlock>& clone : clones){
+        for(IR::Instrction& instr : clone->instructions){
+            cloneOf[IR::getInstrIndex(instr)] = clone;
+        }
+    }
+    for(IR::FuncCallLink& callLink : caller->callLinks){
+        if(callLink.block == callBlock && nextInstrs.contains(callLink.callIndex)){
+            callLink.block = next;
+        }else if(cloneOf.contains(callLink.callIndex)){
+            callLink.block = cloneOf[callLink.callIndex];
+        }
+    }
+    return true;
+}
+
+void InlinePass::replace(IR::index_t& operand){
+    std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(operand);
+    while(it != forward.end()){
+        operand = it->second;
+        it = forward.find(operand);
+    }
+}
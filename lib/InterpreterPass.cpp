@@ -0,0 +1,335 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <InterpreterPass.hpp>
+#include <Exception.hpp>
+
+#include <algorithm>
+#include <limits>
+
+const size_t InterpreterPass::defaultMemorySize = 1 << 22;
+
+InterpreterPass::InterpreterPass(std::istream& input, std::ostream& output, size_t memorySize):
+    input(input), output(output), memory(memorySize)
+{
+}
+
+std::string InterpreterPass::operationName(IR::Operation operation){
+    switch(operation){
+        case IR::Operation::Nop: return "nop";
+        case IR::Operation::Const: return "const";
+        case IR::Operation::StoreReg: return "storereg";
+        case IR::Operation::Neg: return "neg";
+        case IR::Operation::Add: return "add";
+        case IR::Operation::Sub: return "sub";
+        case IR::Operation::Mul: return "mul";
+        case IR::Operation::Div: return "div";
+        case IR::Operation::Cmp: return "cmp";
+        case IR::Operation::Adda: return "adda";
+        case IR::Operation::Load: return "load";
+        case IR::Operation::Store: return "store";
+        case IR::Operation::Phi: return "phi";
+        case IR::Operation::Move: return "move";
+        case IR::Operation::End: return "end";
+        case IR::Operation::Bra: return "bra";
+        case IR::Operation::Bne: return "bne";
+        case IR::Operation::Beq: return "beq";
+        case IR::Operation::Ble: return "ble";
+        case IR::Operation::Blt: return "blt";
+        case IR::Operation::Bge: return "bge";
+        case IR::Operation::Bgt: return "bgt";
+        case IR::Operation::Read: return "read";
+        case IR::Operation::Write: return "write";
+        case IR::Operation::WriteNL: return "writeNL";
+    }
+    return "";
+}
+
+void InterpreterPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    cfgs.clear();
+    funcOf.clear();
+    code.clear();
+    codeStart.clear();
+    callees.clear();
+    counts.clear();
+    std::fill(memory.begin(), memory.end(), 0);
+    for(std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair : funcMap){
+        if(!funcPair.second->root){
+            continue;
+        }
+        std::shared_ptr<IR::CFG> cfg = std::make_shared<IR::CFG>(funcPair.second);
+        for(std::shared_ptr<IR::BasicBlock>& bb : cfg->blocks){
+            funcOf[bb] = funcPair.first;
+            codeStart[bb] = code.size();
+            for(size_t pos = 0; pos <= bb->instructions.size(); ++pos){
+                code.emplace_back(bb, pos);
+            }
+        }
+        cfgs[funcPair.first] = cfg;
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            callees[link.callIndex] = link.funcName;
+        }
+    }
+
+    // Frame of _main starts at 0
+    activations.assign(1, Activation {{}, 0});
+    pc = fp = rval = 0;
+    halted = false;
+    lineStart = true;
+    block = nullptr;
+    enter(funcMap.at("_main")->root, nullptr, false);
+    while(!halted){
+        if(position >= block->instructions.size()){
+            if(block->fallThrough){
+                enter(block->fallThrough, block, false);
+            }else if(activations.size() > 1){
+                // Return without return sequence
+                int32_t returnAddr = memoryAt(fp);
+                fp = memoryAt(fp + INT_SIZE);
+                activations.pop_back();
+                jump(returnAddr);
+            }else{
+                halted = true;
+            }
+            continue;
+        }
+        std::shared_ptr<IR::BasicBlock> current = block;
+        std::visit([this, &current](auto& instr){
+            IR::Operation operation = instr.operation;
+            counts[operation] += 1;
+            visit(instr, current);
+        }, current->instructions[position++]);
+    }
+    if(!lineStart){
+        output << "\n";
+    }
+    output.flush();
+}
+
+int32_t InterpreterPass::valueOf(IR::index_t value){
+    switch(value){
+        case IR::Register::pc:
+            // Address of the call branch in block
+            for(size_t pos = position; pos < block->instructions.size(); ++pos){
+                if(std::holds_alternative<IR::Bra>(block->instructions[pos])){
+                    return (codeStart[block] + pos) * INT_SIZE;
+                }
+            }
+            throw Exception("pc read without call");
+        case IR::Register::fp:
+            return fp;
+        case IR::Register::rval:
+            return rval;
+        default:
+            break;
+    }
+    std::unordered_map<IR::index_t, int32_t>::iterator it = activations.back().values.find(value);
+    if(it == activations.back().values.end()){
+        throw Exception(std::string("value (") + std::to_string(value) + ") used before defined");
+    }
+    return it->second;
+}
+
+void InterpreterPass::define(IR::index_t value, int32_t result){
+    activations.back().values[value] = result;
+}
+
+int32_t& InterpreterPass::memoryAt(int32_t address){
+    if(address < 0 || address % INT_SIZE != 0 || (size_t)(address / INT_SIZE) >= memory.size()){
+        throw Exception(std::string("invalid memory access at ") + std::to_string(address));
+    }
+    return memory[address / INT_SIZE];
+}
+
+void InterpreterPass::enter(std::shared_ptr<IR::BasicBlock> target, std::shared_ptr<IR::BasicBlock> from, bool isBranch){
+    // Fall-through edge comes before branch edge when both reach target
+    const IR::CFG& cfg = *cfgs.at(funcOf.at(target));
+    const std::vector<size_t>& preds = cfg.preds[cfg.blockId.at(target)];
+    size_t edge = 0;
+    for(size_t predId = 0; predId < preds.size(); ++predId){
+        if(cfg.blocks[preds[predId]] == from){
+            edge = predId;
+            if(!isBranch){
+                break;
+            }
+        }
+    }
+    // Phi are evaluated together, before any of them is defined
+    block = target;
+    position = 0;
+    std::vector<std::pair<IR::index_t, int32_t>> results;
+    for(IR::Instrction& instr : target->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            results.emplace_back(phi.index, valueOf((edge == 0) ? phi.operand1 : phi.operand2));
+        }
+    }
+    for(std::pair<IR::index_t, int32_t>& result : results){
+        define(result.first, result.second);
+    }
+}
+
+void InterpreterPass::jump(int32_t address){
+    if(address < 0 || address % INT_SIZE != 0 || (size_t)(address / INT_SIZE) >= code.size()){
+        throw Exception(std::string("invalid code address ") + std::to_string(address));
+    }
+    block = code[address / INT_SIZE].first;
+    position = code[address / INT_SIZE].second;
+}
+
+void InterpreterPass::branchIf(bool taken){
+    if(taken){
+        enter(block->branch, block, true);
+    }
+}
+
+void InterpreterPass::visit(IR::Nop&, std::shared_ptr<IR::BasicBlock>&){}
+
+void InterpreterPass::visit(IR::Const& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, target.value);
+}
+
+void InterpreterPass::visit(IR::Neg& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, (int32_t)(0u - (uint32_t)valueOf(target.operand)));
+}
+
+void InterpreterPass::visit(IR::Add& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, (int32_t)((uint32_t)valueOf(target.operand1) + (uint32_t)valueOf(target.operand2)));
+}
+
+void InterpreterPass::visit(IR::Sub& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, (int32_t)((uint32_t)valueOf(target.operand1) - (uint32_t)valueOf(target.operand2)));
+}
+
+void InterpreterPass::visit(IR::StoreReg& target, std::shared_ptr<IR::BasicBlock>&){
+    int32_t value = valueOf(target.operand2);
+    switch(target.operand1){
+        case IR::Register::pc:
+            pc = value;
+            break;
+        case IR::Register::fp:
+            fp = value;
+            break;
+        case IR::Register::rval:
+            rval = value;
+            break;
+        default:
+            throw Exception("store to unknown register");
+    }
+}
+
+void InterpreterPass::visit(IR::Mul& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, (int32_t)((uint32_t)valueOf(target.operand1) * (uint32_t)valueOf(target.operand2)));
+}
+
+void InterpreterPass::visit(IR::Div& target, std::shared_ptr<IR::BasicBlock>&){
+    int32_t divisor = valueOf(target.operand2);
+    if(divisor == 0){
+        throw Exception("division by zero");
+    }
+    int32_t dividend = valueOf(target.operand1);
+    // Quotient of the only overflowing division wraps around like the other arithmetic
+    if(dividend == std::numeric_limits<int32_t>::min() && divisor == -1){
+        define(target.index, dividend);
+        return;
+    }
+    define(target.index, dividend / divisor);
+}
+
+void InterpreterPass::visit(IR::Cmp& target, std::shared_ptr<IR::BasicBlock>&){
+    int32_t operand1 = valueOf(target.operand1);
+    int32_t operand2 = valueOf(target.operand2);
+    define(target.index, (operand1 > operand2) - (operand1 < operand2));
+}
+
+void InterpreterPass::visit(IR::Adda& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, (int32_t)((uint32_t)valueOf(target.operand1) + (uint32_t)valueOf(target.operand2)));
+}
+
+void InterpreterPass::visit(IR::Load& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.index, memoryAt(valueOf(target.operand)));
+}
+
+void InterpreterPass::visit(IR::Store& target, std::shared_ptr<IR::BasicBlock>&){
+    memoryAt(valueOf(target.operand2)) = valueOf(target.operand1);
+}
+
+// Evaluated on entry of block
+void InterpreterPass::visit(IR::Phi&, std::shared_ptr<IR::BasicBlock>&){}
+
+void InterpreterPass::visit(IR::Move& target, std::shared_ptr<IR::BasicBlock>&){
+    define(target.operand1, valueOf(target.operand2));
+}
+
+void InterpreterPass::visit(IR::End&, std::shared_ptr<IR::BasicBlock>&){
+    halted = true;
+}
+
+void InterpreterPass::visit(IR::Bra& target, std::shared_ptr<IR::BasicBlock>& bb){
+    std::unordered_map<IR::index_t, std::string>::iterator callee = callees.find(target.index);
+    if(callee != callees.end()){
+        // Frame is reused by tail call
+        if(fp == activations.back().fp){
+            activations.back().values.clear();
+        }else{
+            activations.emplace_back(Activation {{}, fp});
+        }
+        enter(cfgs.at(callee->second)->blocks[0], nullptr, false);
+    }else if(target.operand == IR::Register::pc){
+        if(activations.size() == 1){
+            throw Exception("return from _main");
+        }
+        activations.pop_back();
+        jump(pc);
+    }else{
+        enter(bb->branch, bb, true);
+    }
+}
+
+void InterpreterPass::visit(IR::Bne& target, std::shared_ptr<IR::BasicBlock>&){
+    branchIf(valueOf(target.operand1) != 0);
+}
+
+void InterpreterPass::visit(IR::Beq& target, std::shared_ptr<IR::BasicBlock>&){
+    branchIf(valueOf(target.operand1) == 0);
+}
+
+void InterpreterPass::visit(IR::Ble& target, std::shared_ptr<IR::BasicBlock>&){
+    branchIf(valueOf(target.operand1) <= 0);
+}
+
+void InterpreterPass::visit(IR::Blt& target, std::shared_ptr<IR::BasicBlock>&){
+    branchIf(valueOf(target.operand1) < 0);
+}
+
+void InterpreterPass::visit(IR::Bge& target, std::shared_ptr<IR::BasicBlock>&){
+    branchIf(valueOf(target.operand1) >= 0);
+}
+
+void InterpreterPass::visit(IR::Bgt& target, std::shared_ptr<IR::BasicBlock>&){
+    branchIf(valueOf(target.operand1) > 0);
+}
+
+void InterpreterPass::visit(IR::Read& target, std::shared_ptr<IR::BasicBlock>&){
+    int32_t value;
+    if(!(input >> value)){
+        throw Exception("no number to read");
+    }
+    define(target.index, value);
+}
+
+void InterpreterPass::visit(IR::Write& target, std::shared_ptr<IR::BasicBlock>&){
+    if(!lineStart){
+        output << " ";
+    }
+    output << valueOf(target.operand);
+    lineStart = false;
+}
+
+void InterpreterPass::visit(IR::WriteNL&, std::shared_ptr<IR::BasicBlock>&){
+    output << "\n";
+    lineStart = true;
+}
@@ -0,0 +1,194 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <LICMPass.hpp>
+#include <CallGraph.hpp>
+
+#include <algorithm>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+void LICMPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        std::unique_ptr<IR::CFG> cfg = std::make_unique<IR::CFG>(funcPair.second);
+        std::unique_ptr<IR::LoopInfo> loopInfo = std::make_unique<IR::LoopInfo>(*cfg);
+        if(loopInfo->loops.empty()){
+            continue;
+        }
+        if(insertPreheaders(*cfg, *loopInfo)){
+            cfg = std::make_unique<IR::CFG>(funcPair.second);
+            loopInfo = std::make_unique<IR::LoopInfo>(*cfg);
+        }
+        // Constants and call sites
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg->blocks){
+            for(IR::Instrction& instrRef : block->instructions){
+                if(std::holds_alternative<IR::Const>(instrRef)){
+                    IR::Const& instr = std::get<IR::Const>(instrRef);
+                    constants[instr.index] = instr.value;
+                }
+            }
+        }
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            callSet.insert(link.callIndex);
+        }
+        // Inner loops first, so that their invariants can be hoisted further from outer loops
+        IR::AliasAnalysis aliasAnalysis(funcPair.second);
+        for(IR::Loop& loop : loopInfo->loops){
+            hoist(*cfg, loop, aliasAnalysis);
+        }
+        constants.clear();
+        callSet.clear();
+    }
+}
+
+bool LICMPass::insertPreheaders(const IR::CFG& cfg, const IR::LoopInfo& loopInfo){
+    bool changed = false;
+    for(const IR::Loop& loop : loopInfo.loops){
+        std::vector<size_t> entries;
+        for(size_t pred : cfg.preds[loop.header]){
+            if(!loop.contains[pred]){
+                entries.push_back(pred);
+            }
+        }
+        // Phi has only one operand for the entry, a single entry with no other successor is the preheader already
+        if(entries.size() != 1 || cfg.succs[entries[0]].size() == 1){
+            continue;
+        }
+        std::shared_ptr<IR::BasicBlock> entry = cfg.blocks[entries[0]];
+        std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+        std::shared_ptr<IR::BasicBlock> preheader = std::make_shared<IR::BasicBlock>();
+        preheader->fallThrough = header;
+        preheader->dominator = header->dominator;
+        header->dominator = preheader;
+        if(entry->fallThrough == header){
+            entry->fallThrough = preheader;
+        }
+        if(entry->branch == header){
+            entry->branch = preheader;
+            IR::relinkBranch(entry);
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+void LICMPass::hoist(const IR::CFG& cfg, const IR::Loop& loop, const IR::AliasAnalysis& aliasAnalysis){
+    // Preheader
+    std::shared_ptr<IR::BasicBlock> preheader;
+    for(size_t pred : cfg.preds[loop.header]){
+        if(!loop.contains[pred]){
+            if(preheader || cfg.succs[pred].size() != 1){
+                return;
+            }
+            preheader = cfg.blocks[pred];
+        }
+    }
+    if(!preheader){
+        return;
+    }
+
+    // Values defined in loop, memory written in loop
+    std::set<IR::index_t> loopDefs;
+    std::vector<IR::index_t> storeAddrs;
+    bool hasCall = false;
+    for(size_t blockId : loop.blocks){
+        for(IR::Instrction& instrRef : cfg.blocks[blockId]->instructions){
+            loopDefs.insert(IR::getInstrIndex(instrRef));
+            if(std::holds_alternative<IR::Store>(instrRef)){
+                storeAddrs.push_back(std::get<IR::Store>(instrRef).operand2);
+            }else if(callSet.contains(IR::getInstrIndex(instrRef))){
+                hasCall = true;
+            }
+        }
+    }
+
+    // Blocks leaving loop, an instruction that may trap is hoisted only from a block dominating all of them,
+    // which runs whenever the loop is entered
+    std::vector<size_t> exitings;
+    for(size_t blockId : loop.blocks){
+        if(std::any_of(cfg.succs[blockId].begin(), cfg.succs[blockId].end(), [&loop](size_t succ){ return !loop.contains[succ]; })){
+            exitings.push_back(blockId);
+        }
+    }
+
+    // Collect invariants in reverse post-order, so that operands are decided before their users
+    std::set<IR::index_t> invariants;
+    auto isInvariant = [&](IR::index_t operand){
+        if(operand == IR::Register::fp){
+            return true;
+        }
+        if(operand == IR::Register::pc || operand == IR::Register::rval){
+            return false;
+        }
+        return !loopDefs.contains(operand) || invariants.contains(operand);
+    };
+    std::vector<IR::Instrction> hoisted;
+    for(size_t blockId : loop.blocks){
+        std::shared_ptr<IR::BasicBlock> block = cfg.blocks[blockId];
+        bool alwaysRuns = std::all_of(exitings.begin(), exitings.end(), [&](size_t exiting){ return cfg.dominates(blockId, exiting); });
+        std::erase_if(block->instructions, [&](IR::Instrction& instrRef){
+            // Only instructions without side effect and never trap, unless the block always runs, can be executed before the loop
+            bool movable = std::visit(overloaded {
+                [](auto&){ return false; },
+                [](IR::Const&){ return true; },
+                [&](IR::Neg& instr){ return isInvariant(instr.operand); },
+                [&](IR::Add& instr){ return isInvariant(instr.operand1) && isInvariant(instr.operand2); },
+                [&](IR::Sub& instr){ return isInvariant(instr.operand1) && isInvariant(instr.operand2); },
+                [&](IR::Mul& instr){ return isInvariant(instr.operand1) && isInvariant(instr.operand2); },
+                [&](IR::Cmp& instr){ return isInvariant(instr.operand1) && isInvariant(instr.operand2); },
+                [&](IR::Adda& instr){ return isInvariant(instr.operand1) && isInvariant(instr.operand2); },
+                [&](IR::Div& instr){
+                    return isInvariant(instr.operand1) && isInvariant(instr.operand2)
+                        && constants.contains(instr.operand2) && constants[instr.operand2] != 0 && constants[instr.operand2] != -1;
+                },
+                [&](IR::Load& instr){
+                    if(!isInvariant(instr.operand)){
+                        return false;
+                    }
+                    // Slot at a known offset of frame is always in memory, other addresses may be invalid
+                    IR::AliasAnalysis::Location location = aliasAnalysis.locate(instr.operand);
+                    if(!alwaysRuns && (location.kind != IR::AliasAnalysis::Location::Kind::Frame || !location.offset)){
+                        return false;
+                    }
+                    // Callee only writes its own frame, which is never located by the caller
+                    if(hasCall && (location.kind == IR::AliasAnalysis::Location::Kind::Unknown || !location.offset)){
+                        return false;
+                    }
+                    return std::none_of(storeAddrs.begin(), storeAddrs.end(), [&](IR::index_t address){
+                        return aliasAnalysis.mayAlias(aliasAnalysis.locate(address), location);
+                    });
+                },
+            }, instrRef);
+            movable = movable && !std::visit([](auto& instr){ return instr.isImportant; }, instrRef);
+            if(movable){
+                invariants.insert(IR::getInstrIndex(instrRef));
+                hoisted.emplace_back(instrRef);
+            }
+            return movable;
+        });
+    }
+    if(hoisted.empty()){
+        return;
+    }
+    // Keep the branch instruction at the end of preheader
+    std::vector<IR::Instrction>::iterator position = preheader->instructions.end();
+    if(preheader->branch && !preheader->instructions.empty()){
+        position = std::prev(position);
+    }
+    preheader->instructions.insert(position, hoisted.begin(), hoisted.end());
+    // Hoisted instruction may be the branch target
+    for(size_t blockId : loop.blocks){
+        IR::relinkBranch(cfg.blocks[blockId]);
+    }
+    for(size_t pred : cfg.preds[loop.header]){
+        IR::relinkBranch(cfg.blocks[pred]);
+    }
+}
@@ -0,0 +1,317 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <LinearScanPass.hpp>
+#include <Exception.hpp>
+
+#include <algorithm>
+#include <limits>
+
+static const int never = std::numeric_limits<int>::max();
+
+LinearScanPass::LinearScanPass(size_t registerCount): RegisterAllocPass(registerCount){}
+
+int LinearScanPass::Interval::start() const{
+    return ranges.front().from;
+}
+
+int LinearScanPass::Interval::end() const{
+    return ranges.back().to;
+}
+
+bool LinearScanPass::Interval::covers(int pos) const{
+    return std::any_of(ranges.begin(), ranges.end(), [pos](const Range& range){
+        return range.from <= pos && pos < range.to;
+    });
+}
+
+int LinearScanPass::Interval::intersection(const Interval& other) const{
+    std::vector<Range>::const_iterator range1 = ranges.begin();
+    std::vector<Range>::const_iterator range2 = other.ranges.begin();
+    while(range1 != ranges.end() && range2 != other.ranges.end()){
+        int from = std::max(range1->from, range2->from);
+        if(from < std::min(range1->to, range2->to)){
+            return from;
+        }
+        if(range1->to < range2->to){
+            ++range1;
+        }else{
+            ++range2;
+        }
+    }
+    return never;
+}
+
+int LinearScanPass::Interval::nextUse(int pos) const{
+    std::vector<int>::const_iterator use = std::lower_bound(uses.begin(), uses.end(), pos);
+    return (use == uses.end()) ? never : *use;
+}
+
+bool LinearScanPass::Interval::splittable(int pos) const{
+    int use = nextUse(pos);
+    if(!spillable || use == never){
+        return spillable;
+    }
+    if(!std::binary_search(storeUses.begin(), storeUses.end(), use)){
+        return true;
+    }
+    // Value to store is defined again after pos
+    std::vector<int>::const_iterator def = std::lower_bound(defs.begin(), defs.end(), pos);
+    return def != defs.end() && *def < use;
+}
+
+void LinearScanPass::allocate(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry){
+    spillStores.clear();
+    while(true){
+        IR::CFG cfg(entry);
+        IR::Liveness liveness(cfg);
+        std::vector<int> blockFrom;
+        std::vector<Interval> intervals = buildIntervals(cfg, liveness, blockFrom);
+        std::vector<Spill> spills = scan(intervals);
+        if(spills.empty()){
+            entry->registers.clear();
+            for(Interval& interval : intervals){
+                entry->registers[interval.value] = interval.reg;
+            }
+            break;
+        }
+        if(!rewrite(cfg, liveness, blockFrom, spills)){
+            throw Exception(std::string("can't allocate registers in '") + funcName + "'");
+        }
+        moveCalleeFrames(entry);
+    }
+}
+
+std::vector<LinearScanPass::Interval> LinearScanPass::buildIntervals(const IR::CFG& cfg, const IR::Liveness& liveness, std::vector<int>& blockFrom){
+    // Blocks are numbered in reverse post-order, two positions for each instruction
+    blockFrom.assign(cfg.blocks.size() + 1, 0);
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        blockFrom[blockId + 1] = blockFrom[blockId] + 2 * cfg.blocks[blockId]->instructions.size();
+    }
+
+    // Ranges are built backward, so they are kept in reverse order until the end
+    std::vector<Interval> intervals;
+    std::unordered_map<IR::index_t, size_t> intervalOf;
+    auto intervalFor = [&](IR::index_t value) -> Interval& {
+        if(!intervalOf.contains(value)){
+            intervalOf[value] = intervals.size();
+            intervals.emplace_back(Interval {value, {}, {}, {}, {}, 0, !unspillable.contains(value)});
+        }
+        return intervals[intervalOf[value]];
+    };
+    auto addRange = [](Interval& interval, int from, int to){
+        if(!interval.ranges.empty() && interval.ranges.back().from <= to){
+            interval.ranges.back().from = std::min(interval.ranges.back().from, from);
+            interval.ranges.back().to = std::max(interval.ranges.back().to, to);
+        }else{
+            interval.ranges.emplace_back(Range {from, to});
+        }
+    };
+    for(size_t blockId = cfg.blocks.size(); blockId-- > 0;){
+        int from = blockFrom[blockId];
+        for(size_t id : liveness.liveOut[blockId].elements()){
+            addRange(intervalFor(liveness.values[id]), from, blockFrom[blockId + 1]);
+        }
+        std::vector<IR::Instrction>& instrs = cfg.blocks[blockId]->instructions;
+        for(size_t instrId = instrs.size(); instrId-- > 0;){
+            int pos = from + 2 * instrId;
+            IR::index_t def = defOf(instrs[instrId]);
+            // Values never used need no register
+            if(liveness.valueId.contains(def)){
+                Interval& interval = intervalFor(def);
+                if(!interval.ranges.empty() && interval.ranges.back().from <= pos + 1){
+                    interval.ranges.back().from = pos + 1;
+                }else{
+                    interval.ranges.emplace_back(Range {pos + 1, pos + 2});
+                }
+                interval.defs.push_back(pos + 1);
+            }
+            bool isSpillStore = spillStores.contains(IR::getInstrIndex(instrs[instrId]));
+            IR::forEachOperand(instrs[instrId], [&](IR::index_t& operand){
+                if(liveness.valueId.contains(operand)){
+                    Interval& interval = intervalFor(operand);
+                    addRange(interval, from, pos + 1);
+                    interval.uses.push_back(pos);
+                    if(isSpillStore){
+                        interval.storeUses.push_back(pos);
+                    }
+                }
+            });
+        }
+    }
+    for(Interval& interval : intervals){
+        std::reverse(interval.ranges.begin(), interval.ranges.end());
+        std::reverse(interval.uses.begin(), interval.uses.end());
+        std::reverse(interval.storeUses.begin(), interval.storeUses.end());
+        std::reverse(interval.defs.begin(), interval.defs.end());
+    }
+    return intervals;
+}
+
+std::vector<LinearScanPass::Spill> LinearScanPass::scan(std::vector<Interval>& intervals){
+    std::vector<Interval*> unhandled;
+    for(Interval& interval : intervals){
+        unhandled.push_back(&interval);
+    }
+    std::stable_sort(unhandled.begin(), unhandled.end(), [](Interval* interval1, Interval* interval2){
+        return interval1->start() < interval2->start();
+    });
+    std::vector<Interval*> active;
+    std::vector<Interval*> inactive;
+    std::vector<Spill> spills;
+    auto evict = [&](std::vector<Interval*>& list, size_t reg, const Interval& current, int pos){
+        std::erase_if(list, [&](Interval* interval){
+            if(interval->reg == reg && interval->intersection(current) != never){
+                spills.emplace_back(Spill {interval->value, pos});
+                return true;
+            }
+            return false;
+        });
+    };
+    // Interval keeps its register before pos, and is reloaded after it
+    auto split = [&](Interval& interval, int pos){
+        spills.emplace_back(Spill {interval.value, pos});
+        std::erase_if(interval.ranges, [pos](Range& range){ return range.from >= pos; });
+        interval.ranges.back().to = std::min(interval.ranges.back().to, pos);
+    };
+    for(Interval* current : unhandled){
+        int pos = current->start();
+        // Intervals ended are dropped, the others are active if they cover pos, or inactive in a lifetime hole
+        std::vector<Interval*> nextActive;
+        std::vector<Interval*> nextInactive;
+        for(Interval* interval : active){
+            if(interval->end() > pos){
+                (interval->covers(pos) ? nextActive : nextInactive).push_back(interval);
+            }
+        }
+        for(Interval* interval : inactive){
+            if(interval->end() > pos){
+                (interval->covers(pos) ? nextActive : nextInactive).push_back(interval);
+            }
+        }
+        active = nextActive;
+        inactive = nextInactive;
+
+        // Register free for the longest time
+        std::vector<int> freeUntil(registerCount, never);
+        for(Interval* interval : active){
+            freeUntil[interval->reg] = 0;
+        }
+        for(Interval* interval : inactive){
+            freeUntil[interval->reg] = std::min(freeUntil[interval->reg], interval->intersection(*current));
+        }
+        size_t reg = std::max_element(freeUntil.begin(), freeUntil.end()) - freeUntil.begin();
+        if(freeUntil[reg] >= current->end()){
+            current->reg = reg;
+            active.push_back(current);
+            continue;
+        }
+        if(freeUntil[reg] > pos && current->splittable(freeUntil[reg])){
+            // Register is taken before the end, the rest is split off
+            current->reg = reg;
+            split(*current, freeUntil[reg]);
+            active.push_back(current);
+            continue;
+        }
+
+        // All registers are taken: the interval used farthest is split. Values that can't be split
+        // block their register where they meet current, which is split there instead
+        std::vector<int> nextUse(registerCount, never);
+        std::vector<int> blockPos(registerCount, never);
+        auto updateNextUse = [&](Interval* interval, int from){
+            if(!interval->splittable(pos)){
+                blockPos[interval->reg] = std::min(blockPos[interval->reg], from);
+                nextUse[interval->reg] = std::min(nextUse[interval->reg], from);
+            }else{
+                nextUse[interval->reg] = std::min(nextUse[interval->reg], interval->nextUse(pos));
+            }
+        };
+        for(Interval* interval : active){
+            updateNextUse(interval, pos);
+        }
+        for(Interval* interval : inactive){
+            int from = interval->intersection(*current);
+            if(from != never){
+                updateNextUse(interval, from);
+            }
+        }
+        reg = std::max_element(nextUse.begin(), nextUse.end()) - nextUse.begin();
+        if(current->splittable(pos) && current->nextUse(pos) > nextUse[reg]){
+            spills.emplace_back(Spill {current->value, pos});
+            continue;
+        }
+        if(blockPos[reg] <= pos || (blockPos[reg] < current->end() && !current->splittable(blockPos[reg]))){
+            throw Exception("not enough registers for spill code");
+        }
+        current->reg = reg;
+        if(blockPos[reg] < current->end()){
+            split(*current, blockPos[reg]);
+        }
+        evict(active, reg, *current, pos);
+        evict(inactive, reg, *current, pos);
+        active.push_back(current);
+    }
+    return spills;
+}
+
+bool LinearScanPass::rewrite(const IR::CFG& cfg, const IR::Liveness& liveness,
+    const std::vector<int>& blockFrom, std::vector<Spill>& spills)
+{
+    // Split inside a loop the value is live through is moved to the loop header,
+    // otherwise the value is needed in register again after the back edge
+    IR::LoopInfo loopInfo(cfg);
+    std::unordered_map<IR::index_t, int> reloadFrom;
+    std::unordered_set<IR::index_t> newSlots;
+    for(Spill& spill : spills){
+        int from = spill.from;
+        if(from < blockFrom.back()){
+            size_t blockId = std::upper_bound(blockFrom.begin(), blockFrom.end(), from) - blockFrom.begin() - 1;
+            for(IR::Loop& loop : loopInfo.loops){
+                if(loop.contains[blockId] && liveness.isLiveIn(loop.header, spill.value)){
+                    from = std::min(from, blockFrom[loop.header]);
+                }
+            }
+        }
+        reloadFrom[spill.value] = reloadFrom.contains(spill.value) ? std::min(reloadFrom[spill.value], from) : from;
+        if(!slots.contains(spill.value)){
+            slots[spill.value] = slotCount++;
+            newSlots.insert(spill.value);
+        }
+    }
+
+    // Value is stored after each definition, and loaded before uses after the split
+    bool changed = !newSlots.empty();
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        std::vector<IR::Instrction> instrs;
+        int pos = blockFrom[blockId];
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            std::unordered_map<IR::index_t, IR::index_t> reloads;
+            bool isSpillStore = spillStores.contains(IR::getInstrIndex(instr));
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                std::unordered_map<IR::index_t, int>::iterator it = reloadFrom.find(operand);
+                if(isSpillStore || it == reloadFrom.end() || pos < it->second){
+                    return;
+                }
+                changed = true;
+                if(!reloads.contains(operand)){
+                    IR::index_t reload = IR::getInstrIndex(instrs.emplace_back(IR::Load(slotAddress(instrs, operand))));
+                    unspillable.insert(reload);
+                    reloads[operand] = reload;
+                }
+                operand = reloads[operand];
+            });
+            instrs.emplace_back(instr);
+            IR::index_t def = defOf(instr);
+            if(newSlots.contains(def)){
+                IR::index_t address = slotAddress(instrs, def);
+                spillStores.insert(IR::getInstrIndex(instrs.emplace_back(IR::Store(def, address))));
+            }
+            pos += 2;
+        }
+        cfg.blocks[blockId]->instructions = instrs;
+    }
+    return changed;
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <Liveness.hpp>
+
+#include <deque>
+#include <bit>
+
+static const size_t wordBits = 64;
+
+IR::ValueSet::ValueSet(size_t size): words((size + wordBits - 1) / wordBits, 0){}
+
+bool IR::ValueSet::contains(size_t id) const{
+    return (words[id / wordBits] >> (id % wordBits)) & 1;
+}
+
+void IR::ValueSet::insert(size_t id){
+    words[id / wordBits] |= uint64_t(1) << (id % wordBits);
+}
+
+void IR::ValueSet::erase(size_t id){
+    words[id / wordBits] &= ~(uint64_t(1) << (id % wordBits));
+}
+
+bool IR::ValueSet::unite(const IR::ValueSet& other){
+    uint64_t added = 0;
+    for(size_t i = 0; i < words.size(); ++i){
+        added |= other.words[i] & ~words[i];
+        words[i] |= other.words[i];
+    }
+    return added != 0;
+}
+
+bool IR::ValueSet::assign(const IR::ValueSet& gen, const IR::ValueSet& other, const IR::ValueSet& kill){
+    uint64_t changed = 0;
+    for(size_t i = 0; i < words.size(); ++i){
+        uint64_t word = gen.words[i] | (other.words[i] & ~kill.words[i]);
+        changed |= word ^ words[i];
+        words[i] = word;
+    }
+    return changed != 0;
+}
+
+std::vector<size_t> IR::ValueSet::elements() const{
+    std::vector<size_t> result;
+    for(size_t i = 0; i < words.size(); ++i){
+        for(uint64_t word = words[i]; word != 0; word &= word - 1){
+            result.push_back(i * wordBits + std::countr_zero(word));
+        }
+    }
+    return result;
+}
+
+IR::Liveness::Liveness(const IR::CFG& cfg){
+    // Number the values, registers are not values
+    size_t blockCount = cfg.blocks.size();
+    auto number = [this](IR::index_t value){
+        if(value > IR::Register::rval && !valueId.contains(value)){
+            valueId[value] = values.size();
+            values.push_back(value);
+        }
+    };
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            if(std::holds_alternative<IR::Phi>(instr)){
+                number(std::get<IR::Phi>(instr).operand1);
+                number(std::get<IR::Phi>(instr).operand2);
+            }else{
+                IR::forEachOperand(instr, number);
+            }
+        }
+    }
+
+    // Uses before definitions in block, and definitions
+    std::vector<ValueSet> uses(blockCount, ValueSet(values.size()));
+    std::vector<ValueSet> defs(blockCount, ValueSet(values.size()));
+    liveIn.assign(blockCount, ValueSet(values.size()));
+    liveOut.assign(blockCount, ValueSet(values.size()));
+    for(size_t blockId = 0; blockId < blockCount; ++blockId){
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            if(std::holds_alternative<IR::Phi>(instr)){
+                IR::Phi& phi = std::get<IR::Phi>(instr);
+                const std::vector<size_t>& preds = cfg.preds[blockId];
+                if(preds.size() > 0 && valueId.contains(phi.operand1)){
+                    liveOut[preds[0]].insert(valueId[phi.operand1]);
+                }
+                if(preds.size() > 1 && valueId.contains(phi.operand2)){
+                    liveOut[preds[1]].insert(valueId[phi.operand2]);
+                }
+            }else{
+                IR::forEachOperand(instr, [&](IR::index_t& operand){
+                    std::unordered_map<IR::index_t, size_t>::iterator id = valueId.find(operand);
+                    if(id != valueId.end() && !defs[blockId].contains(id->second)){
+                        uses[blockId].insert(id->second);
+                    }
+                });
+            }
+            IR::index_t def = std::holds_alternative<IR::Move>(instr) ? std::get<IR::Move>(instr).operand1 : IR::getInstrIndex(instr);
+            std::unordered_map<IR::index_t, size_t>::iterator id = valueId.find(def);
+            if(id != valueId.end()){
+                defs[blockId].insert(id->second);
+            }
+        }
+    }
+
+    // Live-out only grows, so uses by Phi stay in it. Blocks are visited in post-order,
+    // which is reverse post-order of the reversed graph, so that successors mostly come first
+    std::deque<size_t> worklist;
+    std::vector<bool> queued(blockCount, true);
+    for(size_t blockId = blockCount; blockId-- > 0;){
+        worklist.push_back(blockId);
+    }
+    while(!worklist.empty()){
+        size_t blockId = worklist.front();
+        worklist.pop_front();
+        queued[blockId] = false;
+        ValueSet& out = liveOut[blockId];
+        for(size_t succ : cfg.succs[blockId]){
+            out.unite(liveIn[succ]);
+        }
+        if(liveIn[blockId].assign(uses[blockId], out, defs[blockId])){
+            for(size_t pred : cfg.preds[blockId]){
+                if(!queued[pred]){
+                    queued[pred] = true;
+                    worklist.push_back(pred);
+                }
+            }
+        }
+    }
+}
+
+std::optional<size_t> IR::Liveness::idOf(IR::index_t value) const{
+    std::unordered_map<IR::index_t, size_t>::const_iterator id = valueId.find(value);
+    if(id == valueId.end()){
+        return std::nullopt;
+    }
+    return id->second;
+}
+
+bool IR::Liveness::isLiveIn(size_t blockId, IR::index_t value) const{
+    std::optional<size_t> id = idOf(value);
+    return id && liveIn[blockId].contains(*id);
+}
+
+bool IR::Liveness::isLiveOut(size_t blockId, IR::index_t value) const{
+    std::optional<size_t> id = idOf(value);
+    return id && liveOut[blockId].contains(*id);
+}
@@ -0,0 +1,210 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <LoadForwardPass.hpp>
+#include <CallGraph.hpp>
+#include <LoopInfo.hpp>
+#include <SideEffects.hpp>
+
+#include <set>
+#include <algorithm>
+#include <limits>
+
+const IR::index_t LoadForwardPass::pendingBase = std::numeric_limits<IR::index_t>::max() / 2;
+
+void LoadForwardPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    IR::SideEffects sideEffects(funcMap);
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        IR::CFG cfg(funcPair.second);
+        IR::LoopInfo loopInfo(cfg);
+        IR::AliasAnalysis aliasAnalysis(funcPair.second);
+
+        // Calls to functions that may write memory of caller
+        std::set<IR::index_t> clobberCalls;
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            if(sideEffects.of(link.funcName).writesMemory){
+                clobberCalls.insert(link.callIndex);
+            }
+        }
+
+        // Addresses stored in each loop
+        std::vector<std::vector<IR::index_t>> loopStores(loopInfo.loops.size());
+        std::vector<bool> loopClobbers(loopInfo.loops.size(), false);
+        for(size_t loopId = 0; loopId < loopInfo.loops.size(); ++loopId){
+            for(size_t blockId : loopInfo.loops[loopId].blocks){
+                for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+                    if(std::holds_alternative<IR::Store>(instr)){
+                        loopStores[loopId].push_back(std::get<IR::Store>(instr).operand2);
+                    }else if(clobberCalls.contains(IR::getInstrIndex(instr))){
+                        loopClobbers[loopId] = true;
+                    }
+                }
+            }
+        }
+
+        // Blocks in reverse post-order, so that states of forward predecessors are ready
+        std::vector<MemoryState> exitStates(cfg.blocks.size());
+        std::set<IR::index_t> removedSet;
+        for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+            std::shared_ptr<IR::BasicBlock>& block = cfg.blocks[blockId];
+            std::vector<MemoryState*> predStates;
+            bool isHeader = false;
+            for(size_t pred : cfg.preds[blockId]){
+                if(cfg.dominates(blockId, pred)){
+                    isHeader = true;
+                }else{
+                    predStates.push_back(&exitStates[pred]);
+                }
+            }
+            MemoryState state;
+            if(isHeader){
+                // Values stored in loop are unknown at the header
+                if(predStates.size() == 1){
+                    state = *predStates[0];
+                    for(size_t loopId = 0; loopId < loopInfo.loops.size(); ++loopId){
+                        if(loopInfo.loops[loopId].header != blockId){
+                            continue;
+                        }
+                        if(loopClobbers[loopId]){
+                            state.clear();
+                        }
+                        std::erase_if(state, [&](const std::pair<const IR::index_t, IR::index_t>& entry){
+                            return std::any_of(loopStores[loopId].begin(), loopStores[loopId].end(), [&](IR::index_t address){
+                                return aliasAnalysis.mayAlias(entry.first, address);
+                            });
+                        });
+                    }
+                }
+            }else if(predStates.size() == 1){
+                state = *predStates[0];
+            }else if(predStates.size() > 1){
+                state = joinStates(block, predStates);
+            }
+
+            for(IR::Instrction& instrRef : block->instructions){
+                IR::forEachOperand(instrRef, [this](IR::index_t& operand){
+                    replace(operand);
+                });
+                if(std::holds_alternative<IR::Load>(instrRef)){
+                    IR::Load& instr = std::get<IR::Load>(instrRef);
+                    IR::index_t address = addressOf(aliasAnalysis, instr.operand);
+                    MemoryState::iterator it = state.find(address);
+                    if(it != state.end()){
+                        forward[instr.index] = resolve(it->second);
+                        removedSet.insert(instr.index);
+                    }else{
+                        state[address] = instr.index;
+                    }
+                }else if(std::holds_alternative<IR::Store>(instrRef)){
+                    IR::Store& instr = std::get<IR::Store>(instrRef);
+                    IR::index_t address = addressOf(aliasAnalysis, instr.operand2);
+                    std::erase_if(state, [&](const std::pair<const IR::index_t, IR::index_t>& entry){
+                        return aliasAnalysis.mayAlias(entry.first, address);
+                    });
+                    // Registers may be changed before the load
+                    if(instr.operand1 > IR::Register::rval){
+                        state[address] = instr.operand1;
+                    }
+                }else if(clobberCalls.contains(IR::getInstrIndex(instrRef))){
+                    state.clear();
+                }
+            }
+            exitStates[blockId] = std::move(state);
+        }
+
+        // Phi for the memory values used by loads
+        for(MemoryPhi& memoryPhi : pendingPhis){
+            if(memoryPhi.phi){
+                memoryPhi.block->instructions.insert(memoryPhi.block->instructions.begin(), *memoryPhi.phi);
+            }
+        }
+        // Operands from back edges and call parameters
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            std::erase_if(block->instructions, [&removedSet](IR::Instrction& instr){
+                return removedSet.contains(IR::getInstrIndex(instr));
+            });
+            for(IR::Instrction& instr : block->instructions){
+                IR::forEachOperand(instr, [this](IR::index_t& operand){
+                    replace(operand);
+                });
+            }
+        }
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            for(std::pair<SymbolId, IR::index_t>& param : link.params){
+                replace(param.second);
+            }
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            IR::relinkBranch(block);
+        }
+        pendingPhis.clear();
+        forward.clear();
+        locationMap.clear();
+    }
+}
+
+IR::index_t LoadForwardPass::addressOf(const IR::AliasAnalysis& aliasAnalysis, IR::index_t address){
+    IR::AliasAnalysis::Location location = aliasAnalysis.locate(address);
+    if(location.kind == IR::AliasAnalysis::Location::Kind::Unknown || !location.offset
+        || (location.kind == IR::AliasAnalysis::Location::Kind::Array && !location.element)
+    ){
+        return address;
+    }
+    return locationMap.emplace(std::make_tuple(location.kind, *location.offset, location.element.value_or(0)), address).first->second;
+}
+
+LoadForwardPass::MemoryState LoadForwardPass::joinStates(const std::shared_ptr<IR::BasicBlock>& block, const std::vector<MemoryState*>& states){
+    MemoryState result;
+    for(const std::pair<const IR::index_t, IR::index_t>& entry : *states[0]){
+        bool isSame = true;
+        bool isKnown = true;
+        for(size_t i = 1; i < states.size(); ++i){
+            MemoryState::iterator it = states[i]->find(entry.first);
+            if(it == states[i]->end()){
+                isKnown = false;
+                break;
+            }
+            isSame = isSame && (it->second == entry.second);
+        }
+        if(!isKnown){
+            continue;
+        }
+        if(isSame){
+            result[entry.first] = entry.second;
+        }else if(states.size() == 2){
+            // Operands are in the order of predecessors
+            result[entry.first] = pendingBase + pendingPhis.size();
+            pendingPhis.emplace_back(MemoryPhi {block, entry.second, states[1]->at(entry.first), std::nullopt});
+        }
+    }
+    return result;
+}
+
+IR::index_t LoadForwardPass::resolve(IR::index_t value){
+    if(value < pendingBase){
+        return value;
+    }
+    size_t pendingId = value - pendingBase;
+    if(!pendingPhis[pendingId].phi){
+        // Index is taken now, the instruction is inserted after all blocks are visited
+        IR::index_t operand1 = resolve(pendingPhis[pendingId].operand1);
+        IR::index_t operand2 = resolve(pendingPhis[pendingId].operand2);
+        pendingPhis[pendingId].phi.emplace(operand1, operand2);
+    }
+    return pendingPhis[pendingId].phi->index;
+}
+
+void LoadForwardPass::replace(IR::index_t& operand){
+    std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(operand);
+    while(it != forward.end()){
+        operand = it->second;
+        it = forward.find(operand);
+    }
+}
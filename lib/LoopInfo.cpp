@@ -0,0 +1,85 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <LoopInfo.hpp>
+
+#include <stack>
+#include <limits>
+#include <algorithm>
+
+const size_t IR::LoopInfo::noLoop = std::numeric_limits<size_t>::max();
+
+IR::LoopInfo::LoopInfo(const IR::CFG& cfg){
+    // Headers in reverse post-order, so outer loops are found before inner ones
+    for(size_t header = 0; header < cfg.blocks.size(); ++header){
+        IR::Loop loop {header, {}, {}, std::vector<bool>(cfg.blocks.size(), false), noLoop, 1};
+        std::stack<size_t> workStack;
+        loop.contains[header] = true;
+        for(size_t pred : cfg.preds[header]){
+            if(cfg.dominates(header, pred)){
+                loop.latches.push_back(pred);
+                if(!loop.contains[pred]){
+                    loop.contains[pred] = true;
+                    workStack.push(pred);
+                }
+            }
+        }
+        if(loop.latches.empty()){
+            continue;
+        }
+        while(!workStack.empty()){
+            size_t blockId = workStack.top();
+            workStack.pop();
+            for(size_t pred : cfg.preds[blockId]){
+                if(!loop.contains[pred]){
+                    loop.contains[pred] = true;
+                    workStack.push(pred);
+                }
+            }
+        }
+        for(size_t blockId = header; blockId < cfg.blocks.size(); ++blockId){
+            if(loop.contains[blockId]){
+                loop.blocks.push_back(blockId);
+            }
+        }
+        loops.emplace_back(std::move(loop));
+    }
+
+    // Nesting: the parent is the innermost earlier loop containing the header
+    for(size_t id = 0; id < loops.size(); ++id){
+        for(size_t outer = id; outer-- > 0;){
+            if(loops[outer].contains[loops[id].header]){
+                loops[id].parent = outer;
+                loops[id].depth = loops[outer].depth + 1;
+                break;
+            }
+        }
+    }
+    loopOf.assign(cfg.blocks.size(), noLoop);
+    for(size_t id = 0; id < loops.size(); ++id){
+        for(size_t blockId : loops[id].blocks){
+            loopOf[blockId] = id;
+        }
+    }
+
+    // Reverse to put inner loops first
+    std::reverse(loops.begin(), loops.end());
+    size_t last = loops.size() - 1;
+    for(IR::Loop& loop : loops){
+        if(loop.parent != noLoop){
+            loop.parent = last - loop.parent;
+        }
+    }
+    for(size_t& id : loopOf){
+        if(id != noLoop){
+            id = last - id;
+        }
+    }
+}
+
+size_t IR::LoopInfo::depthOf(size_t blockId) const{
+    return (loopOf[blockId] == noLoop) ? 0 : loops[loopOf[blockId]].depth;
+}
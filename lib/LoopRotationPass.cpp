@@ -0,0 +1,257 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <LoopRotationPass.hpp>
+#include <CallGraph.hpp>
+
+#include <algorithm>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+void LoopRotationPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        // Blocks change with each rotated loop, so loops are found again until none is left
+        bool changed = true;
+        while(changed){
+            changed = false;
+            IR::CFG cfg(funcPair.second);
+            IR::LoopInfo loopInfo(cfg);
+            for(IR::Loop& loop : loopInfo.loops){
+                if(visited.contains(cfg.blocks[loop.header])){
+                    continue;
+                }
+                visited.insert(cfg.blocks[loop.header]);
+                if(canRotate(cfg, loop)){
+                    rotate(funcPair.second, cfg, loop);
+                    changed = true;
+                    break;
+                }
+            }
+            for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(funcPair.second).blocks){
+                IR::relinkBranch(block);
+            }
+        }
+        visited.clear();
+    }
+    IR::relinkCalls(funcMap);
+}
+
+bool LoopRotationPass::canRotate(const IR::CFG& cfg, const IR::Loop& loop){
+    // Header is entered from a single block, and exits to a block with no other entry
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+    if(cfg.preds[loop.header].size() != 2 || loop.latches.size() != 1 || header->instructions.empty()
+        || !header->branch || !header->fallThrough || header->fallThrough == header
+        || !cfg.blockId.contains(header->branch) || loop.contains[cfg.blockId.at(header->branch)]){
+        return false;
+    }
+    size_t exitId = cfg.blockId.at(header->branch);
+    if(std::any_of(cfg.preds[exitId].begin(), cfg.preds[exitId].end(), [&](size_t pred){
+        return pred != loop.header && !cfg.dominates(exitId, pred);
+    })){
+        return false;
+    }
+    // Other blocks only leave loop by returning, so that header no longer dominating blocks after loop does no harm
+    for(size_t blockId : loop.blocks){
+        if(blockId != loop.header && std::any_of(cfg.succs[blockId].begin(), cfg.succs[blockId].end(), [&loop](size_t succ){
+            return !loop.contains[succ];
+        })){
+            return false;
+        }
+    }
+
+    // Latch only goes back to header, so the test can be put at its end
+    std::shared_ptr<IR::BasicBlock> latch = cfg.blocks[loop.latches[0]];
+    if(latch == header){
+        return false;
+    }
+    if(latch->branch){
+        if(latch->branch != header || latch->fallThrough || latch->instructions.empty()
+            || !std::holds_alternative<IR::Bra>(latch->instructions.back())){
+            return false;
+        }
+    }else if(latch->fallThrough != header){
+        return false;
+    }
+
+    // Header only computes values for the test, which can be copied
+    bool isTest = false;
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Bne&){ isTest = true; },
+        [&](IR::Beq&){ isTest = true; },
+        [&](IR::Ble&){ isTest = true; },
+        [&](IR::Blt&){ isTest = true; },
+        [&](IR::Bge&){ isTest = true; },
+        [&](IR::Bgt&){ isTest = true; },
+    }, header->instructions.back());
+    return isTest && std::all_of(header->instructions.begin(), std::prev(header->instructions.end()), [](const IR::Instrction& instr){
+        bool copyable = std::visit(overloaded {
+            [](const auto&){ return false; },
+            [](const IR::Nop&){ return true; },
+            [](const IR::Const&){ return true; },
+            [](const IR::Neg&){ return true; },
+            [](const IR::Add&){ return true; },
+            [](const IR::Sub&){ return true; },
+            [](const IR::Mul&){ return true; },
+            [](const IR::Div&){ return true; },
+            [](const IR::Cmp&){ return true; },
+            [](const IR::Adda&){ return true; },
+            [](const IR::Load&){ return true; },
+            [](const IR::Phi&){ return true; },
+        }, instr);
+        return copyable && !std::visit([](const auto& instr){ return instr.isImportant; }, instr);
+    });
+}
+
+void LoopRotationPass::rotate(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop){
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+    std::shared_ptr<IR::BasicBlock> latch = cfg.blocks[loop.latches[0]];
+    std::shared_ptr<IR::BasicBlock> preheader = cfg.blocks[cfg.preds[loop.header][0]];
+    std::shared_ptr<IR::BasicBlock> exit = header->branch;
+    IR::Instrction test = header->instructions.back();
+    header->instructions.pop_back();
+
+    // Values of header on entry and on back edge
+    std::unordered_map<IR::index_t, IR::index_t> entryValues;
+    std::unordered_map<IR::index_t, IR::index_t> backValues;
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            entryValues[phi.index] = phi.operand1;
+            backValues[phi.index] = phi.operand2;
+        }
+    }
+
+    // Guard runs the test on entry values, and the latch on back edge values
+    std::shared_ptr<IR::BasicBlock> guard = std::make_shared<IR::BasicBlock>();
+    if(latch->branch){
+        latch->instructions.pop_back();
+    }
+    auto valueOf = [](std::unordered_map<IR::index_t, IR::index_t>& values, IR::index_t index){
+        return values.contains(index) ? values[index] : index;
+    };
+    auto copyTo = [](std::vector<IR::Instrction>& instrs, const IR::Instrction& instr, std::unordered_map<IR::index_t, IR::index_t>& values){
+        IR::Instrction& newInstr = instrs.emplace_back(IR::cloneInstr(instr));
+        IR::forEachOperand(newInstr, [&values](IR::index_t& operand){
+            if(values.contains(operand)){
+                operand = values[operand];
+            }
+        });
+        values[IR::getInstrIndex(instr)] = IR::getInstrIndex(newInstr);
+    };
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr) || std::holds_alternative<IR::Nop>(instr)){
+            continue;
+        }
+        copyTo(guard->instructions, instr, entryValues);
+        // Constants in header dominate latch
+        if(!std::holds_alternative<IR::Const>(instr)){
+            copyTo(latch->instructions, instr, backValues);
+        }
+    }
+    IR::index_t cmp = 0;
+    IR::Instrction guardTest = IR::cloneInstr(test);
+    IR::Instrction backTest = IR::Nop();
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Bne& instr){ cmp = instr.operand1; backTest = IR::Beq(valueOf(backValues, cmp), 0); },
+        [&](IR::Beq& instr){ cmp = instr.operand1; backTest = IR::Bne(valueOf(backValues, cmp), 0); },
+        [&](IR::Ble& instr){ cmp = instr.operand1; backTest = IR::Bgt(valueOf(backValues, cmp), 0); },
+        [&](IR::Blt& instr){ cmp = instr.operand1; backTest = IR::Bge(valueOf(backValues, cmp), 0); },
+        [&](IR::Bge& instr){ cmp = instr.operand1; backTest = IR::Blt(valueOf(backValues, cmp), 0); },
+        [&](IR::Bgt& instr){ cmp = instr.operand1; backTest = IR::Ble(valueOf(backValues, cmp), 0); },
+    }, test);
+    IR::forEachOperand(guardTest, [&](IR::index_t& operand){
+        if(operand == cmp){
+            operand = valueOf(entryValues, cmp);
+        }
+    });
+    guard->instructions.emplace_back(guardTest);
+    latch->instructions.emplace_back(backTest);
+
+    // Exit is entered from latch by fall-through, then from guard by branch
+    std::shared_ptr<IR::BasicBlock> join = std::make_shared<IR::BasicBlock>();
+    std::unordered_map<IR::index_t, IR::index_t> exitValues;
+    for(IR::Instrction& instr : header->instructions){
+        IR::index_t index = IR::getInstrIndex(instr);
+        if(std::holds_alternative<IR::Nop>(instr)){
+            continue;
+        }else if(std::holds_alternative<IR::Const>(instr)){
+            exitValues[index] = IR::getInstrIndex(join->instructions.emplace_back(IR::cloneInstr(instr)));
+        }else{
+            exitValues[index] = IR::getInstrIndex(join->instructions.emplace_back(IR::Phi(backValues[index], entryValues[index])));
+        }
+    }
+    if(join->instructions.empty()){
+        join->instructions.emplace_back(IR::Nop());
+    }
+
+    // Values computed in header are merged from guard and latch, keeping their indices for uses in body
+    std::vector<IR::Instrction> headerInstrs;
+    std::vector<IR::Instrction> constants;
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            headerInstrs.emplace_back(instr);
+        }else if(std::holds_alternative<IR::Const>(instr)){
+            constants.emplace_back(instr);
+        }else if(!std::holds_alternative<IR::Nop>(instr)){
+            IR::Phi phi(entryValues[IR::getInstrIndex(instr)], backValues[IR::getInstrIndex(instr)]);
+            phi.index = IR::getInstrIndex(instr);
+            headerInstrs.emplace_back(phi);
+        }
+    }
+    headerInstrs.insert(headerInstrs.end(), constants.begin(), constants.end());
+    if(headerInstrs.empty()){
+        headerInstrs.emplace_back(IR::Nop());
+    }
+    header->instructions = headerInstrs;
+
+    // Edges
+    if(preheader->fallThrough == header){
+        preheader->fallThrough = guard;
+    }else{
+        preheader->branch = guard;
+    }
+    guard->fallThrough = header;
+    guard->branch = join;
+    guard->dominator = preheader;
+    header->dominator = guard;
+    header->branch = nullptr;
+    latch->fallThrough = join;
+    latch->branch = header;
+    join->fallThrough = exit;
+    join->dominator = guard;
+    exit->dominator = join;
+
+    // Values of header used after loop
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        if(loop.contains[blockId]){
+            continue;
+        }
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            IR::forEachOperand(instr, [&exitValues](IR::index_t& operand){
+                if(exitValues.contains(operand)){
+                    operand = exitValues[operand];
+                }
+            });
+        }
+    }
+    for(IR::FuncCallLink& link : entry->callLinks){
+        if(cfg.blockId.contains(link.block) && loop.contains[cfg.blockId.at(link.block)]){
+            continue;
+        }
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            if(exitValues.contains(param.second)){
+                param.second = exitValues[param.second];
+            }
+        }
+    }
+}
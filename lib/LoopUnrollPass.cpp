@@ -0,0 +1,553 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <LoopUnrollPass.hpp>
+#include <CallGraph.hpp>
+
+#include <algorithm>
+#include <limits>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+const size_t LoopUnrollPass::defaultFactor = 4;
+const size_t LoopUnrollPass::maxFullTrips = 16;
+const size_t LoopUnrollPass::sizeLimit = 256;
+
+LoopUnrollPass::LoopUnrollPass(size_t factor): factor(factor), fullyUnrolled(false){}
+
+void LoopUnrollPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        // Blocks change with each unrolled loop, so loops are found again until none is left
+        bool changed = true;
+        while(changed){
+            changed = false;
+            IR::CFG cfg(funcPair.second);
+            IR::LoopInfo loopInfo(cfg);
+            constants.clear();
+            for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+                for(IR::Instrction& instrRef : block->instructions){
+                    if(std::holds_alternative<IR::Const>(instrRef)){
+                        IR::Const& instr = std::get<IR::Const>(instrRef);
+                        constants[instr.index] = instr.value;
+                    }
+                }
+            }
+            for(size_t loopId = 0; loopId < loopInfo.loops.size() && !changed; ++loopId){
+                IR::Loop& loop = loopInfo.loops[loopId];
+                bool innermost = std::none_of(loopInfo.loops.begin(), loopInfo.loops.end(), [loopId](IR::Loop& inner){
+                    return inner.parent == loopId;
+                });
+                if(!innermost || visited.contains(cfg.blocks[loop.header])){
+                    continue;
+                }
+                visited.insert(cfg.blocks[loop.header]);
+                changed = unroll(funcPair.second, cfg, loop);
+            }
+            for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(funcPair.second).blocks){
+                IR::relinkBranch(block);
+            }
+        }
+        // Induction variables of copies are constants now
+        if(fullyUnrolled){
+            IR::foldConstants(funcPair.second);
+        }
+        fullyUnrolled = false;
+        visited.clear();
+        constants.clear();
+    }
+    IR::relinkCalls(funcMap);
+}
+
+bool LoopUnrollPass::unroll(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop){
+    // Loop is entered from a single block
+    std::shared_ptr<IR::BasicBlock> preheader;
+    for(size_t pred : cfg.preds[loop.header]){
+        if(!loop.contains[pred]){
+            if(preheader){
+                return false;
+            }
+            preheader = cfg.blocks[pred];
+        }
+    }
+    std::optional<Counter> counter = findCounter(cfg, loop);
+    if(!preheader || !counter){
+        return false;
+    }
+    size_t size = 0;
+    for(size_t blockId : loop.blocks){
+        size += cfg.blocks[blockId]->instructions.size();
+    }
+    std::optional<size_t> trips = tripCount(*counter);
+    if(trips && *trips * size <= sizeLimit){
+        unrollFully(entry, cfg, loop, preheader, *trips);
+        fullyUnrolled = true;
+        return true;
+    }
+
+    // Test of the last copy covers the earlier ones only if the exit condition is monotonic in the direction of step
+    IR::Operation exitOp = counter->exitOp;
+    if(counter->boundFirst){
+        switch(exitOp){
+            case IR::Operation::Bge: exitOp = IR::Operation::Ble; break;
+            case IR::Operation::Bgt: exitOp = IR::Operation::Blt; break;
+            case IR::Operation::Ble: exitOp = IR::Operation::Bge; break;
+            case IR::Operation::Blt: exitOp = IR::Operation::Bgt; break;
+            default: break;
+        }
+    }
+    bool monotonic = (counter->step > 0) ? (exitOp == IR::Operation::Bge || exitOp == IR::Operation::Bgt)
+        : (exitOp == IR::Operation::Ble || exitOp == IR::Operation::Blt);
+    if(factor < 2 || !monotonic || factor * size > sizeLimit){
+        return false;
+    }
+    // Bound of the first copy is moved back by the steps of other copies, which must not wrap around
+    int64_t distance = (int64_t)counter->step * (int64_t)(factor - 1);
+    if(distance < std::numeric_limits<int32_t>::min() || distance > std::numeric_limits<int32_t>::max()){
+        return false;
+    }
+    if(constants.contains(counter->bound)){
+        int64_t bound = (int64_t)constants[counter->bound] - distance;
+        if(bound < std::numeric_limits<int32_t>::min() || bound > std::numeric_limits<int32_t>::max()){
+            return false;
+        }
+    }
+    unrollPartially(entry, cfg, loop, preheader, *counter);
+    return true;
+}
+
+std::optional<LoopUnrollPass::Counter> LoopUnrollPass::findCounter(const IR::CFG& cfg, const IR::Loop& loop){
+    // Header ends with the only exit of loop, and the single latch goes back to it
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+    if(loop.latches.size() != 1 || header->instructions.empty() || !header->branch || !header->fallThrough
+        || header->fallThrough == header || !cfg.blockId.contains(header->branch) || loop.contains[cfg.blockId.at(header->branch)]){
+        return std::nullopt;
+    }
+    for(size_t blockId : loop.blocks){
+        if(blockId != loop.header && std::any_of(cfg.succs[blockId].begin(), cfg.succs[blockId].end(), [&loop](size_t succ){
+            return !loop.contains[succ];
+        })){
+            return std::nullopt;
+        }
+    }
+
+    std::unordered_map<IR::index_t, IR::Instrction*> loopDefs;
+    for(size_t blockId : loop.blocks){
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            loopDefs[IR::getInstrIndex(instr)] = &instr;
+        }
+    }
+    auto isInvariant = [&](IR::index_t operand){
+        return constants.contains(operand) || (operand != IR::Register::pc && operand != IR::Register::rval && !loopDefs.contains(operand));
+    };
+
+    Counter counter {0, 0, 0, 0, 0, false, IR::Operation::Nop};
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Bne& instr){ counter.cmp = instr.operand1; counter.exitOp = IR::Operation::Bne; },
+        [&](IR::Beq& instr){ counter.cmp = instr.operand1; counter.exitOp = IR::Operation::Beq; },
+        [&](IR::Ble& instr){ counter.cmp = instr.operand1; counter.exitOp = IR::Operation::Ble; },
+        [&](IR::Blt& instr){ counter.cmp = instr.operand1; counter.exitOp = IR::Operation::Blt; },
+        [&](IR::Bge& instr){ counter.cmp = instr.operand1; counter.exitOp = IR::Operation::Bge; },
+        [&](IR::Bgt& instr){ counter.cmp = instr.operand1; counter.exitOp = IR::Operation::Bgt; },
+    }, header->instructions.back());
+    if(!loopDefs.contains(counter.cmp) || !std::holds_alternative<IR::Cmp>(*loopDefs[counter.cmp])){
+        return std::nullopt;
+    }
+    IR::Cmp& cmp = std::get<IR::Cmp>(*loopDefs[counter.cmp]);
+
+    // Induction variable compared with an invariant bound
+    auto isPhi = [&](IR::index_t operand){
+        return std::any_of(header->instructions.begin(), header->instructions.end(), [operand](IR::Instrction& instr){
+            return std::holds_alternative<IR::Phi>(instr) && std::get<IR::Phi>(instr).index == operand;
+        });
+    };
+    if(isPhi(cmp.operand1) && isInvariant(cmp.operand2)){
+        counter.phi = cmp.operand1;
+        counter.bound = cmp.operand2;
+    }else if(isPhi(cmp.operand2) && isInvariant(cmp.operand1)){
+        counter.phi = cmp.operand2;
+        counter.bound = cmp.operand1;
+        counter.boundFirst = true;
+    }else{
+        return std::nullopt;
+    }
+    IR::Phi& phi = std::get<IR::Phi>(*loopDefs[counter.phi]);
+    counter.init = phi.operand1;
+    if(!isInvariant(phi.operand1) || !loopDefs.contains(phi.operand2)){
+        return std::nullopt;
+    }
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Add& instr){
+            if(instr.operand1 == phi.index && constants.contains(instr.operand2)){
+                counter.step = constants[instr.operand2];
+            }else if(instr.operand2 == phi.index && constants.contains(instr.operand1)){
+                counter.step = constants[instr.operand1];
+            }
+        },
+        [&](IR::Sub& instr){
+            if(instr.operand1 == phi.index && constants.contains(instr.operand2)){
+                counter.step = -constants[instr.operand2];
+            }
+        },
+    }, *loopDefs[phi.operand2]);
+    if(counter.step == 0){
+        return std::nullopt;
+    }
+    return counter;
+}
+
+bool LoopUnrollPass::exits(IR::Operation exitOp, int32_t cmpValue){
+    switch(exitOp){
+        case IR::Operation::Bne: return cmpValue != 0;
+        case IR::Operation::Beq: return cmpValue == 0;
+        case IR::Operation::Ble: return cmpValue <= 0;
+        case IR::Operation::Blt: return cmpValue < 0;
+        case IR::Operation::Bge: return cmpValue >= 0;
+        case IR::Operation::Bgt: return cmpValue > 0;
+        default: return false;
+    }
+}
+
+std::optional<size_t> LoopUnrollPass::tripCount(const Counter& counter){
+    if(!constants.contains(counter.init) || !constants.contains(counter.bound)){
+        return std::nullopt;
+    }
+    // Run the exit test, loops longer than the limit are not counted
+    int32_t value = constants[counter.init];
+    int32_t bound = constants[counter.bound];
+    for(size_t trips = 0; trips <= maxFullTrips; ++trips){
+        int32_t first = counter.boundFirst ? bound : value;
+        int32_t second = counter.boundFirst ? value : bound;
+        if(exits(counter.exitOp, (first > second) - (first < second))){
+            return trips;
+        }
+        value = (int32_t)((uint32_t)value + (uint32_t)counter.step);
+    }
+    return std::nullopt;
+}
+
+LoopUnrollPass::Iteration LoopUnrollPass::cloneIteration(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop,
+    const std::unordered_map<IR::index_t, IR::index_t>& phiValues)
+{
+    Iteration iteration {nullptr, nullptr, true, {}};
+    std::unordered_map<std::shared_ptr<IR::BasicBlock>, std::shared_ptr<IR::BasicBlock>> blockMap;
+    for(size_t blockId : loop.blocks){
+        std::shared_ptr<IR::BasicBlock> block = cfg.blocks[blockId];
+        std::shared_ptr<IR::BasicBlock> newBlock = std::make_shared<IR::BasicBlock>();
+        blockMap[block] = newBlock;
+        for(IR::Instrction& instr : block->instructions){
+            if(blockId == loop.header && (std::holds_alternative<IR::Phi>(instr) || &instr == &block->instructions.back())){
+                continue;
+            }
+            iteration.valueMap[IR::getInstrIndex(instr)] = IR::getInstrIndex(newBlock->instructions.emplace_back(IR::cloneInstr(instr)));
+        }
+    }
+    iteration.entry = blockMap[cfg.blocks[loop.header]];
+
+    // Edges inside the copy, the one back to header is left to caller
+    for(size_t blockId : loop.blocks){
+        std::shared_ptr<IR::BasicBlock> block = cfg.blocks[blockId];
+        std::shared_ptr<IR::BasicBlock>& newBlock = blockMap[block];
+        if(block->dominator && blockMap.contains(block->dominator)){
+            newBlock->dominator = blockMap[block->dominator];
+        }
+        if(blockId == loop.header){
+            newBlock->fallThrough = blockMap[block->fallThrough];
+            continue;
+        }
+        if(block->fallThrough == cfg.blocks[loop.header]){
+            iteration.latch = newBlock;
+            iteration.latchFallsThrough = true;
+        }else if(block->fallThrough){
+            newBlock->fallThrough = blockMap.contains(block->fallThrough) ? blockMap[block->fallThrough] : block->fallThrough;
+        }
+        if(block->branch == cfg.blocks[loop.header]){
+            iteration.latch = newBlock;
+            iteration.latchFallsThrough = false;
+        }else if(block->branch){
+            newBlock->branch = blockMap.contains(block->branch) ? blockMap[block->branch] : block->branch;
+        }
+        for(IR::Instrction& instr : newBlock->instructions){
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                if(iteration.valueMap.contains(operand)){
+                    operand = iteration.valueMap[operand];
+                }else if(phiValues.contains(operand)){
+                    operand = phiValues.at(operand);
+                }
+            });
+        }
+    }
+    for(IR::Instrction& instr : iteration.entry->instructions){
+        IR::forEachOperand(instr, [&](IR::index_t& operand){
+            if(iteration.valueMap.contains(operand)){
+                operand = iteration.valueMap[operand];
+            }else if(phiValues.contains(operand)){
+                operand = phiValues.at(operand);
+            }
+        });
+    }
+
+    // Calls in copy
+    size_t linkCount = entry->callLinks.size();
+    for(size_t i = 0; i < linkCount; ++i){
+        IR::FuncCallLink link = entry->callLinks[i];
+        if(!iteration.valueMap.contains(link.callIndex)){
+            continue;
+        }
+        link.callIndex = iteration.valueMap[link.callIndex];
+        link.block = blockMap[link.block];
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            if(iteration.valueMap.contains(param.second)){
+                param.second = iteration.valueMap[param.second];
+            }else if(phiValues.contains(param.second)){
+                param.second = phiValues.at(param.second);
+            }
+        }
+        if(link.resultIndex && iteration.valueMap.contains(*link.resultIndex)){
+            link.resultIndex = iteration.valueMap[*link.resultIndex];
+        }
+        entry->callLinks.emplace_back(link);
+    }
+    return iteration;
+}
+
+std::unordered_map<IR::index_t, IR::index_t> LoopUnrollPass::nextPhiValues(const IR::CFG& cfg, const IR::Loop& loop,
+    const Iteration& iteration, const std::unordered_map<IR::index_t, IR::index_t>& phiValues)
+{
+    std::unordered_map<IR::index_t, IR::index_t> nextValues;
+    for(IR::Instrction& instr : cfg.blocks[loop.header]->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            IR::index_t value = phi.operand2;
+            if(iteration.valueMap.contains(value)){
+                value = iteration.valueMap.at(value);
+            }else if(phiValues.contains(value)){
+                value = phiValues.at(value);
+            }
+            nextValues[phi.index] = value;
+        }
+    }
+    return nextValues;
+}
+
+void LoopUnrollPass::unrollFully(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop,
+    std::shared_ptr<IR::BasicBlock>& preheader, size_t trips)
+{
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+    std::shared_ptr<IR::BasicBlock> exit = header->branch;
+    std::unordered_map<IR::index_t, IR::index_t> phiValues;
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            phiValues[std::get<IR::Phi>(instr).index] = std::get<IR::Phi>(instr).operand1;
+        }
+    }
+    std::set<IR::index_t> loopDefs;
+    for(size_t blockId : loop.blocks){
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            loopDefs.insert(IR::getInstrIndex(instr));
+        }
+    }
+
+    // Copies are chained in place of loop
+    std::shared_ptr<IR::BasicBlock> last = preheader;
+    bool lastFallsThrough = (preheader->fallThrough == header);
+    auto connect = [&](const std::shared_ptr<IR::BasicBlock>& block){
+        if(lastFallsThrough){
+            last->fallThrough = block;
+        }else{
+            last->branch = block;
+        }
+        block->dominator = last;
+    };
+    for(size_t trip = 0; trip < trips; ++trip){
+        Iteration iteration = cloneIteration(entry, cfg, loop, phiValues);
+        connect(iteration.entry);
+        last = iteration.latch;
+        lastFallsThrough = iteration.latchFallsThrough;
+        phiValues = nextPhiValues(cfg, loop, iteration, phiValues);
+    }
+
+    // Header runs once more before the exit, only its values used after loop are kept by DCE
+    std::shared_ptr<IR::BasicBlock> tail = std::make_shared<IR::BasicBlock>();
+    std::unordered_map<IR::index_t, IR::index_t> outsideMap = phiValues;
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr) || &instr == &header->instructions.back()){
+            continue;
+        }
+        IR::Instrction& newInstr = tail->instructions.emplace_back(IR::cloneInstr(instr));
+        IR::forEachOperand(newInstr, [&outsideMap](IR::index_t& operand){
+            if(outsideMap.contains(operand)){
+                operand = outsideMap[operand];
+            }
+        });
+        outsideMap[IR::getInstrIndex(instr)] = IR::getInstrIndex(newInstr);
+    }
+    if(tail->instructions.empty()){
+        tail->instructions.emplace_back(IR::Nop());
+    }
+    connect(tail);
+    tail->fallThrough = exit;
+    exit->dominator = tail;
+
+    // Values of header used after loop
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        if(loop.contains[blockId]){
+            continue;
+        }
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            IR::forEachOperand(instr, [&outsideMap](IR::index_t& operand){
+                if(outsideMap.contains(operand)){
+                    operand = outsideMap[operand];
+                }
+            });
+        }
+    }
+    std::erase_if(entry->callLinks, [&loopDefs](IR::FuncCallLink& link){
+        return loopDefs.contains(link.callIndex);
+    });
+    for(IR::FuncCallLink& link : entry->callLinks){
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            if(outsideMap.contains(param.second)){
+                param.second = outsideMap[param.second];
+            }
+        }
+    }
+}
+
+void LoopUnrollPass::unrollPartially(std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, const IR::Loop& loop,
+    std::shared_ptr<IR::BasicBlock>& preheader, const Counter& counter)
+{
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+
+    // Bound of the first copy, so that the test covers all copies of an iteration. Constant bound is known
+    // not to wrap around, other bounds are tested by a guard that leaves all iterations to the original loop
+    int32_t distance = counter.step * (int32_t)(factor - 1);
+    IR::index_t bound;
+    std::shared_ptr<IR::BasicBlock> guard;
+    if(constants.contains(counter.bound)){
+        std::vector<IR::Instrction>::iterator position = preheader->instructions.end();
+        if(preheader->branch && !preheader->instructions.empty()){
+            position = std::prev(position);
+        }
+        bound = IR::getInstrIndex(*preheader->instructions.insert(position, IR::Const(constants[counter.bound] - distance)));
+    }else{
+        guard = std::make_shared<IR::BasicBlock>();
+        IR::index_t distanceIndex = IR::getInstrIndex(guard->instructions.emplace_back(IR::Const(distance)));
+        bound = IR::getInstrIndex(guard->instructions.emplace_back(IR::Sub(counter.bound, distanceIndex)));
+        int32_t limit = (counter.step > 0) ? (std::numeric_limits<int32_t>::min() + distance) : (std::numeric_limits<int32_t>::max() + distance);
+        IR::index_t limitIndex = IR::getInstrIndex(guard->instructions.emplace_back(IR::Const(limit)));
+        IR::index_t wraps = IR::getInstrIndex(guard->instructions.emplace_back(IR::Cmp(counter.bound, limitIndex)));
+        if(counter.step > 0){
+            guard->instructions.emplace_back(IR::Blt(wraps, 0));
+        }else{
+            guard->instructions.emplace_back(IR::Bgt(wraps, 0));
+        }
+    }
+
+    // Phi of unrolled loop
+    std::vector<IR::Instrction> phis;
+    std::unordered_map<IR::index_t, IR::index_t> phiValues;
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            phiValues[phi.index] = IR::getInstrIndex(phis.emplace_back(IR::Phi(phi.operand1, 0)));
+        }
+    }
+    std::unordered_map<IR::index_t, IR::index_t> headerPhis = phiValues;
+
+    // The first copy tests the exit condition, and leaves to the original loop
+    Iteration first = cloneIteration(entry, cfg, loop, phiValues);
+    std::shared_ptr<IR::BasicBlock> newHeader = first.entry;
+    for(IR::Instrction& instr : newHeader->instructions){
+        if(IR::getInstrIndex(instr) == first.valueMap[counter.cmp]){
+            IR::Cmp& cmp = std::get<IR::Cmp>(instr);
+            (counter.boundFirst ? cmp.operand1 : cmp.operand2) = bound;
+        }
+    }
+    IR::Instrction exitTest = IR::cloneInstr(header->instructions.back());
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Bne& instr){ instr.operand1 = first.valueMap[counter.cmp]; },
+        [&](IR::Beq& instr){ instr.operand1 = first.valueMap[counter.cmp]; },
+        [&](IR::Ble& instr){ instr.operand1 = first.valueMap[counter.cmp]; },
+        [&](IR::Blt& instr){ instr.operand1 = first.valueMap[counter.cmp]; },
+        [&](IR::Bge& instr){ instr.operand1 = first.valueMap[counter.cmp]; },
+        [&](IR::Bgt& instr){ instr.operand1 = first.valueMap[counter.cmp]; },
+    }, exitTest);
+    newHeader->instructions.insert(newHeader->instructions.begin(), phis.begin(), phis.end());
+    newHeader->instructions.emplace_back(exitTest);
+    newHeader->branch = header;
+    newHeader->dominator = preheader;
+    header->dominator = newHeader;
+    std::shared_ptr<IR::BasicBlock> loopEntry = newHeader;
+    if(guard){
+        guard->fallThrough = newHeader;
+        guard->dominator = preheader;
+        newHeader->dominator = guard;
+        loopEntry = guard;
+    }
+    if(preheader->fallThrough == header){
+        preheader->fallThrough = loopEntry;
+    }else{
+        preheader->branch = loopEntry;
+    }
+
+    // Other copies follow without test
+    std::shared_ptr<IR::BasicBlock> last = first.latch;
+    bool lastFallsThrough = first.latchFallsThrough;
+    phiValues = nextPhiValues(cfg, loop, first, phiValues);
+    for(size_t copy = 1; copy < factor; ++copy){
+        Iteration iteration = cloneIteration(entry, cfg, loop, phiValues);
+        (lastFallsThrough ? last->fallThrough : last->branch) = iteration.entry;
+        iteration.entry->dominator = last;
+        last = iteration.latch;
+        lastFallsThrough = iteration.latchFallsThrough;
+        phiValues = nextPhiValues(cfg, loop, iteration, phiValues);
+    }
+    (lastFallsThrough ? last->fallThrough : last->branch) = newHeader;
+
+    // Back edge values of unrolled loop, and the original loop starts from where it stopped
+    for(IR::Instrction& instr : newHeader->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            for(std::pair<const IR::index_t, IR::index_t>& headerPhi : headerPhis){
+                if(headerPhi.second == phi.index){
+                    phi.operand2 = phiValues[headerPhi.first];
+                }
+            }
+        }
+    }
+    // Original loop is entered from guard and from unrolled loop, both by branch
+    std::shared_ptr<IR::BasicBlock> join;
+    if(guard){
+        join = std::make_shared<IR::BasicBlock>();
+        guard->branch = join;
+        newHeader->branch = join;
+        join->fallThrough = header;
+        join->dominator = guard;
+        header->dominator = join;
+    }
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            if(join){
+                phi.operand1 = IR::getInstrIndex(join->instructions.emplace_back(IR::Phi(phi.operand1, headerPhis[phi.index])));
+            }else{
+                phi.operand1 = headerPhis[phi.index];
+            }
+        }
+    }
+    if(join && join->instructions.empty()){
+        join->instructions.emplace_back(IR::Nop());
+    }
+    visited.insert(newHeader);
+}
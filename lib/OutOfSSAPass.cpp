@@ -0,0 +1,295 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <OutOfSSAPass.hpp>
+#include <CallGraph.hpp>
+
+#include <algorithm>
+
+void OutOfSSAPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(funcPair.second->root){
+            translate(funcPair.second);
+        }
+    }
+    IR::relinkCalls(funcMap);
+}
+
+OutOfSSAPass::Interference::Interference(const IR::CFG& cfg): liveness(cfg){
+    lastUse.resize(cfg.blocks.size());
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        std::vector<IR::Instrction>& instrs = cfg.blocks[blockId]->instructions;
+        for(size_t pos = 0; pos < instrs.size(); ++pos){
+            IR::index_t index = IR::getInstrIndex(instrs[pos]);
+            defBlock[index] = blockId;
+            if(std::holds_alternative<IR::Phi>(instrs[pos])){
+                defPos[index] = -1;
+                continue;
+            }
+            defPos[index] = pos;
+            IR::forEachOperand(instrs[pos], [&](IR::index_t& operand){
+                lastUse[blockId][operand] = pos;
+            });
+        }
+    }
+}
+
+bool OutOfSSAPass::Interference::liveAt(IR::index_t value, size_t blockId, int pos) const{
+    // Defined before pos, and used after it
+    std::unordered_map<IR::index_t, size_t>::const_iterator def = defBlock.find(value);
+    if(!liveness.isLiveIn(blockId, value) && (def == defBlock.end() || def->second != blockId || defPos.at(value) > pos)){
+        return false;
+    }
+    if(liveness.isLiveOut(blockId, value)){
+        return true;
+    }
+    std::unordered_map<IR::index_t, int>::const_iterator use = lastUse[blockId].find(value);
+    return use != lastUse[blockId].end() && use->second > pos;
+}
+
+bool OutOfSSAPass::Interference::interfere(IR::index_t value1, IR::index_t value2) const{
+    // In SSA form, two values interfere only if one is live at the definition of the other
+    if(!defBlock.contains(value1) || !defBlock.contains(value2)){
+        return true;
+    }
+    return liveAt(value1, defBlock.at(value2), defPos.at(value2)) || liveAt(value2, defBlock.at(value1), defPos.at(value1));
+}
+
+IR::index_t OutOfSSAPass::find(IR::index_t value){
+    std::unordered_map<IR::index_t, IR::index_t>::iterator it = parent.find(value);
+    if(it == parent.end() || it->second == value){
+        return value;
+    }
+    IR::index_t root = find(it->second);
+    parent[value] = root;
+    return root;
+}
+
+IR::index_t OutOfSSAPass::representative(IR::index_t value){
+    // Value computed by an instruction keeps its index, otherwise the variable is named after a Phi
+    IR::index_t root = find(value);
+    if(!members.contains(root)){
+        return root;
+    }
+    for(IR::index_t member : members[root]){
+        if(!phis.contains(member)){
+            return member;
+        }
+    }
+    return root;
+}
+
+bool OutOfSSAPass::tryMerge(IR::index_t value1, IR::index_t value2, const Interference& interference, const std::unordered_map<IR::index_t, size_t>& phiBlock){
+    IR::index_t root1 = find(value1);
+    IR::index_t root2 = find(value2);
+    if(root1 == root2){
+        return true;
+    }
+    if(!interference.defBlock.contains(value1) || !interference.defBlock.contains(value2)){
+        return false;
+    }
+    std::vector<IR::index_t> members1 = members.contains(root1) ? members[root1] : std::vector<IR::index_t> {root1};
+    std::vector<IR::index_t> members2 = members.contains(root2) ? members[root2] : std::vector<IR::index_t> {root2};
+
+    // At most one value computed by an instruction, since its index can't be renamed
+    size_t computed = std::count_if(members1.begin(), members1.end(), [&](IR::index_t member){ return !phis.contains(member); })
+        + std::count_if(members2.begin(), members2.end(), [&](IR::index_t member){ return !phis.contains(member); });
+    if(computed > 1){
+        return false;
+    }
+    for(IR::index_t member1 : members1){
+        for(IR::index_t member2 : members2){
+            // Phi in the same block are copied on the same edges
+            if(phiBlock.contains(member1) && phiBlock.contains(member2) && phiBlock.at(member1) == phiBlock.at(member2)){
+                return false;
+            }
+            if(interference.interfere(member1, member2)){
+                return false;
+            }
+        }
+    }
+    parent[root2] = root1;
+    members1.insert(members1.end(), members2.begin(), members2.end());
+    members[root1] = members1;
+    members.erase(root2);
+    return true;
+}
+
+void OutOfSSAPass::coalesce(const IR::CFG& cfg, const Interference& interference){
+    // Copies on edges in deeper loops are removed first
+    struct Candidate{
+        size_t depth;
+        IR::index_t phi;
+        IR::index_t operand;
+    };
+    IR::LoopInfo loopInfo(cfg);
+    std::vector<Candidate> candidates;
+    std::unordered_map<IR::index_t, size_t> phiBlock;
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        const std::vector<size_t>& preds = cfg.preds[blockId];
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            if(!std::holds_alternative<IR::Phi>(instr)){
+                continue;
+            }
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            phis.insert(phi.index);
+            phiBlock[phi.index] = blockId;
+            if(preds.size() > 0){
+                candidates.emplace_back(Candidate {loopInfo.depthOf(preds[0]), phi.index, phi.operand1});
+            }
+            if(preds.size() > 1){
+                candidates.emplace_back(Candidate {loopInfo.depthOf(preds[1]), phi.index, phi.operand2});
+            }
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& candidate1, const Candidate& candidate2){
+        return candidate1.depth > candidate2.depth;
+    });
+    for(Candidate& candidate : candidates){
+        tryMerge(candidate.phi, candidate.operand, interference, phiBlock);
+    }
+}
+
+std::shared_ptr<IR::BasicBlock> OutOfSSAPass::splitEdge(const std::shared_ptr<IR::BasicBlock>& pred, const std::shared_ptr<IR::BasicBlock>& succ){
+    std::shared_ptr<IR::BasicBlock> block = std::make_shared<IR::BasicBlock>();
+    block->dominator = pred;
+    if(pred->fallThrough == succ){
+        block->instructions.emplace_back(IR::Nop());
+        block->fallThrough = succ;
+        pred->fallThrough = block;
+        // Both ways go to the same block
+        if(pred->branch == succ){
+            pred->branch = block;
+            succ->dominator = block;
+        }
+    }else{
+        block->instructions.emplace_back(IR::Bra(IR::getInstrIndex(succ->instructions.front())));
+        block->branch = succ;
+        pred->branch = block;
+    }
+    return block;
+}
+
+std::vector<IR::Instrction> OutOfSSAPass::sequentialize(const ParallelCopy& copies){
+    // Copies to locations not read by other copies are ready, and a cycle of copies is broken by saving
+    // one location to a temporary, which is a Move to its own index
+    std::vector<IR::Instrction> instrs;
+    std::unordered_map<IR::index_t, IR::index_t> loc;
+    std::unordered_map<IR::index_t, IR::index_t> pred;
+    std::unordered_set<IR::index_t> done;
+    std::vector<IR::index_t> ready;
+    std::vector<IR::index_t> todo;
+    auto emit = [&instrs](IR::index_t dest, IR::index_t src) -> IR::Move& {
+        IR::Move& move = std::get<IR::Move>(instrs.emplace_back(IR::Move(dest, src)));
+        move.isImportant = true;
+        return move;
+    };
+    for(const std::pair<IR::index_t, IR::index_t>& copy : copies){
+        loc[copy.second] = copy.second;
+        pred[copy.first] = copy.second;
+        todo.emplace_back(copy.first);
+    }
+    for(const std::pair<IR::index_t, IR::index_t>& copy : copies){
+        if(!loc.contains(copy.first)){
+            ready.emplace_back(copy.first);
+        }
+    }
+    while(!todo.empty()){
+        while(!ready.empty()){
+            IR::index_t dest = ready.back();
+            ready.pop_back();
+            IR::index_t src = pred[dest];
+            IR::index_t current = loc[src];
+            emit(dest, current);
+            done.insert(dest);
+            loc[src] = dest;
+            if(src == current && pred.contains(src) && !done.contains(src)){
+                ready.emplace_back(src);
+            }
+        }
+        IR::index_t dest = todo.back();
+        todo.pop_back();
+        if(!done.contains(dest)){
+            IR::Move& save = emit(0, dest);
+            save.operand1 = save.index;
+            loc[dest] = save.index;
+            ready.emplace_back(dest);
+        }
+    }
+    return instrs;
+}
+
+void OutOfSSAPass::translate(const std::shared_ptr<IR::FuncEntry>& entry){
+    parent.clear();
+    members.clear();
+    phis.clear();
+    IR::CFG cfg(entry);
+    coalesce(cfg, Interference(cfg));
+
+    // Copies of Phi on edges from predecessors, in operand order
+    std::vector<std::pair<std::shared_ptr<IR::BasicBlock>, std::vector<std::pair<std::shared_ptr<IR::BasicBlock>, ParallelCopy>>>> edgeCopies;
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        std::shared_ptr<IR::BasicBlock>& block = cfg.blocks[blockId];
+        std::vector<std::pair<std::shared_ptr<IR::BasicBlock>, ParallelCopy>> edges;
+        for(size_t pred : cfg.preds[blockId]){
+            edges.emplace_back(cfg.blocks[pred], ParallelCopy());
+        }
+        size_t phiCount = std::erase_if(block->instructions, [&](IR::Instrction& instr){
+            if(!std::holds_alternative<IR::Phi>(instr)){
+                return false;
+            }
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            IR::index_t dest = representative(phi.index);
+            IR::index_t operands[2] = {phi.operand1, phi.operand2};
+            for(size_t edge = 0; edge < edges.size() && edge < 2; ++edge){
+                IR::index_t src = representative(operands[edge]);
+                if(src != dest){
+                    edges[edge].second.emplace_back(dest, src);
+                }
+            }
+            return true;
+        });
+        if(phiCount > 0){
+            if(block->instructions.empty()){
+                block->instructions.emplace_back(IR::Nop());
+            }
+            edgeCopies.emplace_back(block, edges);
+        }
+    }
+
+    // Values in the same variable share one name
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            IR::forEachOperand(instr, [this](IR::index_t& operand){
+                operand = representative(operand);
+            });
+        }
+    }
+    for(IR::FuncCallLink& link : entry->callLinks){
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            param.second = representative(param.second);
+        }
+    }
+
+    // Copies go before the jump at the end of predecessor, or to a new block on a critical edge
+    for(std::pair<std::shared_ptr<IR::BasicBlock>, std::vector<std::pair<std::shared_ptr<IR::BasicBlock>, ParallelCopy>>>& blockPair : edgeCopies){
+        for(std::pair<std::shared_ptr<IR::BasicBlock>, ParallelCopy>& edge : blockPair.second){
+            if(edge.second.empty()){
+                continue;
+            }
+            std::shared_ptr<IR::BasicBlock> block = edge.first;
+            if(block->branch && block->fallThrough){
+                block = splitEdge(block, blockPair.first);
+            }
+            std::vector<IR::Instrction> moves = sequentialize(edge.second);
+            block->instructions.insert(block->branch ? std::prev(block->instructions.end()) : block->instructions.end(), moves.begin(), moves.end());
+        }
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+        IR::relinkBranch(block);
+    }
+}
@@ -143,7 +143,9 @@ bool Parser::Ident::parse(){
     Letter letterObj(source, passes);
     isSuccess = false;
     if(letterObj.parse()){
-        value = std::string({(char)letterObj.letter});
+        // Name is built in the buffer of source, and copied only when it is interned the first time
+        std::string& value = source.buffer();
+        value.assign(1, (char)letterObj.letter);
         Digit digitObj(source, passes);
         while(letterObj.parse() || digitObj.parse()){
             if(letterObj.isSuccess){
@@ -152,6 +154,7 @@ bool Parser::Ident::parse(){
                 value += (char) digitObj.digit;
             }
         }
+        symbol = Symbol::intern(value);
         isSuccess = true;
     }
     return runPassAfterParse(isSuccess, *this, passes);
@@ -0,0 +1,140 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <RegisterAllocPass.hpp>
+#include <CFG.hpp>
+#include <CallGraph.hpp>
+#include <Exception.hpp>
+
+#include <algorithm>
+
+const size_t RegisterAllocPass::defaultRegisters = 8;
+
+RegisterAllocPass::RegisterAllocPass(size_t registerCount): registerCount(registerCount){}
+
+void RegisterAllocPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(funcPair.second->root){
+            prepare(funcName, funcPair.second, funcMap);
+            allocate(funcName, funcPair.second);
+            finish(funcName, funcPair.second);
+        }
+    }
+    IR::relinkCalls(funcMap);
+}
+
+IR::index_t RegisterAllocPass::defOf(const IR::Instrction& instr){
+    return std::holds_alternative<IR::Move>(instr) ? std::get<IR::Move>(instr).operand1 : IR::getInstrIndex(instr);
+}
+
+void RegisterAllocPass::prepare(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry,
+    std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap
+){
+    slots.clear();
+    slotCount = 0;
+    unspillable.clear();
+    calleeFrames.clear();
+    frameConsts.clear();
+    slotBase = entry->frameSize;
+    IR::CFG cfg(entry);
+    for(IR::FuncCallLink& link : entry->callLinks){
+        // Calls left in unreachable blocks by earlier passes are never made
+        if(!cfg.blockId.contains(link.block)){
+            continue;
+        }
+        std::optional<IR::CallSite> site = IR::findCallSite(cfg, link);
+        if(!site){
+            // Tail call stores parameters into this frame, which must not overwrite slots before they are reloaded
+            if(!funcMap.contains(link.funcName) || !std::holds_alternative<IR::Bra>(link.block->instructions.back())
+                || IR::getInstrIndex(link.block->instructions.back()) != link.callIndex
+            ){
+                throw Exception(std::string("unknown call sequence in '") + funcName + "'");
+            }
+            slotBase = std::max(slotBase, funcMap[link.funcName]->frameSize);
+            continue;
+        }
+        calleeFrames.emplace_back(std::get<IR::StoreReg>(site->block->instructions[site->position - 1]).operand2, site->frameOffset);
+    }
+    // Return address is used after fp is restored, when slots can't be reached,
+    // so it is copied to a temporary kept in register before the restore
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        std::vector<IR::Instrction>& instrs = block->instructions;
+        for(size_t pos = 1; pos < instrs.size(); ++pos){
+            if(!std::holds_alternative<IR::StoreReg>(instrs[pos]) || std::get<IR::StoreReg>(instrs[pos]).operand1 != IR::Register::pc
+                || !std::holds_alternative<IR::StoreReg>(instrs[pos - 1]) || std::get<IR::StoreReg>(instrs[pos - 1]).operand1 != IR::Register::fp
+            ){
+                continue;
+            }
+            IR::Move copy(0, std::get<IR::StoreReg>(instrs[pos]).operand2);
+            copy.operand1 = copy.index;
+            copy.isImportant = true;
+            std::get<IR::StoreReg>(instrs[pos]).operand2 = copy.index;
+            unspillable.insert(copy.index);
+            instrs.insert(instrs.begin() + pos - 1, copy);
+            ++pos;
+        }
+    }
+}
+
+IR::index_t RegisterAllocPass::slotAddress(std::vector<IR::Instrction>& instrs, IR::index_t value){
+    IR::index_t offset = IR::getInstrIndex(instrs.emplace_back(IR::Const(slotBase + slots.at(value) * INT_SIZE)));
+    IR::index_t address = IR::getInstrIndex(instrs.emplace_back(IR::Add(IR::Register::fp, offset)));
+    unspillable.insert(offset);
+    unspillable.insert(address);
+    return address;
+}
+
+void RegisterAllocPass::moveCalleeFrames(const std::shared_ptr<IR::FuncEntry>& entry){
+    if(slotCount == 0 || !frameConsts.empty()){
+        return;
+    }
+    // Offset of each frame gets its own constant, set when the number of slots is known
+    for(std::pair<IR::index_t, int32_t>& calleeFrame : calleeFrames){
+        for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+            std::vector<IR::Instrction>::iterator it = std::find_if(block->instructions.begin(), block->instructions.end(), [&calleeFrame](IR::Instrction& instr){
+                return IR::getInstrIndex(instr) == calleeFrame.first;
+            });
+            if(it == block->instructions.end()){
+                continue;
+            }
+            IR::Const offset(0);
+            std::get<IR::Add>(*it).operand2 = offset.index;
+            block->instructions.insert(it, offset);
+            frameConsts[offset.index] = calleeFrame.second;
+            unspillable.insert(offset.index);
+            break;
+        }
+    }
+}
+
+void RegisterAllocPass::finish(const std::string& funcName, const std::shared_ptr<IR::FuncEntry>& entry){
+    // Frames of callees start after spill slots
+    IR::address_t slotSize = slotCount * INT_SIZE;
+    size_t moveCount = 0;
+    for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+        // Spill code may be placed before the first instruction of block
+        IR::relinkBranch(block);
+        for(IR::Instrction& instr : block->instructions){
+            if(std::holds_alternative<IR::Const>(instr) && frameConsts.contains(std::get<IR::Const>(instr).index)){
+                IR::Const& offset = std::get<IR::Const>(instr);
+                offset.value = std::max(frameConsts[offset.index], slotBase) + slotSize;
+            }else if(std::holds_alternative<IR::Move>(instr)){
+                IR::Move& move = std::get<IR::Move>(instr);
+                std::unordered_map<IR::index_t, size_t>::iterator dest = entry->registers.find(move.operand1);
+                std::unordered_map<IR::index_t, size_t>::iterator src = entry->registers.find(move.operand2);
+                if(dest != entry->registers.end() && src != entry->registers.end() && dest->second != src->second){
+                    moveCount += 1;
+                }
+            }
+        }
+    }
+    if(slotCount > 0){
+        entry->frameSize = slotBase + slotSize;
+    }
+    spillCounts[funcName] = slots.size();
+    moveCounts[funcName] = moveCount;
+}
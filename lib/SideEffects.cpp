@@ -0,0 +1,65 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <SideEffects.hpp>
+#include <CallGraph.hpp>
+#include <CFG.hpp>
+#include <AliasAnalysis.hpp>
+
+#include <vector>
+
+using Location = IR::AliasAnalysis::Location;
+
+bool IR::FuncSummary::isPure() const{
+    return !readsMemory && !writesMemory && !performsIO;
+}
+
+IR::SideEffects::SideEffects(const std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    IR::CallGraph callGraph(funcMap);
+    // Components bottom-up, so summaries of callees in other components are complete
+    for(const std::vector<std::string>& scc : callGraph.sccs){
+        FuncSummary summary {false, false, false};
+        for(const std::string& funcName : scc){
+            const std::shared_ptr<IR::FuncEntry>& entry = funcMap.at(funcName);
+            if(!entry->root){
+                summary = FuncSummary {true, true, true};
+                continue;
+            }
+            // Frame of function is only located relative to fp, other addresses may point anywhere
+            IR::AliasAnalysis aliasAnalysis(entry);
+            for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+                for(IR::Instrction& instr : block->instructions){
+                    if(std::holds_alternative<IR::Load>(instr)){
+                        Location location = aliasAnalysis.locate(std::get<IR::Load>(instr).operand);
+                        summary.readsMemory = summary.readsMemory || location.kind == Location::Kind::Unknown || !location.offset || *location.offset < 0;
+                    }else if(std::holds_alternative<IR::Store>(instr)){
+                        Location location = aliasAnalysis.locate(std::get<IR::Store>(instr).operand2);
+                        summary.writesMemory = summary.writesMemory || location.kind == Location::Kind::Unknown || !location.offset || *location.offset < 0;
+                    }else if(std::holds_alternative<IR::Read>(instr) || std::holds_alternative<IR::Write>(instr)
+                        || std::holds_alternative<IR::WriteNL>(instr) || std::holds_alternative<IR::End>(instr)
+                    ){
+                        summary.performsIO = true;
+                    }
+                }
+            }
+            for(const std::string& callee : callGraph.callees.at(funcName)){
+                if(callGraph.sccOf.at(callee) != callGraph.sccOf.at(funcName)){
+                    const FuncSummary& calleeSummary = summaries.at(callee);
+                    summary.readsMemory = summary.readsMemory || calleeSummary.readsMemory;
+                    summary.writesMemory = summary.writesMemory || calleeSummary.writesMemory;
+                    summary.performsIO = summary.performsIO || calleeSummary.performsIO;
+                }
+            }
+        }
+        for(const std::string& funcName : scc){
+            summaries[funcName] = summary;
+        }
+    }
+}
+
+const IR::FuncSummary& IR::SideEffects::of(const std::string& funcName) const{
+    return summaries.at(funcName);
+}
@@ -0,0 +1,307 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <SimplifyCFGPass.hpp>
+#include <CallGraph.hpp>
+
+#include <algorithm>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+static bool hasPhi(const std::shared_ptr<IR::BasicBlock>& block){
+    return std::any_of(block->instructions.begin(), block->instructions.end(), [](const IR::Instrction& instr){
+        return std::holds_alternative<IR::Phi>(instr);
+    });
+}
+
+void SimplifyCFGPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        dcePass.eliminate(funcPair.second);
+        simplify(funcPair.second);
+    }
+    IR::relinkCalls(funcMap);
+}
+
+void SimplifyCFGPass::simplify(const std::shared_ptr<IR::FuncEntry>& entry){
+    // One change at a time, with Phi fixed by comparing predecessors before and after it
+    bool changed = true;
+    while(changed){
+        IR::CFG cfg(entry);
+        PhiPreds preds = phiPreds(cfg);
+        changed = foldBranches(cfg) || threadJump(cfg, preds) || mergeChain(entry, cfg, preds);
+        if(changed){
+            fixPhis(entry, preds);
+        }
+    }
+
+    // Nop is only kept in blocks with nothing else, and dominators follow the new blocks
+    IR::CFG cfg(entry);
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        std::shared_ptr<IR::BasicBlock>& block = cfg.blocks[blockId];
+        std::erase_if(block->instructions, [](IR::Instrction& instr){
+            return std::holds_alternative<IR::Nop>(instr);
+        });
+        if(block->instructions.empty()){
+            block->instructions.emplace_back(IR::Nop());
+        }
+        if(blockId != 0){
+            block->dominator = cfg.blocks[cfg.idom[blockId]];
+        }
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        IR::relinkBranch(block);
+    }
+    // Calls in blocks made unreachable by folded branches are gone
+    std::erase_if(entry->callLinks, [&](const IR::FuncCallLink& link){
+        return !cfg.blockId.contains(link.block);
+    });
+}
+
+SimplifyCFGPass::PhiPreds SimplifyCFGPass::phiPreds(const IR::CFG& cfg){
+    PhiPreds preds;
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        if(hasPhi(cfg.blocks[blockId])){
+            std::vector<std::shared_ptr<IR::BasicBlock>>& predBlocks = preds[cfg.blocks[blockId]];
+            for(size_t pred : cfg.preds[blockId]){
+                predBlocks.emplace_back(cfg.blocks[pred]);
+            }
+        }
+    }
+    return preds;
+}
+
+void SimplifyCFGPass::replacePred(PhiPreds& preds, const std::shared_ptr<IR::BasicBlock>& from, const std::shared_ptr<IR::BasicBlock>& to){
+    for(std::pair<const std::shared_ptr<IR::BasicBlock>, std::vector<std::shared_ptr<IR::BasicBlock>>>& predPair : preds){
+        std::replace(predPair.second.begin(), predPair.second.end(), from, to);
+    }
+}
+
+bool SimplifyCFGPass::foldBranches(const IR::CFG& cfg){
+    std::unordered_map<IR::index_t, int32_t> constants;
+    std::unordered_map<IR::index_t, IR::Cmp*> cmps;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            if(std::holds_alternative<IR::Const>(instr)){
+                constants[std::get<IR::Const>(instr).index] = std::get<IR::Const>(instr).value;
+            }else if(std::holds_alternative<IR::Cmp>(instr)){
+                cmps[std::get<IR::Cmp>(instr).index] = &std::get<IR::Cmp>(instr);
+            }
+        }
+    }
+    // Result of Cmp is known if its operands are constants or the same value
+    auto cmpValue = [&](IR::index_t index) -> std::optional<int32_t> {
+        if(constants.contains(index)){
+            return constants[index];
+        }
+        if(!cmps.contains(index)){
+            return std::nullopt;
+        }
+        IR::Cmp& cmp = *cmps[index];
+        if(cmp.operand1 == cmp.operand2){
+            return 0;
+        }
+        if(constants.contains(cmp.operand1) && constants.contains(cmp.operand2)){
+            int32_t value1 = constants[cmp.operand1];
+            int32_t value2 = constants[cmp.operand2];
+            return (value1 > value2) - (value1 < value2);
+        }
+        return std::nullopt;
+    };
+
+    bool changed = false;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        if(!block->branch || !block->fallThrough || block->instructions.empty()){
+            continue;
+        }
+        std::optional<bool> taken;
+        std::visit(overloaded {
+            [](auto&){},
+            [&](IR::Bne& instr){
+                std::optional<int32_t> value = cmpValue(instr.operand1);
+                if(value){ taken = *value != 0; }
+            },
+            [&](IR::Beq& instr){
+                std::optional<int32_t> value = cmpValue(instr.operand1);
+                if(value){ taken = *value == 0; }
+            },
+            [&](IR::Ble& instr){
+                std::optional<int32_t> value = cmpValue(instr.operand1);
+                if(value){ taken = *value <= 0; }
+            },
+            [&](IR::Blt& instr){
+                std::optional<int32_t> value = cmpValue(instr.operand1);
+                if(value){ taken = *value < 0; }
+            },
+            [&](IR::Bge& instr){
+                std::optional<int32_t> value = cmpValue(instr.operand1);
+                if(value){ taken = *value >= 0; }
+            },
+            [&](IR::Bgt& instr){
+                std::optional<int32_t> value = cmpValue(instr.operand1);
+                if(value){ taken = *value > 0; }
+            },
+        }, block->instructions.back());
+        // Both ways go to the same block
+        if(!taken && block->branch == block->fallThrough && !hasPhi(block->branch)){
+            taken = false;
+        }
+        if(!taken){
+            continue;
+        }
+        if(*taken){
+            block->instructions.back() = IR::Bra(IR::getInstrIndex(block->branch->instructions.front()));
+            block->fallThrough = nullptr;
+        }else{
+            block->instructions.pop_back();
+            block->branch = nullptr;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+bool SimplifyCFGPass::threadJump(const IR::CFG& cfg, PhiPreds& preds){
+    for(size_t blockId = 1; blockId < cfg.blocks.size(); ++blockId){
+        // Block with only Nop, and a jump or a fall-through
+        std::shared_ptr<IR::BasicBlock> block = cfg.blocks[blockId];
+        std::shared_ptr<IR::BasicBlock> target;
+        std::vector<IR::Instrction>::iterator last = block->instructions.end();
+        if(block->branch && !block->fallThrough){
+            if(block->instructions.empty() || !std::holds_alternative<IR::Bra>(block->instructions.back())){
+                continue;
+            }
+            target = block->branch;
+            last = std::prev(last);
+        }else if(!block->branch && block->fallThrough){
+            target = block->fallThrough;
+        }else{
+            continue;
+        }
+        if(target == block || !std::all_of(block->instructions.begin(), last, [](IR::Instrction& instr){
+            return std::holds_alternative<IR::Nop>(instr);
+        })){
+            continue;
+        }
+
+        // Predecessors go to target directly, Phi of target can only take the place of this block
+        bool targetHasPhi = hasPhi(target);
+        for(size_t pred : cfg.preds[blockId]){
+            std::shared_ptr<IR::BasicBlock> predBlock = cfg.blocks[pred];
+            if(predBlock == block){
+                continue;
+            }
+            if(targetHasPhi && (cfg.preds[blockId].size() != 1 || predBlock->fallThrough == target || predBlock->branch == target)){
+                break;
+            }
+            if(predBlock->fallThrough == block){
+                predBlock->fallThrough = target;
+            }
+            if(predBlock->branch == block){
+                predBlock->branch = target;
+            }
+            // Conditional branch to where it falls through does nothing
+            if(predBlock->branch == predBlock->fallThrough){
+                predBlock->instructions.pop_back();
+                predBlock->branch = nullptr;
+            }
+            replacePred(preds, block, predBlock);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SimplifyCFGPass::mergeChain(const std::shared_ptr<IR::FuncEntry>& entry, const IR::CFG& cfg, PhiPreds& preds){
+    for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+        // Block goes only to a successor entered from nowhere else
+        std::shared_ptr<IR::BasicBlock> block = cfg.blocks[blockId];
+        if(cfg.succs[blockId].size() != 1){
+            continue;
+        }
+        size_t succ = cfg.succs[blockId][0];
+        std::shared_ptr<IR::BasicBlock> next = cfg.blocks[succ];
+        if(succ == 0 || next == block || cfg.preds[succ].size() != 1 || hasPhi(next)){
+            continue;
+        }
+        if(block->branch){
+            if(block->fallThrough || block->instructions.empty() || !std::holds_alternative<IR::Bra>(block->instructions.back())){
+                continue;
+            }
+            block->instructions.pop_back();
+        }
+        block->instructions.insert(block->instructions.end(), next->instructions.begin(), next->instructions.end());
+        block->fallThrough = next->fallThrough;
+        block->branch = next->branch;
+        for(IR::FuncCallLink& link : entry->callLinks){
+            if(link.block == next){
+                link.block = block;
+            }
+        }
+        replacePred(preds, next, block);
+        return true;
+    }
+    return false;
+}
+
+void SimplifyCFGPass::fixPhis(const std::shared_ptr<IR::FuncEntry>& entry, const PhiPreds& preds){
+    IR::CFG cfg(entry);
+    std::unordered_map<IR::index_t, IR::index_t> forward;
+    for(const std::pair<const std::shared_ptr<IR::BasicBlock>, std::vector<std::shared_ptr<IR::BasicBlock>>>& predPair : preds){
+        if(!cfg.blockId.contains(predPair.first)){
+            continue;
+        }
+        const std::vector<std::shared_ptr<IR::BasicBlock>>& oldPreds = predPair.second;
+        std::vector<std::shared_ptr<IR::BasicBlock>> newPreds;
+        for(size_t pred : cfg.preds[cfg.blockId.at(predPair.first)]){
+            newPreds.emplace_back(cfg.blocks[pred]);
+        }
+        std::erase_if(predPair.first->instructions, [&](IR::Instrction& instr){
+            if(!std::holds_alternative<IR::Phi>(instr)){
+                return false;
+            }
+            IR::Phi& phi = std::get<IR::Phi>(instr);
+            // Operands follow the new order of predecessors
+            if(newPreds.size() == 2 && oldPreds.size() == 2 && newPreds[0] == oldPreds[1] && newPreds[1] == oldPreds[0]){
+                std::swap(phi.operand1, phi.operand2);
+            }
+            // Value from the only predecessor left
+            if(newPreds.size() == 1 && oldPreds.size() == 2){
+                forward[phi.index] = (newPreds[0] == oldPreds[0]) ? phi.operand1 : phi.operand2;
+                return true;
+            }
+            if(phi.operand1 == phi.operand2){
+                forward[phi.index] = phi.operand1;
+                return true;
+            }
+            return false;
+        });
+    }
+    if(forward.empty()){
+        return;
+    }
+    auto replace = [&forward](IR::index_t& operand){
+        std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(operand);
+        while(it != forward.end()){
+            operand = it->second;
+            it = forward.find(operand);
+        }
+    };
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            IR::forEachOperand(instr, replace);
+        }
+    }
+    for(IR::FuncCallLink& link : entry->callLinks){
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            replace(param.second);
+        }
+    }
+}
@@ -97,3 +97,7 @@ void Source::putback(int ch){
         back.push(ch);
     }
 }
+
+std::string& Source::buffer(){
+    return text;
+}
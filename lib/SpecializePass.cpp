@@ -0,0 +1,200 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <SpecializePass.hpp>
+#include <CFG.hpp>
+#include <CallGraph.hpp>
+#include <LoopInfo.hpp>
+#include <AliasAnalysis.hpp>
+
+#include <map>
+#include <set>
+#include <algorithm>
+
+using Location = IR::AliasAnalysis::Location;
+
+const size_t SpecializePass::defaultBudget = 400;
+
+SpecializePass::SpecializePass(size_t budget): budget(budget){}
+
+void SpecializePass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    IR::CallGraph callGraph(funcMap);
+
+    // Parameters never stored by the function, so that loading them always gives the argument
+    std::unordered_map<std::string, std::vector<bool>> fixedParams;
+    for(const std::string& funcName : callGraph.bottomUp()){
+        std::shared_ptr<IR::FuncEntry> entry = funcMap.at(funcName);
+        if(!entry->root){
+            continue;
+        }
+        IR::AliasAnalysis aliasAnalysis(entry);
+        std::vector<bool>& fixed = fixedParams[funcName];
+        fixed.assign(entry->paramNames.size(), true);
+        for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+            for(IR::Instrction& instr : block->instructions){
+                if(!std::holds_alternative<IR::Store>(instr)){
+                    continue;
+                }
+                Location location = aliasAnalysis.locate(std::get<IR::Store>(instr).operand2);
+                for(size_t i = 0; i < entry->paramNames.size(); ++i){
+                    if(location.kind == Location::Kind::Unknown || (location.kind == Location::Kind::Frame
+                        && (!location.offset || *location.offset == entry->paramAddrMap.at(entry->paramNames[i])))
+                    ){
+                        fixed[i] = false;
+                    }
+                }
+            }
+        }
+    }
+
+    // Calls grouped by callee and constant arguments, weighted by the loop depth of call
+    struct Group{
+        size_t weight;
+        std::vector<IR::FuncCallLink*> links;
+    };
+    std::map<std::pair<std::string, Arguments>, Group> groups;
+    for(const std::string& funcName : callGraph.bottomUp()){
+        std::shared_ptr<IR::FuncEntry> caller = funcMap.at(funcName);
+        if(!caller->root){
+            continue;
+        }
+        IR::CFG cfg(caller);
+        IR::LoopInfo loopInfo(cfg);
+        std::unordered_map<IR::index_t, int32_t> constants;
+        std::unordered_map<IR::index_t, size_t> blockOf;
+        for(size_t blockId = 0; blockId < cfg.blocks.size(); ++blockId){
+            for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+                blockOf[IR::getInstrIndex(instr)] = blockId;
+                if(std::holds_alternative<IR::Const>(instr)){
+                    constants[std::get<IR::Const>(instr).index] = std::get<IR::Const>(instr).value;
+                }
+            }
+        }
+        for(IR::FuncCallLink& link : caller->callLinks){
+            std::shared_ptr<IR::FuncEntry> callee = funcMap.at(link.funcName);
+            if(!callee->root || link.funcName == "_main" || callGraph.isRecursive(link.funcName) || !blockOf.contains(link.callIndex)){
+                continue;
+            }
+            Arguments arguments(callee->paramNames.size());
+            bool hasConstant = false;
+            for(std::pair<SymbolId, IR::index_t>& param : link.params){
+                size_t paramId = std::find(callee->paramNames.begin(), callee->paramNames.end(), param.first) - callee->paramNames.begin();
+                if(paramId < arguments.size() && fixedParams[link.funcName][paramId] && constants.contains(param.second)){
+                    arguments[paramId] = constants[param.second];
+                    hasConstant = true;
+                }
+            }
+            if(!hasConstant){
+                continue;
+            }
+            Group& group = groups[{link.funcName, arguments}];
+            group.weight += (size_t)1 << (3 * std::min(loopInfo.depthOf(blockOf[link.callIndex]), (size_t)4));
+            group.links.push_back(&link);
+        }
+    }
+
+    // Heaviest groups first, until clones use up the budget
+    std::vector<std::pair<const std::pair<std::string, Arguments>, Group>*> order;
+    for(std::pair<const std::pair<std::string, Arguments>, Group>& group : groups){
+        order.push_back(&group);
+    }
+    std::stable_sort(order.begin(), order.end(), [](auto* group1, auto* group2){
+        return group1->second.weight > group2->second.weight;
+    });
+    size_t remaining = budget;
+    std::set<std::string> generics;
+    for(std::pair<const std::pair<std::string, Arguments>, Group>* group : order){
+        const std::string& funcName = group->first.first;
+        const Arguments& arguments = group->first.second;
+        size_t size = 0;
+        for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(funcMap.at(funcName)).blocks){
+            size += block->instructions.size();
+        }
+        if(size > remaining){
+            continue;
+        }
+        remaining -= size;
+        std::shared_ptr<IR::FuncEntry> clone = IR::cloneFunc(funcMap.at(funcName));
+        specialize(clone, arguments);
+        std::string cloneName = nameOf(funcName, arguments);
+        funcMap[cloneName] = clone;
+        for(IR::FuncCallLink* link : group->second.links){
+            link->funcName = cloneName;
+        }
+        generics.insert(funcName);
+    }
+    if(generics.empty()){
+        return;
+    }
+
+    // Generic versions no longer called
+    if(funcMap.contains("_main")){
+        std::set<std::string> reachable = IR::CallGraph(funcMap).reachableFrom("_main");
+        for(const std::string& funcName : generics){
+            if(!reachable.contains(funcName)){
+                funcMap.erase(funcName);
+            }
+        }
+    }
+    IR::relinkCalls(funcMap);
+}
+
+std::string SpecializePass::nameOf(const std::string& funcName, const Arguments& arguments){
+    // Dots never appear in identifiers, so clones don't clash with declared functions
+    std::string name = funcName;
+    for(const std::optional<int32_t>& argument : arguments){
+        name += "." + (argument ? std::to_string(*argument) : std::string("_"));
+    }
+    return name;
+}
+
+void SpecializePass::specialize(const std::shared_ptr<IR::FuncEntry>& entry, const Arguments& arguments){
+    // Constants are placed at the start of root, and loads of their parameters use them instead
+    std::vector<IR::Instrction> constInstrs;
+    std::unordered_map<int32_t, IR::index_t> paramConsts;
+    for(size_t i = 0; i < arguments.size(); ++i){
+        if(arguments[i]){
+            paramConsts[entry->paramAddrMap.at(entry->paramNames[i])] = IR::getInstrIndex(constInstrs.emplace_back(IR::Const(*arguments[i])));
+        }
+    }
+    entry->root->instructions.insert(entry->root->instructions.begin(), constInstrs.begin(), constInstrs.end());
+    IR::AliasAnalysis aliasAnalysis(entry);
+    IR::CFG cfg(entry);
+    std::unordered_map<IR::index_t, IR::index_t> forward;
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        std::erase_if(block->instructions, [&](IR::Instrction& instr){
+            if(!std::holds_alternative<IR::Load>(instr)){
+                return false;
+            }
+            Location location = aliasAnalysis.locate(std::get<IR::Load>(instr).operand);
+            if(location.kind != Location::Kind::Frame || !location.offset || !paramConsts.contains(*location.offset)){
+                return false;
+            }
+            forward[std::get<IR::Load>(instr).index] = paramConsts[*location.offset];
+            return true;
+        });
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            IR::forEachOperand(instr, [&forward](IR::index_t& operand){
+                if(forward.contains(operand)){
+                    operand = forward[operand];
+                }
+            });
+        }
+    }
+    for(IR::FuncCallLink& link : entry->callLinks){
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            if(forward.contains(param.second)){
+                param.second = forward[param.second];
+            }
+        }
+    }
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        IR::relinkBranch(block);
+    }
+    IR::foldConstants(entry);
+}
@@ -0,0 +1,497 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <StrengthReductionPass.hpp>
+#include <CallGraph.hpp>
+
+#include <set>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+static std::shared_ptr<IR::BasicBlock> findPreheader(const IR::CFG& cfg, const IR::Loop& loop){
+    std::shared_ptr<IR::BasicBlock> preheader;
+    for(size_t pred : cfg.preds[loop.header]){
+        if(!loop.contains[pred]){
+            if(preheader || cfg.succs[pred].size() != 1){
+                return nullptr;
+            }
+            preheader = cfg.blocks[pred];
+        }
+    }
+    return preheader;
+}
+
+static void appendToPreheader(std::shared_ptr<IR::BasicBlock>& preheader, std::vector<IR::Instrction>& code){
+    // Keep the branch instruction at the end of preheader
+    std::vector<IR::Instrction>::iterator position = preheader->instructions.end();
+    if(preheader->branch && !preheader->instructions.empty()){
+        position = std::prev(position);
+    }
+    preheader->instructions.insert(position, code.begin(), code.end());
+    code.clear();
+}
+
+void StrengthReductionPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root){
+            continue;
+        }
+        IR::CFG cfg(funcPair.second);
+        IR::LoopInfo loopInfo(cfg);
+        if(loopInfo.loops.empty()){
+            continue;
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            for(IR::Instrction& instrRef : block->instructions){
+                if(std::holds_alternative<IR::Const>(instrRef)){
+                    IR::Const& instr = std::get<IR::Const>(instrRef);
+                    constants[instr.index] = instr.value;
+                }
+            }
+        }
+        // Inner loops first, then the initial values created in their preheaders are reduced by outer loops
+        for(IR::Loop& loop : loopInfo.loops){
+            reduce(cfg, loop);
+            if(!reduced.empty()){
+                replaceUses(cfg, funcPair.second);
+                dcePass.eliminate(funcPair.second);
+                replaceExitTest(cfg, loop);
+                reduced.clear();
+            }
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            IR::relinkBranch(block);
+        }
+        constants.clear();
+        forward.clear();
+    }
+    IR::relinkCalls(funcMap);
+}
+
+IR::index_t StrengthReductionPass::emitConst(std::vector<IR::Instrction>& code, int32_t value){
+    IR::Const& instr = std::get<IR::Const>(code.emplace_back(IR::Const(value)));
+    constants[instr.index] = value;
+    return instr.index;
+}
+
+IR::index_t StrengthReductionPass::emitMul(std::vector<IR::Instrction>& code, IR::index_t operand, int32_t factor){
+    if(factor == 1){
+        return operand;
+    }
+    if(factor == 0){
+        return emitConst(code, 0);
+    }
+    if(constants.contains(operand)){
+        return emitConst(code, (int32_t)((uint32_t)constants[operand] * (uint32_t)factor));
+    }
+    IR::index_t factorIndex = emitConst(code, factor);
+    return IR::getInstrIndex(code.emplace_back(IR::Mul(operand, factorIndex)));
+}
+
+IR::index_t StrengthReductionPass::emitAdd(std::vector<IR::Instrction>& code, IR::index_t operand1, IR::index_t operand2){
+    if(constants.contains(operand1) && constants.contains(operand2)){
+        return emitConst(code, (int32_t)((uint32_t)constants[operand1] + (uint32_t)constants[operand2]));
+    }
+    if(constants.contains(operand1) && constants[operand1] == 0){
+        return operand2;
+    }
+    if(constants.contains(operand2) && constants[operand2] == 0){
+        return operand1;
+    }
+    return IR::getInstrIndex(code.emplace_back(IR::Add(operand1, operand2)));
+}
+
+IR::index_t StrengthReductionPass::materialize(std::vector<IR::Instrction>& code, const Linear& linear, IR::index_t value){
+    // Value of linear at the given value of its induction variable
+    IR::index_t result = emitMul(code, value, linear.scale);
+    for(const std::pair<IR::index_t, int32_t>& term : linear.terms){
+        if(term.second < 0 && !constants.contains(term.first)){
+            IR::index_t subtrahend = emitMul(code, term.first, -term.second);
+            result = IR::getInstrIndex(code.emplace_back(IR::Sub(result, subtrahend)));
+        }else{
+            result = emitAdd(code, result, emitMul(code, term.first, term.second));
+        }
+    }
+    if(linear.base){
+        result = IR::getInstrIndex(code.emplace_back(IR::Adda(*linear.base, result)));
+    }
+    return result;
+}
+
+void StrengthReductionPass::reduce(const IR::CFG& cfg, const IR::Loop& loop){
+    std::shared_ptr<IR::BasicBlock> preheader = findPreheader(cfg, loop);
+    if(!preheader || loop.latches.size() != 1){
+        return;
+    }
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+
+    // Instructions defined in loop
+    std::unordered_map<IR::index_t, std::pair<std::shared_ptr<IR::BasicBlock>, IR::Instrction*>> loopDefs;
+    for(size_t blockId : loop.blocks){
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            loopDefs[IR::getInstrIndex(instr)] = {cfg.blocks[blockId], &instr};
+        }
+    }
+    auto isInvariant = [&](IR::index_t operand){
+        if(operand == IR::Register::fp){
+            return true;
+        }
+        return operand != IR::Register::pc && operand != IR::Register::rval && !loopDefs.contains(operand);
+    };
+
+    // Basic induction variables
+    std::unordered_map<IR::index_t, Induction> inductions;
+    for(IR::Instrction& instrRef : header->instructions){
+        if(!std::holds_alternative<IR::Phi>(instrRef)){
+            continue;
+        }
+        IR::Phi& phi = std::get<IR::Phi>(instrRef);
+        if(!isInvariant(phi.operand1) || !loopDefs.contains(phi.operand2)){
+            continue;
+        }
+        Induction induction {phi.index, phi.operand1, phi.operand2, 0, 1};
+        std::visit(overloaded {
+            [](auto&){},
+            [&](IR::Add& instr){
+                if(instr.operand1 == phi.index && isInvariant(instr.operand2)){
+                    induction.step = instr.operand2;
+                }else if(instr.operand2 == phi.index && isInvariant(instr.operand1)){
+                    induction.step = instr.operand1;
+                }
+            },
+            [&](IR::Sub& instr){
+                if(instr.operand1 == phi.index && isInvariant(instr.operand2)){
+                    induction.step = instr.operand2;
+                    induction.stepSign = -1;
+                }
+            },
+        }, *loopDefs[phi.operand2].second);
+        if(induction.step != 0){
+            inductions[phi.index] = induction;
+        }
+    }
+    if(inductions.empty()){
+        return;
+    }
+
+    // Linear values of induction variables, in reverse post-order so that operands are decided first
+    std::unordered_map<IR::index_t, Linear> linears;
+    for(std::pair<const IR::index_t, Induction>& induction : inductions){
+        linears[induction.first] = Linear {induction.first, 1, {}, std::nullopt};
+    }
+    auto addTerm = [](Linear linear, IR::index_t term, int32_t coefficient){
+        linear.terms.emplace_back(term, coefficient);
+        return linear;
+    };
+    auto scale = [](Linear linear, int32_t factor){
+        linear.scale *= factor;
+        for(std::pair<IR::index_t, int32_t>& term : linear.terms){
+            term.second *= factor;
+        }
+        return linear;
+    };
+    auto combine = [&](const Linear& linear1, const Linear& linear2, int32_t sign){
+        Linear result = linear1;
+        result.scale += linear2.scale * sign;
+        for(const std::pair<IR::index_t, int32_t>& term : linear2.terms){
+            result.terms.emplace_back(term.first, term.second * sign);
+        }
+        return result;
+    };
+    std::vector<IR::index_t> linearOrder;
+    for(size_t blockId : loop.blocks){
+        for(IR::Instrction& instrRef : cfg.blocks[blockId]->instructions){
+            std::optional<Linear> result;
+            std::visit(overloaded {
+                [](auto&){},
+                [&](IR::Neg& instr){
+                    if(linears.contains(instr.operand) && !linears[instr.operand].base){
+                        result = scale(linears[instr.operand], -1);
+                    }
+                },
+                [&](IR::Add& instr){
+                    bool linear1 = linears.contains(instr.operand1);
+                    bool linear2 = linears.contains(instr.operand2);
+                    if(linear1 && linear2){
+                        Linear& first = linears[instr.operand1];
+                        Linear& second = linears[instr.operand2];
+                        if(first.phi == second.phi && !first.base && !second.base){
+                            result = combine(first, second, 1);
+                        }
+                    }else if(linear1 && isInvariant(instr.operand2)){
+                        result = addTerm(linears[instr.operand1], instr.operand2, 1);
+                    }else if(linear2 && isInvariant(instr.operand1)){
+                        result = addTerm(linears[instr.operand2], instr.operand1, 1);
+                    }
+                },
+                [&](IR::Sub& instr){
+                    bool linear1 = linears.contains(instr.operand1);
+                    bool linear2 = linears.contains(instr.operand2);
+                    if(linear1 && linear2){
+                        Linear& first = linears[instr.operand1];
+                        Linear& second = linears[instr.operand2];
+                        if(first.phi == second.phi && !first.base && !second.base){
+                            result = combine(first, second, -1);
+                        }
+                    }else if(linear1 && isInvariant(instr.operand2)){
+                        result = addTerm(linears[instr.operand1], instr.operand2, -1);
+                    }else if(linear2 && isInvariant(instr.operand1) && !linears[instr.operand2].base){
+                        result = addTerm(scale(linears[instr.operand2], -1), instr.operand1, 1);
+                    }
+                },
+                [&](IR::Mul& instr){
+                    if(linears.contains(instr.operand1) && constants.contains(instr.operand2) && !linears[instr.operand1].base){
+                        result = scale(linears[instr.operand1], constants[instr.operand2]);
+                    }else if(linears.contains(instr.operand2) && constants.contains(instr.operand1) && !linears[instr.operand2].base){
+                        result = scale(linears[instr.operand2], constants[instr.operand1]);
+                    }
+                },
+                [&](IR::Adda& instr){
+                    if(linears.contains(instr.operand2) && isInvariant(instr.operand1) && !linears[instr.operand2].base){
+                        result = linears[instr.operand2];
+                        result->base = instr.operand1;
+                    }else if(linears.contains(instr.operand1) && isInvariant(instr.operand2) && linears[instr.operand1].base){
+                        result = addTerm(linears[instr.operand1], instr.operand2, 1);
+                    }
+                },
+            }, instrRef);
+            if(result){
+                // Merge terms into canonical form
+                std::map<IR::index_t, int32_t> termMap;
+                for(std::pair<IR::index_t, int32_t>& term : result->terms){
+                    termMap[term.first] += term.second;
+                }
+                std::erase_if(termMap, [](const std::pair<const IR::index_t, int32_t>& term){ return term.second == 0; });
+                result->terms.assign(termMap.begin(), termMap.end());
+                IR::index_t index = IR::getInstrIndex(instrRef);
+                linears[index] = *result;
+                linearOrder.push_back(index);
+            }
+        }
+    }
+
+    // Only addresses and scaled values are worth reducing, and those used only by other candidates are folded into them
+    auto isCandidate = [&](IR::index_t index){
+        if(!linears.contains(index) || inductions.contains(index)){
+            return false;
+        }
+        Linear& linear = linears[index];
+        return linear.base || (linear.scale != 1 && linear.scale != 0);
+    };
+    std::set<IR::index_t> roots;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            if(isCandidate(IR::getInstrIndex(instr))){
+                continue;
+            }
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                if(isCandidate(operand)){
+                    roots.insert(operand);
+                }
+            });
+        }
+    }
+
+    // Create induction variables
+    std::vector<IR::Instrction> code;
+    std::map<LinearKey, IR::index_t> reducedMap;
+    for(IR::index_t root : linearOrder){
+        if(!roots.contains(root)){
+            continue;
+        }
+        Linear& linear = linears[root];
+        if(std::any_of(linear.terms.begin(), linear.terms.end(), [&](std::pair<IR::index_t, int32_t>& term){
+            return loopDefs.contains(term.first);
+        }) || (linear.base && loopDefs.contains(*linear.base))){
+            continue;
+        }
+        LinearKey key {linear.phi, linear.scale, linear.terms, linear.base};
+        if(reducedMap.contains(key)){
+            forward[root] = reducedMap[key];
+            continue;
+        }
+        Induction& induction = inductions[linear.phi];
+        IR::index_t init = materialize(code, linear, induction.init);
+        IR::index_t step;
+        if(constants.contains(induction.step)){
+            step = emitConst(code, constants[induction.step] * linear.scale * induction.stepSign);
+        }else{
+            step = emitMul(code, induction.step, linear.scale * induction.stepSign);
+        }
+        // New value is updated right after the basic induction variable
+        IR::Phi phi(init, 0);
+        IR::Instrction update = linear.base ? IR::Instrction(IR::Adda(phi.index, step)) : IR::Instrction(IR::Add(phi.index, step));
+        phi.operand2 = IR::getInstrIndex(update);
+        std::shared_ptr<IR::BasicBlock> updateBlock = loopDefs[induction.update].first;
+        std::vector<IR::Instrction>::iterator updatePos = std::find_if(updateBlock->instructions.begin(), updateBlock->instructions.end(),
+            [&](IR::Instrction& instr){
+                return IR::getInstrIndex(instr) == induction.update;
+            }
+        );
+        updateBlock->instructions.insert(std::next(updatePos), update);
+        header->instructions.insert(header->instructions.begin(), phi);
+        // Pointers into header and update block are invalidated
+        loopDefs.clear();
+        for(size_t blockId : loop.blocks){
+            for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+                loopDefs[IR::getInstrIndex(instr)] = {cfg.blocks[blockId], &instr};
+            }
+        }
+        forward[root] = phi.index;
+        reducedMap[key] = phi.index;
+        reduced.emplace_back(induction, phi.index, linear);
+    }
+    appendToPreheader(preheader, code);
+}
+
+void StrengthReductionPass::replaceExitTest(const IR::CFG& cfg, const IR::Loop& loop){
+    std::shared_ptr<IR::BasicBlock> preheader = findPreheader(cfg, loop);
+    std::shared_ptr<IR::BasicBlock> header = cfg.blocks[loop.header];
+    if(reduced.empty() || !preheader || header->instructions.empty()){
+        return;
+    }
+    // Exit test compares a basic induction variable with an invariant bound
+    IR::index_t cmpIndex = 0;
+    std::visit(overloaded {
+        [](auto&){},
+        [&](IR::Bne& instr){ cmpIndex = instr.operand1; },
+        [&](IR::Beq& instr){ cmpIndex = instr.operand1; },
+        [&](IR::Ble& instr){ cmpIndex = instr.operand1; },
+        [&](IR::Blt& instr){ cmpIndex = instr.operand1; },
+        [&](IR::Bge& instr){ cmpIndex = instr.operand1; },
+        [&](IR::Bgt& instr){ cmpIndex = instr.operand1; },
+    }, header->instructions.back());
+    // Reduced induction variables used only by dead code are already eliminated
+    std::set<IR::index_t> headerPhis;
+    for(IR::Instrction& instr : header->instructions){
+        if(std::holds_alternative<IR::Phi>(instr)){
+            headerPhis.insert(IR::getInstrIndex(instr));
+        }
+    }
+    std::vector<IR::Instrction>::iterator cmpIt = std::find_if(header->instructions.begin(), header->instructions.end(),
+        [&](IR::Instrction& instr){
+            return IR::getInstrIndex(instr) == cmpIndex;
+        }
+    );
+    if(cmpIt == header->instructions.end() || !std::holds_alternative<IR::Cmp>(*cmpIt)){
+        return;
+    }
+    IR::Cmp& cmp = std::get<IR::Cmp>(*cmpIt);
+
+    // Users of values
+    std::set<IR::index_t> loopDefs;
+    for(size_t blockId : loop.blocks){
+        for(IR::Instrction& instr : cfg.blocks[blockId]->instructions){
+            loopDefs.insert(IR::getInstrIndex(instr));
+        }
+    }
+    std::unordered_map<IR::index_t, std::set<IR::index_t>> users;
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            IR::index_t index = IR::getInstrIndex(instr);
+            IR::forEachOperand(instr, [&](IR::index_t& operand){
+                users[operand].insert(index);
+            });
+        }
+    }
+
+    for(std::tuple<Induction, IR::index_t, Linear>& entry : reduced){
+        Induction& induction = std::get<0>(entry);
+        Linear& linear = std::get<2>(entry);
+        // Order is kept only for positive scale
+        if(linear.scale <= 0 || !headerPhis.contains(std::get<1>(entry))){
+            continue;
+        }
+        IR::index_t* ivOperand = nullptr;
+        IR::index_t bound = 0;
+        if(cmp.operand1 == induction.phi){
+            ivOperand = &cmp.operand1;
+            bound = cmp.operand2;
+        }else if(cmp.operand2 == induction.phi){
+            ivOperand = &cmp.operand2;
+            bound = cmp.operand1;
+        }
+        if(!ivOperand || loopDefs.contains(bound) || bound == IR::Register::pc || bound == IR::Register::rval){
+            continue;
+        }
+        if(!fitsInt32(induction, linear, bound)){
+            continue;
+        }
+        // Replace only if the basic induction variable is left for nothing else
+        std::set<IR::index_t> phiUsers {cmp.index, induction.update};
+        std::set<IR::index_t> updateUsers {induction.phi};
+        if(!std::includes(phiUsers.begin(), phiUsers.end(), users[induction.phi].begin(), users[induction.phi].end())
+            || !std::includes(updateUsers.begin(), updateUsers.end(), users[induction.update].begin(), users[induction.update].end())
+        ){
+            continue;
+        }
+        std::vector<IR::Instrction> code;
+        IR::index_t newBound = materialize(code, linear, bound);
+        *ivOperand = std::get<1>(entry);
+        if(ivOperand == &cmp.operand1){
+            cmp.operand2 = newBound;
+        }else{
+            cmp.operand1 = newBound;
+        }
+        appendToPreheader(preheader, code);
+        break;
+    }
+}
+
+bool StrengthReductionPass::fitsInt32(const Induction& induction, const Linear& linear, IR::index_t bound){
+    // Known only for constants, an address depends on fp
+    if(linear.base || !constants.contains(induction.init) || !constants.contains(induction.step) || !constants.contains(bound)
+        || std::any_of(linear.terms.begin(), linear.terms.end(), [this](const std::pair<IR::index_t, int32_t>& term){
+            return !constants.contains(term.first);
+        })
+    ){
+        return false;
+    }
+    // Values tested go from init to at most a step past bound, and linear is monotonic in them
+    int64_t step = std::abs((int64_t)constants[induction.step]);
+    int64_t low = std::min<int64_t>(constants[induction.init], constants[bound]) - step;
+    int64_t high = std::max<int64_t>(constants[induction.init], constants[bound]) + step;
+    auto valueAt = [&](int64_t value){
+        int64_t result = (int64_t)linear.scale * value;
+        for(const std::pair<IR::index_t, int32_t>& term : linear.terms){
+            result += (int64_t)constants[term.first] * term.second;
+        }
+        return result;
+    };
+    auto fits = [](int64_t value){
+        return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+    };
+    return fits(low) && fits(high) && fits(valueAt(low)) && fits(valueAt(high));
+}
+
+void StrengthReductionPass::replaceUses(const IR::CFG& cfg, std::shared_ptr<IR::FuncEntry>& entry){
+    if(forward.empty()){
+        return;
+    }
+    for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            IR::forEachOperand(instr, [this](IR::index_t& operand){
+                std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(operand);
+                if(it != forward.end()){
+                    operand = it->second;
+                }
+            });
+        }
+    }
+    for(IR::FuncCallLink& link : entry->callLinks){
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(param.second);
+            if(it != forward.end()){
+                param.second = it->second;
+            }
+        }
+    }
+}
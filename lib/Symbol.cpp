@@ -0,0 +1,30 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <Symbol.hpp>
+
+Symbol::Symbol()
+{}
+
+Symbol Symbol::symbol = Symbol();
+
+SymbolId Symbol::intern(std::string_view name){
+    std::unordered_map<std::string_view, SymbolId>::iterator idIt = symbol.ids.find(name);
+    if(idIt != symbol.ids.end()){
+        return idIt->second;
+    }
+    SymbolId id = symbol.names.size();
+    symbol.ids.emplace(symbol.names.emplace_back(name), id);
+    return id;
+}
+
+const std::string& Symbol::name(SymbolId id){
+    return symbol.names[id];
+}
+
+size_t Symbol::count(){
+    return symbol.names.size();
+}
@@ -0,0 +1,244 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <TailCallPass.hpp>
+#include <CallGraph.hpp>
+
+#include <set>
+#include <algorithm>
+
+void TailCallPass::traverse(std::unordered_map<std::string, std::shared_ptr<IR::FuncEntry>>& funcMap){
+    for(const std::string& funcName : IR::CallGraph(funcMap).bottomUp()){
+        std::pair<const std::string, std::shared_ptr<IR::FuncEntry>>& funcPair = *funcMap.find(funcName);
+        if(!funcPair.second->root || funcPair.first == "_main"){
+            continue;
+        }
+        IR::CFG cfg(funcPair.second);
+        std::vector<TailCall> selfCalls;
+        for(IR::FuncCallLink& link : funcPair.second->callLinks){
+            std::optional<IR::CallSite> site = IR::findCallSite(cfg, link);
+            bool fallsToEnd = false;
+            if(!site || !isTail(cfg, link, *site, fallsToEnd)){
+                continue;
+            }
+            TailCall tailCall {link, *site, fallsToEnd};
+            if(link.funcName == funcPair.first){
+                selfCalls.emplace_back(tailCall);
+            }else{
+                reuseFrame(tailCall, funcMap.at(link.funcName));
+                link = tailCall.link;
+            }
+        }
+        if(!selfCalls.empty()){
+            loopToRoot(funcPair.second, selfCalls);
+        }
+        for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(funcPair.second).blocks){
+            IR::relinkBranch(block);
+        }
+        forward.clear();
+    }
+    IR::relinkCalls(funcMap);
+}
+
+bool TailCallPass::isTail(const IR::CFG& cfg, const IR::FuncCallLink& link, const IR::CallSite& site, bool& fallsToEnd){
+    const std::vector<IR::Instrction>& instrs = site.block->instructions;
+    size_t pos = site.position + 1;
+    // Copy of return value
+    if(link.resultIndex){
+        if(pos + 1 >= instrs.size() || IR::getInstrIndex(instrs[pos + 1]) != *link.resultIndex){
+            return false;
+        }
+        pos += 2;
+    }
+    // Caller returns the value of call, or nothing
+    size_t allowedUses = 0;
+    if(pos < instrs.size() && std::holds_alternative<IR::StoreReg>(instrs[pos]) && std::get<IR::StoreReg>(instrs[pos]).operand1 == IR::Register::rval){
+        if(!link.resultIndex || std::get<IR::StoreReg>(instrs[pos]).operand2 != *link.resultIndex){
+            return false;
+        }
+        allowedUses = 1;
+    }
+    if(link.resultIndex){
+        size_t uses = 0;
+        for(const std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+            for(IR::Instrction instr : block->instructions){
+                IR::forEachOperand(instr, [&](IR::index_t& operand){
+                    uses += (operand == *link.resultIndex) ? 1 : 0;
+                });
+            }
+        }
+        if(uses != allowedUses){
+            return false;
+        }
+    }
+    if(pos < instrs.size()){
+        // Return sequence
+        fallsToEnd = false;
+        return std::holds_alternative<IR::Bra>(instrs.back()) && std::get<IR::Bra>(instrs.back()).operand == IR::Register::pc
+            && IR::returnStart(instrs, instrs.size() - 1) == pos;
+    }
+    // Blocks after the call do nothing until the end of function
+    fallsToEnd = true;
+    for(std::shared_ptr<IR::BasicBlock> block = site.block; block; block = block->fallThrough){
+        if(block->branch){
+            return false;
+        }
+        if(block != site.block && std::any_of(block->instructions.begin(), block->instructions.end(), [](const IR::Instrction& instr){
+            return !std::holds_alternative<IR::Nop>(instr);
+        })){
+            return false;
+        }
+    }
+    return true;
+}
+
+void TailCallPass::cutAfterCall(TailCall& tailCall){
+    std::vector<IR::Instrction>& instrs = tailCall.site.block->instructions;
+    instrs.resize(tailCall.site.position);
+    std::erase_if(instrs, [&tailCall](IR::Instrction& instr){
+        return tailCall.site.setup.contains(IR::getInstrIndex(instr));
+    });
+    // Path to the end of function is not taken anymore, blocks on it have only Nop
+    if(tailCall.fallsToEnd){
+        tailCall.site.block->fallThrough = nullptr;
+    }
+}
+
+void TailCallPass::reuseFrame(TailCall& tailCall, const std::shared_ptr<IR::FuncEntry>& callee){
+    IR::Bra call = std::get<IR::Bra>(tailCall.site.block->instructions[tailCall.site.position]);
+    cutAfterCall(tailCall);
+    // Return address and fp in current frame are passed to callee as they are
+    std::vector<IR::Instrction>& instrs = tailCall.site.block->instructions;
+    for(std::pair<SymbolId, IR::index_t>& param : tailCall.link.params){
+        IR::index_t offset = IR::getInstrIndex(instrs.emplace_back(IR::Const(callee->paramAddrMap.at(param.first))));
+        IR::index_t address = IR::getInstrIndex(instrs.emplace_back(IR::Add(IR::Register::fp, offset)));
+        instrs.emplace_back(IR::Store(param.second, address));
+    }
+    instrs.emplace_back(call);
+    tailCall.link.block = tailCall.site.block;
+    tailCall.link.resultIndex.reset();
+}
+
+void TailCallPass::loopToRoot(const std::shared_ptr<IR::FuncEntry>& entry, std::vector<TailCall>& tailCalls){
+    IR::CFG cfg(entry);
+    std::shared_ptr<IR::BasicBlock> header = entry->root;
+    if(header->instructions.empty()){
+        header->instructions.emplace_back(IR::Nop());
+    }
+
+    // Loads of parameters
+    std::unordered_map<IR::index_t, int32_t> constants;
+    std::unordered_map<IR::index_t, int32_t> frameOffsets;
+    std::vector<std::pair<IR::index_t, int32_t>> paramLoads;
+    for(std::shared_ptr<IR::BasicBlock>& block : cfg.blocks){
+        for(IR::Instrction& instr : block->instructions){
+            if(std::holds_alternative<IR::Const>(instr)){
+                constants[std::get<IR::Const>(instr).index] = std::get<IR::Const>(instr).value;
+            }else if(std::holds_alternative<IR::Add>(instr)){
+                IR::Add& add = std::get<IR::Add>(instr);
+                if(add.operand1 == IR::Register::fp && constants.contains(add.operand2)){
+                    frameOffsets[add.index] = constants[add.operand2];
+                }
+            }else if(std::holds_alternative<IR::Load>(instr) && frameOffsets.contains(std::get<IR::Load>(instr).operand)){
+                paramLoads.emplace_back(std::get<IR::Load>(instr).index, frameOffsets[std::get<IR::Load>(instr).operand]);
+            }
+        }
+    }
+    for(TailCall& tailCall : tailCalls){
+        cutAfterCall(tailCall);
+    }
+
+    // Parameters passed from caller are loaded in the new root
+    std::shared_ptr<IR::BasicBlock> root = std::make_shared<IR::BasicBlock>();
+    root->instructions.emplace_back(IR::Nop());
+    root->fallThrough = header;
+    header->dominator = root;
+    std::vector<IR::index_t> initValues;
+    for(SymbolId paramName : entry->paramNames){
+        IR::index_t offset = IR::getInstrIndex(root->instructions.emplace_back(IR::Const(entry->paramAddrMap.at(paramName))));
+        IR::index_t address = IR::getInstrIndex(root->instructions.emplace_back(IR::Add(IR::Register::fp, offset)));
+        initValues.push_back(IR::getInstrIndex(root->instructions.emplace_back(IR::Load(address))));
+    }
+
+    // Parameters of next iteration
+    std::vector<IR::index_t> nextValues;
+    std::shared_ptr<IR::BasicBlock> latch = header;
+    if(tailCalls.size() == 1){
+        for(std::pair<SymbolId, IR::index_t>& param : tailCalls[0].link.params){
+            nextValues.push_back(param.second);
+        }
+    }else{
+        // Phi has only two operands, values from several calls are merged through frame
+        latch = std::make_shared<IR::BasicBlock>();
+        latch->dominator = header;
+        for(TailCall& tailCall : tailCalls){
+            std::vector<IR::Instrction>& instrs = tailCall.site.block->instructions;
+            for(std::pair<SymbolId, IR::index_t>& param : tailCall.link.params){
+                IR::index_t offset = IR::getInstrIndex(instrs.emplace_back(IR::Const(entry->paramAddrMap.at(param.first))));
+                IR::index_t address = IR::getInstrIndex(instrs.emplace_back(IR::Add(IR::Register::fp, offset)));
+                instrs.emplace_back(IR::Store(param.second, address));
+            }
+        }
+        for(SymbolId paramName : entry->paramNames){
+            IR::index_t offset = IR::getInstrIndex(latch->instructions.emplace_back(IR::Const(entry->paramAddrMap.at(paramName))));
+            IR::index_t address = IR::getInstrIndex(latch->instructions.emplace_back(IR::Add(IR::Register::fp, offset)));
+            nextValues.push_back(IR::getInstrIndex(latch->instructions.emplace_back(IR::Load(address))));
+        }
+        latch->instructions.emplace_back(IR::Bra(IR::getInstrIndex(header->instructions.front())));
+        latch->branch = header;
+    }
+    for(TailCall& tailCall : tailCalls){
+        tailCall.site.block->instructions.emplace_back(IR::Bra(IR::getInstrIndex(latch->instructions.front())));
+        tailCall.site.block->branch = latch;
+    }
+
+    // Parameters become Phi in the old root
+    std::vector<IR::Instrction> phis;
+    std::unordered_map<int32_t, IR::index_t> paramPhis;
+    for(size_t i = 0; i < entry->paramNames.size(); ++i){
+        IR::index_t phi = IR::getInstrIndex(phis.emplace_back(IR::Phi(initValues[i], nextValues[i])));
+        paramPhis[entry->paramAddrMap.at(entry->paramNames[i])] = phi;
+    }
+    header->instructions.insert(header->instructions.begin(), phis.begin(), phis.end());
+    std::set<IR::index_t> removedSet;
+    for(std::pair<IR::index_t, int32_t>& paramLoad : paramLoads){
+        if(paramPhis.contains(paramLoad.second)){
+            forward[paramLoad.first] = paramPhis[paramLoad.second];
+            removedSet.insert(paramLoad.first);
+        }
+    }
+    entry->root = root;
+    for(std::shared_ptr<IR::BasicBlock>& block : IR::CFG(entry).blocks){
+        std::erase_if(block->instructions, [&removedSet](IR::Instrction& instr){
+            return removedSet.contains(IR::getInstrIndex(instr));
+        });
+        for(IR::Instrction& instr : block->instructions){
+            IR::forEachOperand(instr, [this](IR::index_t& operand){
+                replace(operand);
+            });
+        }
+    }
+
+    // Calls turned into branches
+    std::erase_if(entry->callLinks, [&tailCalls](IR::FuncCallLink& link){
+        return std::any_of(tailCalls.begin(), tailCalls.end(), [&link](TailCall& tailCall){
+            return tailCall.link.callIndex == link.callIndex;
+        });
+    });
+    for(IR::FuncCallLink& link : entry->callLinks){
+        for(std::pair<SymbolId, IR::index_t>& param : link.params){
+            replace(param.second);
+        }
+    }
+}
+
+void TailCallPass::replace(IR::index_t& operand){
+    std::unordered_map<IR::index_t, IR::index_t>::iterator it = forward.find(operand);
+    while(it != forward.end()){
+        operand = it->second;
+        it = forward.find(operand);
+    }
+}
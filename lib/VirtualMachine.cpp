@@ -0,0 +1,349 @@
+/**
+ * Copyright 2021 Luis Hsu. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include <VirtualMachine.hpp>
+#include <Exception.hpp>
+
+#include <algorithm>
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#endif
+
+// Opcode is replaced by the address of its handler in threaded code
+union Word{
+    const void* label;
+    VM::Opcode opcode;
+    int32_t value;
+};
+
+#ifdef VM_COMPUTED_GOTO
+#define HANDLER(op) op##Handler: ++executed[(size_t)VM::Opcode::op];
+#define DISPATCH() goto *ip->label
+#else
+#define HANDLER(op) case VM::Opcode::op: ++executed[(size_t)VM::Opcode::op];
+#define DISPATCH() continue
+#endif
+#define NEXT(size) ip += size; DISPATCH()
+#define OPERAND(n) (ip[n].value)
+#define REG(n) (regs[ip[n].value])
+
+const size_t VM::VirtualMachine::defaultMemorySize = 1 << 22;
+const size_t VM::VirtualMachine::defaultStackSize = 1 << 26;
+
+// Arithmetic wraps around in 32 bits like the interpreter
+static inline int32_t add(int32_t value1, int32_t value2){
+    return (int32_t)((uint32_t)value1 + (uint32_t)value2);
+}
+
+static inline int32_t sub(int32_t value1, int32_t value2){
+    return (int32_t)((uint32_t)value1 - (uint32_t)value2);
+}
+
+static inline int32_t mul(int32_t value1, int32_t value2){
+    return (int32_t)((uint32_t)value1 * (uint32_t)value2);
+}
+
+static inline size_t wordAt(int32_t address, size_t size){
+    if((uint32_t)address / INT_SIZE >= size || address % INT_SIZE != 0){
+        throw Exception(std::string("invalid memory access at ") + std::to_string(address));
+    }
+    return address / INT_SIZE;
+}
+
+static inline size_t codeAt(int32_t address, size_t size){
+    if((uint32_t)address / INT_SIZE >= size || address % INT_SIZE != 0){
+        throw Exception(std::string("invalid code address ") + std::to_string(address));
+    }
+    return address / INT_SIZE;
+}
+
+VM::VirtualMachine::VirtualMachine(std::istream& input, std::ostream& output, size_t memorySize, size_t stackSize):
+    input(input), output(output), memorySize(memorySize), stackSize(stackSize)
+{
+}
+
+void VM::VirtualMachine::run(const VM::Bytecode& bytecode){
+#ifdef VM_COMPUTED_GOTO
+    // In the order of Opcode
+    static const void* handlers[] = {
+        &&HaltHandler, &&ImmHandler, &&MovHandler, &&NegHandler, &&AddHandler, &&SubHandler, &&MulHandler, &&DivHandler,
+        &&CmpHandler, &&LoadHandler, &&StoreHandler, &&JmpHandler, &&BneHandler, &&BeqHandler, &&BleHandler, &&BltHandler,
+        &&BgeHandler, &&BgtHandler, &&CallHandler, &&RetHandler, &&LeaveHandler, &&ReadHandler, &&WriteHandler, &&WriteNLHandler,
+        &&AddIHandler, &&SubIHandler, &&MulIHandler, &&CmpBneHandler, &&CmpBeqHandler, &&CmpBleHandler, &&CmpBltHandler,
+        &&CmpBgeHandler, &&CmpBgtHandler, &&CmpBneIHandler, &&CmpBeqIHandler, &&CmpBleIHandler, &&CmpBltIHandler,
+        &&CmpBgeIHandler, &&CmpBgtIHandler, &&LoadOffsetHandler, &&StoreOffsetHandler, &&LoadIndexedHandler,
+        &&StoreIndexedHandler,
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == VM::opcodeCount);
+#endif
+    std::vector<Word> code(bytecode.code.size());
+    for(size_t pos = 0; pos < code.size();){
+        VM::Opcode opcode = (VM::Opcode)bytecode.code[pos];
+#ifdef VM_COMPUTED_GOTO
+        code[pos].label = handlers[(size_t)opcode];
+#else
+        code[pos].opcode = opcode;
+#endif
+        for(size_t i = 1; i < VM::instrSize(opcode); ++i){
+            code[pos + i].value = bytecode.code[pos + i];
+        }
+        pos += VM::instrSize(opcode);
+    }
+
+    memory.assign(memorySize, 0);
+    counts.clear();
+    size_t executed[VM::opcodeCount] = {};
+    bool lineStart = true;
+    // Frame of _main starts at 0
+    frames.assign(1, Frame {0, 0, bytecode.windowSizes.at("_main")});
+    stack.assign(std::max(frames[0].windowSize, std::min<size_t>(1 << 16, stackSize)), 0);
+    int32_t* regs = stack.data();
+    regs[VM::Slot::fp] = 0;
+    regs[VM::Slot::rval] = 0;
+    Word* ip = code.data() + bytecode.entry;
+
+#ifdef VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+    while(true){
+        switch(ip->opcode){
+#endif
+    HANDLER(Halt){
+        goto halted;
+    }
+    HANDLER(Imm){
+        REG(1) = OPERAND(2);
+        NEXT(3);
+    }
+    HANDLER(Mov){
+        REG(1) = REG(2);
+        NEXT(3);
+    }
+    HANDLER(Neg){
+        REG(1) = sub(0, REG(2));
+        NEXT(3);
+    }
+    HANDLER(Add){
+        REG(1) = add(REG(2), REG(3));
+        NEXT(4);
+    }
+    HANDLER(Sub){
+        REG(1) = sub(REG(2), REG(3));
+        NEXT(4);
+    }
+    HANDLER(Mul){
+        REG(1) = mul(REG(2), REG(3));
+        NEXT(4);
+    }
+    HANDLER(Div){
+        if(REG(3) == 0){
+            throw Exception("division by zero");
+        }
+        // INT_MIN / -1 wraps around to INT_MIN
+        REG(1) = (REG(3) == -1) ? sub(0, REG(2)) : REG(2) / REG(3);
+        NEXT(4);
+    }
+    HANDLER(Cmp){
+        REG(1) = (REG(2) > REG(3)) - (REG(2) < REG(3));
+        NEXT(4);
+    }
+    HANDLER(Load){
+        REG(1) = memory[wordAt(REG(2), memory.size())];
+        NEXT(3);
+    }
+    HANDLER(Store){
+        memory[wordAt(REG(2), memory.size())] = REG(1);
+        NEXT(3);
+    }
+    HANDLER(Jmp){
+        ip = code.data() + OPERAND(1);
+        DISPATCH();
+    }
+    HANDLER(Bne){
+        ip = (REG(1) != 0) ? code.data() + OPERAND(2) : ip + 3;
+        DISPATCH();
+    }
+    HANDLER(Beq){
+        ip = (REG(1) == 0) ? code.data() + OPERAND(2) : ip + 3;
+        DISPATCH();
+    }
+    HANDLER(Ble){
+        ip = (REG(1) <= 0) ? code.data() + OPERAND(2) : ip + 3;
+        DISPATCH();
+    }
+    HANDLER(Blt){
+        ip = (REG(1) < 0) ? code.data() + OPERAND(2) : ip + 3;
+        DISPATCH();
+    }
+    HANDLER(Bge){
+        ip = (REG(1) >= 0) ? code.data() + OPERAND(2) : ip + 3;
+        DISPATCH();
+    }
+    HANDLER(Bgt){
+        ip = (REG(1) > 0) ? code.data() + OPERAND(2) : ip + 3;
+        DISPATCH();
+    }
+    HANDLER(Call){
+        // Frame is reused by tail call
+        Frame& frame = frames.back();
+        size_t windowSize = OPERAND(2);
+        if(regs[VM::Slot::fp] == frame.fp){
+            frame.windowSize = windowSize;
+        }else{
+            frames.emplace_back(Frame {regs[VM::Slot::fp], frame.base + frame.windowSize, windowSize});
+        }
+        // Stack grows up to its limit
+        if(frames.back().base + windowSize > stack.size()){
+            if(frames.back().base + windowSize > stackSize){
+                throw Exception("register stack overflow");
+            }
+            stack.resize(std::min(std::max(stack.size() * 2, frames.back().base + windowSize), stackSize));
+        }
+        regs = stack.data() + frames.back().base;
+        regs[VM::Slot::fp] = frames.back().fp;
+        ip = code.data() + OPERAND(1);
+        DISPATCH();
+    }
+    HANDLER(Ret){
+        if(frames.size() == 1){
+            throw Exception("return from _main");
+        }
+        int32_t returnAddr = regs[VM::Slot::pc];
+        int32_t framePtr = regs[VM::Slot::fp];
+        int32_t result = regs[VM::Slot::rval];
+        frames.pop_back();
+        regs = stack.data() + frames.back().base;
+        regs[VM::Slot::fp] = framePtr;
+        regs[VM::Slot::rval] = result;
+        ip = code.data() + codeAt(returnAddr, code.size());
+        DISPATCH();
+    }
+    HANDLER(Leave){
+        if(frames.size() == 1){
+            throw Exception("return from _main");
+        }
+        int32_t returnAddr = memory[wordAt(regs[VM::Slot::fp], memory.size())];
+        int32_t framePtr = memory[wordAt(add(regs[VM::Slot::fp], INT_SIZE), memory.size())];
+        int32_t result = regs[VM::Slot::rval];
+        frames.pop_back();
+        regs = stack.data() + frames.back().base;
+        regs[VM::Slot::fp] = framePtr;
+        regs[VM::Slot::rval] = result;
+        ip = code.data() + codeAt(returnAddr, code.size());
+        DISPATCH();
+    }
+    HANDLER(Read){
+        if(!(input >> REG(1))){
+            throw Exception("no number to read");
+        }
+        NEXT(2);
+    }
+    HANDLER(Write){
+        if(!lineStart){
+            output << " ";
+        }
+        output << REG(1);
+        lineStart = false;
+        NEXT(2);
+    }
+    HANDLER(WriteNL){
+        output << "\n";
+        lineStart = true;
+        NEXT(1);
+    }
+    HANDLER(AddI){
+        REG(1) = add(REG(2), OPERAND(3));
+        NEXT(4);
+    }
+    HANDLER(SubI){
+        REG(1) = sub(REG(2), OPERAND(3));
+        NEXT(4);
+    }
+    HANDLER(MulI){
+        REG(1) = mul(REG(2), OPERAND(3));
+        NEXT(4);
+    }
+    HANDLER(CmpBne){
+        ip = (REG(1) != REG(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBeq){
+        ip = (REG(1) == REG(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBle){
+        ip = (REG(1) <= REG(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBlt){
+        ip = (REG(1) < REG(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBge){
+        ip = (REG(1) >= REG(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBgt){
+        ip = (REG(1) > REG(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBneI){
+        ip = (REG(1) != OPERAND(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBeqI){
+        ip = (REG(1) == OPERAND(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBleI){
+        ip = (REG(1) <= OPERAND(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBltI){
+        ip = (REG(1) < OPERAND(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBgeI){
+        ip = (REG(1) >= OPERAND(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(CmpBgtI){
+        ip = (REG(1) > OPERAND(2)) ? code.data() + OPERAND(3) : ip + 4;
+        DISPATCH();
+    }
+    HANDLER(LoadOffset){
+        REG(1) = memory[wordAt(add(REG(2), OPERAND(3)), memory.size())];
+        NEXT(4);
+    }
+    HANDLER(StoreOffset){
+        memory[wordAt(add(REG(2), OPERAND(3)), memory.size())] = REG(1);
+        NEXT(4);
+    }
+    HANDLER(LoadIndexed){
+        REG(1) = memory[wordAt(add(REG(2), mul(REG(3), OPERAND(4))), memory.size())];
+        NEXT(5);
+    }
+    HANDLER(StoreIndexed){
+        memory[wordAt(add(REG(2), mul(REG(3), OPERAND(4))), memory.size())] = REG(1);
+        NEXT(5);
+    }
+#ifndef VM_COMPUTED_GOTO
+        }
+    }
+#endif
+
+halted:
+    if(!lineStart){
+        output << "\n";
+    }
+    output.flush();
+    for(size_t opcode = 0; opcode < VM::opcodeCount; ++opcode){
+        if(executed[opcode] > 0){
+            counts[(VM::Opcode)opcode] = executed[opcode];
+        }
+    }
+}
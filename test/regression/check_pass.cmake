@@ -0,0 +1,36 @@
+# Run smplc on SAMPLE reading INPUT with and without the pass turned off by the first word of PASS, and check
+# that the pass lowers the count of the interpreter named by the second word, or the total of instructions executed
+separate_arguments(PASS)
+list(GET PASS 0 disable)
+list(LENGTH PASS pass_length)
+if(pass_length GREATER 1)
+    list(GET PASS 1 counter)
+    set(count_regex " ${counter}: ([0-9]+)")
+else()
+    set(counter "instructions")
+    set(count_regex "([0-9]+) instructions executed")
+endif()
+foreach(mode IN ITEMS enabled disabled)
+    if(mode STREQUAL "enabled")
+        set(args --run)
+    else()
+        set(args ${disable} --run)
+    endif()
+    execute_process(COMMAND ${SMPLC} ${args} ${SAMPLE}
+        INPUT_FILE ${INPUT}
+        OUTPUT_QUIET
+        ERROR_VARIABLE error
+        RESULT_VARIABLE result
+    )
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "smplc ${args} exited with ${result}\n${error}")
+    endif()
+    # Counter not printed is never executed
+    set(count_${mode} 0)
+    if(error MATCHES "${count_regex}")
+        set(count_${mode} ${CMAKE_MATCH_1})
+    endif()
+endforeach()
+if(NOT count_enabled LESS count_disabled)
+    message(FATAL_ERROR "${counter} executed: ${count_enabled}, ${count_disabled} with ${disable}")
+endif()
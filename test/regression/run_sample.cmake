@@ -0,0 +1,15 @@
+# Run smplc with ARGS on SAMPLE, reading INPUT, and compare what it prints with EXPECTED
+separate_arguments(ARGS)
+execute_process(COMMAND ${SMPLC} ${ARGS} ${SAMPLE}
+    INPUT_FILE ${INPUT}
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE error
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "smplc ${ARGS} exited with ${result}\n${error}")
+endif()
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "smplc ${ARGS} printed\n${output}\nexpected\n${expected}")
+endif()